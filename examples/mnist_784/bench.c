@@ -0,0 +1,39 @@
+//bench.c
+#include "qmtik_config.h"
+#define QMTIK_BENCH
+#define QMTIK_IMPLEMENTATION
+#include "qmtik.h"
+
+#define BENCH_SAMPLES 1024
+#define BENCH_ITERATIONS 10000
+
+static QMTIK_SamplePair samples[BENCH_SAMPLES];
+static double latencies[BENCH_ITERATIONS];
+static QMTIK_QNetwork q_network;
+static QMTIK_Network network;
+int main() {
+    size_t n_samples=0;
+    FILE* infer_file=fopen("mnist_784_infer", "rb");
+    if (infer_file){
+        n_samples=fread(samples, sizeof(QMTIK_SamplePair), BENCH_SAMPLES, infer_file);
+        fclose(infer_file);
+    }
+    if (!n_samples){
+        fprintf(stderr, "No mnist_784_infer samples, benchmarking random ones\n");
+        for (n_samples=0; n_samples<BENCH_SAMPLES; ++n_samples){
+            for (size_t i=0; i<QMTIK_I; ++i) samples[n_samples].input[i]=(QMTIK_QActvT)(rand()%128);
+            for (size_t i=0; i<QMTIK_O; ++i) samples[n_samples].output[i]=(rand()%QMTIK_O==0)?127:0;
+        }
+    }
+    QMTIK_BenchResult result={0};
+    if (QMTIK_bench_infer(&result, &q_network, "mnist_784_model", samples, n_samples, latencies, BENCH_ITERATIONS)) return 1;
+    long n_threads=sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads<1) n_threads=1;
+    QMTIK_TrainContext* contexts=calloc((size_t)n_threads, sizeof(QMTIK_TrainContext));
+    if (!contexts){perror("Failed to allocate training contexts"); return 1;}
+    QMTIK_init_weights(&network);
+    QMTIK_bench_train(&result, &network, contexts, (size_t)n_threads, samples, n_samples);
+    free(contexts);
+    QMTIK_write_bench_json(&result, stdout);
+    return 0;
+}
@@ -0,0 +1,19 @@
+//compile.c
+#include "qmtik_config.h"
+#define QMTIK_IMPLEMENTATION
+#include "qmtik.h"
+
+static QMTIK_QModel q_model;
+int main() {
+    FILE* q_model_file=fopen("mnist_784_model", "rb");
+    if (!q_model_file){perror("Failed to open model file"); return 1;}
+    if (QMTIK_load_q_model(&q_model, q_model_file)) return 1;
+    fclose(q_model_file);
+    FILE* c_file=fopen("mnist_784_model.c", "w");
+    FILE* h_file=fopen("mnist_784_model.h", "w");
+    if (!c_file||!h_file){perror("Failed to open compiled model files"); return 1;}
+    if (QMTIK_compile_model(&q_model, "mnist_784_model", 8, c_file, h_file)) return 1;
+    fclose(c_file);
+    fclose(h_file);
+    return 0;
+}
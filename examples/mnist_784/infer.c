@@ -11,7 +11,7 @@ int main() {
     fclose(q_model_file);
     FILE* infer_file=fopen("mnist_784_infer", "rb");
     if (!infer_file){perror("Failed to open model file"); return 1;}
-    printf("PERFORMANCE AFTER QUANT: %f\n", QMTIK_test_after_quant(&q_network, infer_file));
+    printf("PERFORMANCE AFTER QUANT: %f\n", QMTIK_test_after_quant_parallel(&q_network.q_model, infer_file, 0));
     fclose(infer_file);
     return 0;
 }
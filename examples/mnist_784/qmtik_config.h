@@ -12,8 +12,12 @@
 #define QMTIK_BETA1 0.9f
 #define QMTIK_BETA2 0.999f
 #define QMTIK_EPS 1e-8f
+#define QMTIK_TRAIN_BATCH 32
 #define QMTIK_EPOCHS_DEBUG_UPDATE_POINT 1
 #define QMTIK_SAMPLE_NUMBER_DEBUG_UPDATE_POINT 1024
 #define QMTIK_TRAIN_DEBUG
 #define QMTIK_TEST_BEFORE_QUANT_DEBUG
 #define QMTIK_TEST_AFTER_QUANT_DEBUG
+#define QMTIK_SIMD
+#define QMTIK_THREADS
+#define QMTIK_MMAP
@@ -4,11 +4,20 @@
 #include "qmtik.h"
 
 int main() {
-    QMTIK_Network network={0};
+    static QMTIK_Network network={0};
     QMTIK_init_weights(&network);
     FILE* train_file=fopen("mnist_784_train", "rb");
     if (!train_file){perror("Failed to open model file"); return 1;}
-    QMTIK_train(&network, train_file);
+    long n_threads=sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads<1) n_threads=1;
+    QMTIK_TrainContext* contexts=calloc((size_t)n_threads, sizeof(QMTIK_TrainContext));
+    if (!contexts){perror("Failed to allocate training contexts"); return 1;}
+    static QMTIK_Dataset train_set={0};
+    if (QMTIK_map_dataset(&train_set, "mnist_784_train")) return 1;
+    QMTIK_shuffle_dataset(&train_set, 42);
+    QMTIK_train_dataset(&network, &train_set, contexts, (size_t)n_threads);
+    QMTIK_close_dataset(&train_set);
+    free(contexts);
     printf("PERFORMANCE BEFORE QUANT: %f\n", QMTIK_test_before_quant(&network, train_file));
     fclose(train_file);
     QMTIK_Model model={0};
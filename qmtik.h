@@ -22,6 +22,10 @@ CONFIGURATION:
     #define QMTIK_BETA1 0.9f
     #define QMTIK_BETA2 0.999f
     #define QMTIK_EPS 1e-8f
+    #define QMTIK_TRAIN_BATCH 32 // Samples averaged per Adam update (default 1, plain per-sample SGD)
+    #define QMTIK_WARMUP_STEPS 500 // Adam updates over which the step size ramps linearly up (default 0)
+    #define QMTIK_COSINE_LR    // Cosine decay of QMTIK_ALPHA over the epochs down to QMTIK_MIN_ALPHA (default 0)
+    // #define QMTIK_STEP_LR 3 // Or multiply QMTIK_ALPHA by QMTIK_LR_GAMMA every 3 epochs (default 0.1)
     
     // Choose activation function (define one)
     #define QMTIK_RELU_ACTV
@@ -38,6 +42,26 @@ CONFIGURATION:
     #define QMTIK_MSE_COST
     // #define QMTIK_CROSS_ENTROPY_COST
 
+    // Inference kernels (optional, x86 GCC/Clang)
+    #define QMTIK_SIMD         // SSE4.1/AVX2/AVX-512 VNNI kernels picked at load time via cpuid
+    #define QMTIK_BATCH 16     // Samples per weight tile pass in QMTIK_infer_forward_batch (default 16)
+    #define QMTIK_THREADS      // pthread based helpers such as QMTIK_train_parallel and QMTIK_test_after_quant_parallel (link with -pthread)
+    #define QMTIK_MMAP         // POSIX QMTIK_map_model and QMTIK_map_dataset zero-copy loaders, mapped training checkpoints
+    #define QMTIK_INT4_WGHT    // Two weights per byte with a per-row scale, QMTIK_W_SCALE still scales the INT8 biases
+    #define QMTIK_PRUNE_PERCENT 90 // Prune this share of 4x16 input weight blocks during training and store the input layer block-sparse
+    #define QMTIK_PRUNE_EPOCHS 6   // Epochs over which pruning ramps up to QMTIK_PRUNE_PERCENT (default QMTIK_EPOCHS-1)
+    #define QMTIK_SKIP_ZERO_ACTV   // Also store HH/O weights column-wise and only accumulate the columns of non-zero activations
+    #define QMTIK_ACTV_DENSITY 0.3f // Non-zero share of a layer input below which the column kernels are used (default per kernel)
+    #define QMTIK_MAX_THREADS 64
+    #define QMTIK_SPIN_LIMIT 4096 // Pause spins before a waiting inference or training pool thread yields or sleeps (default 4096)
+    #define QMTIK_BENCH        // QMTIK_bench_infer/QMTIK_bench_train timing harness with JSON output (POSIX clock_gettime)
+    #define QMTIK_PROFILE      // Per-layer time and int8 saturation counters in inference, training and quantization
+    #define QMTIK_PROFILE_CLOCK() read_cycle_counter() // Profile time source (default rdtsc on x86, else clock_gettime ns)
+    #define QMTIK_SERVE        // In-process micro-batching inference server over a lock-free queue (needs QMTIK_THREADS)
+    #define QMTIK_SERVE_QUEUE 1024   // Requests the server queue holds, a power of two (default 1024)
+    #define QMTIK_SERVE_MAX_BATCH 64 // Upper bound for a server's max_batch (default 64)
+    #define QMTIK_FINETUNE_HH  // QMTIK_finetune_step also updates the last hidden layer, an int16 copy of its HxH weights
+
     // Define debugging (optional)
     #define QMTIK_EPOCHS_DEBUG_UPDATE_POINT 1
     #define QMTIK_SAMPLE_NUMBER_DEBUG_UPDATE_POINT 1024
@@ -72,14 +96,14 @@ Training:
     #include "qmtik.h"
     
     int main() {
-        QMTIK_Network network;
+        static QMTIK_Network network; // several MB with the Adam state and shadow weights, too big for the stack
         QMTIK_init_weights(&network);
         
         FILE* train_file = fopen("train", "rb");
         QMTIK_train(&network, train_file);
         fclose(train_file);
         
-        QMTIK_Model model;
+        static QMTIK_Model model;
         QMTIK_quantize_to_model(&network, &model);
         
         FILE* model_file=fopen("model", "wb");
@@ -122,9 +146,137 @@ Infering:
         return 0;
     }
 
+MODEL FILE FORMAT:
+    QMTIK_store_model writes a 64 byte QMTIK_ModelHeader (magic, version, topology, scales, activation and
+    post processing ids, flags, payload size, FNV-1a checksum) followed by the QMTIK_QModel layers in native
+    byte order, whose weight sections are 64 byte aligned. The checksum is summed in a first pass, so the file is written
+    front to back and can go to a pipe. Weights are stored row-major once, SIMD panels are not part of the file. QMTIK_INT4_WGHT models set a header flag and store packed
+    nibble rows (even column in the low nibble) with a float scale and fixed-point rescale per row. QMTIK_PRUNE_PERCENT
+    models set another flag and store the input layer as the kept 4x16 weight blocks with their column indices and row group ends,
+    QMTIK_SKIP_ZERO_ACTV models add transposed HH and O weights after the layers. QMTIK_load_model reads it straight into the
+    QMTIK_QModel and repacks the panels of SIMD builds, QMTIK_map_model points the inference engine at the mapped file
+    (SIMD builds repack the panels into pages behind it), so SIMD and portable builds read each other's files. Files from
+    SIMD builds that still carry a panel section are accepted by both. Headerless files written
+    by QMTIK 1.0 are still accepted by QMTIK_load_model.
+
+MODEL COMPILER:
+    QMTIK_compile_model(q_model, "name", unroll, c_file, h_file) writes name.c/name.h with every weight as a flat static
+    const array and void name_infer(const int8_t input[I], int8_t output[O]), bit-exact with QMTIK_infer. Sizes, requant
+    constants, the activation and post processing are folded in, unroll>1 adds #pragma GCC unroll to the inner loops.
+    The generated pair only needs <stdint.h>, weights and tables stay in flash/.rodata and only two activation rows use RAM.
+
+ACTIVATION TABLES:
+    Inference never calls expf/tanhf. Sigmoid and tanh become 255 accumulator breakpoints per output level, found once from
+    the scales on the first model load (per runtime network on QMTIK_rt_instantiate), and an 8 step search reproduces the
+    float activation exactly. QMTIK_SIGMOID_PP is a 256 entry table, QMTIK_SOFT_MAX_PP an exp table with a fixed-point
+    reciprocal of the sum, within 1 of the float softmax at exact half ties. With QMTIK_CROSS_ENTROPY_COST,
+    QMTIK_infer_class(q_model, q_context) skips post processing and returns the argmax of the output layer.
+
+DELTA INFERENCE:
+    For input streams where few of the QMTIK_I inputs change between frames, QMTIK_infer_delta(q_model, q_context, &q_delta)
+    keeps the input layer's int32 dot products in a per-stream QMTIK_QDelta and only adds the weight columns of changed
+    inputs (acc+=w[:,j]*dx_j) before running the remaining layers as usual. Outputs are bit-identical to QMTIK_infer.
+    Zero the QMTIK_QDelta or call QMTIK_reset_delta before the first frame and whenever the model changes.
+
+INTRA-OP PARALLEL INFERENCE:
+    With QMTIK_THREADS, QMTIK_start_infer_pool(&pool, n_threads, pin) starts n_threads-1 persistent workers. The caller
+    is thread 0. QMTIK_infer_parallel(&pool, q_model, q_context) splits the output neurons of every layer into
+    QMTIK_PANEL_R aligned row ranges, one per thread, with a spin barrier between layers. It lowers the latency of one
+    request on wide layers, outputs are bit-identical to QMTIK_infer. Waiting threads spin QMTIK_SPIN_LIMIT pauses, then
+    barrier waits yield and idle workers sleep. With pin set, worker t is pinned to CPU t on Linux builds with
+    _GNU_SOURCE. A pruned input layer runs on the caller alone, and the QMTIK_SKIP_ZERO_ACTV column kernels are
+    not used. One request at a time per pool, QMTIK_stop_infer_pool joins the workers.
+
+RUNTIME TOPOLOGIES:
+    A QMTIK_RtDesc lists n_layers+1 widths, one QMTIK_RT_* activation per layer, a post processing id and the scales, so
+    one binary can serve differently shaped INT8 models (e.g. 784-512-128-10) next to the compiled-in one:
+        size_t size=QMTIK_rt_arena_size(&desc);          // or QMTIK_rt_file_arena_size(file)
+        QMTIK_rt_instantiate(&rt, &desc, arena, size);    // then QMTIK_rt_set_layer per layer, or QMTIK_rt_load(&rt, arena, size, file)
+        QMTIK_rt_infer(&rt, scratch, input, output);      // scratch of rt.scratch_size bytes per thread
+    The scratch holds the accumulators and two ping-pong activation buffers, each sized for the widest layer of its parity.
+    Runtime networks are inference only, QMTIK_rt_model_desc and QMTIK_rt_from_q_model import a dense QMTIK_QModel.
+
+EXPORT OPTIMIZATION:
+    QMTIK_rt_plan_model(&plan, q_model, samples, n_samples) runs a dense INT8 QMTIK_QModel over a sample set (e.g. the
+    training set) and records the int8 range of every input and hidden neuron. Inputs and neurons that are constant
+    over it (padding pixels, ReLU neurons that never fire) are dropped and w*value is folded into the next layer's
+    accumulators. Neurons and input columns no kept neuron of the next layer weights are dropped as well.
+    plan.desc is the smaller topology and plan.macs/plan.dense_macs the work left:
+        QMTIK_rt_instantiate(&rt, &plan.desc, arena, QMTIK_rt_arena_size(&plan.desc));
+        QMTIK_rt_from_plan(&rt, &plan, q_model);         // then QMTIK_rt_store(&rt, file) keeps folds and gather map
+    The runtime network still takes QMTIK_I inputs and gathers the kept ones itself (QMTIK_rt_set_gather). Its outputs
+    match QMTIK_infer for every planned sample, an input seen changing later is still read as its planned constant.
+
+CALIBRATION:
+    QMTIK_calibrate(&calibration, network, calib_file, percentile, pow2) runs the float QMTIK_Network over the samples of
+    calib_file without fake quantization. It picks a weight scale per layer from the |weights| and an output scale per
+    layer from the |activations|, clipping at the given percentile of a QMTIK_CALIB_BINS histogram (100 keeps the
+    maximum). With pow2 every scale is rounded up to a power of two, so the requantization multiplier of each layer is
+    one and requantizing is a rounding shift. The scales then live in a runtime network, which stores them per layer:
+        QMTIK_rt_model_desc(&desc, widths, actvs);
+        QMTIK_rt_instantiate(&rt, &desc, arena, QMTIK_rt_arena_size(&desc));
+        QMTIK_rt_from_network(&rt, network, &calibration);   // or QMTIK_rt_set_scales on a hand built network
+    Inputs keep QMTIK_A_SCALE, QMTIK_W_SCALE and QMTIK_A_SCALE still drive training and QMTIK_Model.
+
+FINE-TUNING:
+    QMTIK_finetune_begin(&fine_tune, q_model, shift, seed) copies the output layer weight and bias codes into Q8 int16
+    masters (O*(H+1)*2 bytes, with QMTIK_FINETUNE_HH the last hidden layer too). The rest of the model stays frozen.
+    For a sample whose trunk activations are already in q_context (QMTIK_infer once, or cached q_hh_actv per sample
+    when running several passes), QMTIK_finetune_step reruns the tuned layers and post processing. It takes the
+    integer error q_o_z-expected and moves every master by error*input/2^shift codes, rounding stochastically with a
+    xorshift generator, then writes the codes back into q_model. The step returns the cost of the sample before the
+    update. A shift near log2(QMTIK_W_SCALE/(lr*QMTIK_A_SCALE)) matches plain SGD at rate lr. q_model must be a
+    writable copy, not a mapped or compiled model, and no other thread may infer with it during a step.
+
+TRAINING SCHEDULES:
+    The Adam step size is QMTIK_ALPHA unless a schedule is configured. QMTIK_COSINE_LR decays it per epoch along a
+    half cosine to QMTIK_MIN_ALPHA, QMTIK_STEP_LR n multiplies it by QMTIK_LR_GAMMA every n epochs. QMTIK_WARMUP_STEPS
+    ramps the first updates linearly up to the scheduled value. QMTIK_train_validated trains like QMTIK_train_dataset
+    (or QMTIK_train on train_file with a NULL dataset) and after every epoch quantizes the network into the caller's
+    validation.model, round trips it through QMTIK_store_model/QMTIK_load_q_model into validation.q_model and scores it
+    on validation.valid_file. The per-epoch cost, argmax accuracy, step size and seconds land in the QMTIK_Validation,
+    training stops after `patience` epochs without a better cost (lower, or higher under QMTIK_CROSS_ENTROPY_COST where
+    it is the hit rate) and, when validation.best is set, the network ends with the weights of validation.best_epoch.
+    Under QMTIK_PRUNE_PERCENT the epochs before QMTIK_PRUNE_EPOCHS are not scored.
+
+CHECKPOINTS:
+    With QMTIK_MMAP, QMTIK_open_checkpoint maps a training-state file holding a 4KB QMTIK_CheckpointHeader (topology,
+    epoch and sample positions), the live QMTIK_Network and two snapshots of it, weights and Adam state with t/b1t/b2t
+    included. Training works on the mapped network directly, so the kernel can page it out for large QMTIK_H and
+    nothing has to sit on the stack. A new file is created zeroed with resumed=0, so call
+    QMTIK_init_weights(checkpoint.network) first. Then QMTIK_resume_training snapshots the starting network and trains
+    to QMTIK_EPOCHS. Every `every` samples and at each epoch end QMTIK_sync_checkpoint copies the network into the older
+    slot, msyncs it and only then marks that slot current, so a kill or crash at any point leaves one complete
+    snapshot. Reopening the file restores the newest one. Call QMTIK_resume_training again: it skips the samples that
+    snapshot had seen in its epoch (same shuffle order for a QMTIK_Dataset), redoes the batches trained after it and
+    continues bit-identically.
+
+BENCHMARKING:
+    With QMTIK_BENCH, QMTIK_bench_infer fills a zeroed QMTIK_BenchResult with the mean model load time, single-sample
+    QMTIK_infer_forward latency (mean, p50, p99, p999), mean time per layer, effective GOPS and QMTIK_infer_forward_batch
+    samples/s. QMTIK_bench_train adds training samples/s over QMTIK_TRAIN_BATCH updates, QMTIK_write_bench_json prints
+    it all with the kernel and topology so runs of different builds and machines can be compared.
+
+SERVING:
+    With QMTIK_SERVE and QMTIK_THREADS, QMTIK_serve_start runs n_workers threads over one shared QMTIK_QModel. Callers fill
+    a QMTIK_ServeRequest input, QMTIK_serve_submit it (1 when the queue is full) and QMTIK_serve_wait for its output.
+    Each worker takes the oldest request, then waits for up to max_batch-1 more until max_wait_us after that request was
+    submitted, and runs the micro-batch through QMTIK_infer_forward_batch. Under bursty load this trades a bounded delay
+    for tile reuse across the batch. QMTIK_serve_stats reports queue depth, batch sizes and latency percentiles
+    (power-of-two microsecond buckets). QMTIK_serve_stop answers everything still queued, then joins the workers.
+
+PROFILING:
+    With QMTIK_PROFILE, every inference layer, QMTIK_train_forward layer, QMTIK_train_batch step and QMTIK_quantize_to_model
+    layer adds its QMTIK_PROFILE_CLOCK ticks, value count and saturated value count to a global QMTIK_Profile.
+    Inference counts int8 outputs sitting at -128/127, training counts tape activations and quantization counts
+    weights and biases whose rounded value fell outside the int8 range. Read it with QMTIK_get_profile, clear it with
+    QMTIK_reset_profile or see each sample as it happens with QMTIK_set_profile_hook. Without it nothing is compiled in.
+
 MEMORY REQUIREMENTS:
-    Training: ~sizeof(Network)
-    Inference: ~sizeof(QNetwork)
+    Training: ~sizeof(Network), plus sizeof(TrainContext) per thread for QMTIK_train_parallel
+    Checkpointed training: a 4KB+3*sizeof(Network) file (live network and two snapshots) mapped with QMTIK_open_checkpoint, paged in and out by the kernel
+    Inference: ~sizeof(QNetwork), or one shared read-only sizeof(QModel) plus sizeof(QContext) per thread
+    Runtime networks: QMTIK_rt_arena_size(&desc) shared, plus rt.scratch_size per thread
     Model storage: ~sizeof(Model)
     
     This library is allocation-agnostic.
@@ -155,10 +307,14 @@ LICENSE:
 
 VERSION HISTORY:
     1.0 (2025-09-11) Initial release
+    2.0 (2026-10-17) Integer-only inference with SIMD kernels, batched and delta inference, QMTIK_QModel/QMTIK_QContext
+                     split, versioned and checksummed model files (headerless 1.0 files still load), INT4 weights,
+                     pruning, zero skipping, model compiler, runtime topologies, mini-batch training with checkpoints,
+                     streamed datasets, calibration, validation, integer fine-tuning, serving and inference pools
 */
 
 #pragma once
-#define QMTIK_VERSION "1.0"
+#define QMTIK_VERSION "2.0"
 //==================================================
 #include <stdio.h>
 #include <stdint.h>
@@ -166,10 +322,39 @@ VERSION HISTORY:
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <stddef.h>
+#if defined(QMTIK_SIMD) && !((defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__))
+    #undef QMTIK_SIMD
+#endif
+#ifdef QMTIK_SIMD
+    #include <immintrin.h>
+#endif
+#ifdef QMTIK_THREADS
+    #include <pthread.h>
+    #include <unistd.h>
+    #include <sched.h>
+#endif
+#ifdef QMTIK_SERVE
+    #ifndef QMTIK_THREADS
+        #error "QMTIK_SERVE runs its workers on pthreads, define QMTIK_THREADS"
+    #endif
+    #ifndef __GNUC__
+        #error "QMTIK_SERVE needs the GCC/Clang __atomic builtins"
+    #endif
+    #include <semaphore.h>
+    #include <errno.h>
+#endif
+#ifdef QMTIK_MMAP
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
 //==================================================
 #define QMTIK_MainT float
 #define QMTIK_QWghtT int8_t
 #define QMTIK_QActvT int8_t
+#define QMTIK_QAccT int32_t
 #define QMTIK_QWghtT_MAX 127
 #define QMTIK_QWghtT_MIN -128
 #define QMTIK_QActvT_MAX 127
@@ -177,90 +362,713 @@ VERSION HISTORY:
 #define QMTIK_LEAK 0.01f
 #define QMTIK_CLAMP_MIN -88.0f
 #define QMTIK_CLAMP_MAX 88.0f
+#define QMTIK_QACC_SCALE (QMTIK_W_SCALE*QMTIK_A_SCALE)
+#define QMTIK_ROUND_UP(n, m) ((((n)+(m)-1)/(m))*(m))
+#define QMTIK_PANEL_R 16
+#define QMTIK_PANEL_K 4
+#ifdef QMTIK_INT4_WGHT
+    #define QMTIK_WGHT_BITS 4
+    #define QMTIK_QW4_MAX 7
+    #define QMTIK_QW4_MIN -8
+    #define QMTIK_WGHT_ROW(k) (((k)+1)/2)
+    #define QMTIK_PANEL_KW (2*QMTIK_PANEL_K)
+    #define QMTIK_PANEL_INDEX(r, j) (((((j)/QMTIK_PANEL_KW)*QMTIK_PANEL_R+(r))*QMTIK_PANEL_K+(j)%QMTIK_PANEL_K)*2+((j)%QMTIK_PANEL_KW)/QMTIK_PANEL_K)
+    #define QMTIK_MODEL_SCALES_FIELD QMTIK_MainT q_ih_scale[QMTIK_H], q_hh_scales[QMTIK_L][QMTIK_H], q_o_scale[QMTIK_O];
+    #define QMTIK_QROW_FIELDS(p, rows) QMTIK_MainT p##_scale[rows]; QMTIK_QRequant p##_row_rq[rows];
+    #define QMTIK_QROW_RQ(row_rq) (row_rq)
+    #define QMTIK_QROW_ARGS(T, p, scale) offsetof(T, p##_scale), offsetof(T, p##_row_rq), (scale)
+    #define QMTIK_ROW_SCALE(scale) (&(scale))
+    #define QMTIK_SET_GEMV4(isa) QMTIK_gemv4_kernel=QMTIK_gemv4_##isa;
+    #define QMTIK_GEMV_NAME(isa) isa "-int4"
+    #define QMTIK_MODEL_WGHT_FLAG QMTIK_MODEL_FLAG_INT4
+#else
+    #define QMTIK_WGHT_BITS 8
+    #define QMTIK_WGHT_ROW(k) (k)
+    #define QMTIK_PANEL_KW QMTIK_PANEL_K
+    #define QMTIK_PANEL_INDEX(r, j) ((((j)/QMTIK_PANEL_K)*QMTIK_PANEL_R+(r))*QMTIK_PANEL_K+(j)%QMTIK_PANEL_K)
+    #define QMTIK_MODEL_SCALES_FIELD
+    #define QMTIK_QROW_FIELDS(p, rows)
+    #define QMTIK_QROW_RQ(row_rq) NULL
+    #define QMTIK_QROW_ARGS(T, p, scale) 0, 0, NULL
+    #define QMTIK_ROW_SCALE(scale) NULL
+    #define QMTIK_SET_GEMV4(isa)
+    #define QMTIK_GEMV_NAME(isa) isa
+    #define QMTIK_MODEL_WGHT_FLAG 0u
+#endif
+#define QMTIK_SPARSE_ROWS 4
+#define QMTIK_SPARSE_BLOCK 16
+#define QMTIK_SPARSE_GROUPS (QMTIK_ROUND_UP(QMTIK_H, QMTIK_SPARSE_ROWS)/QMTIK_SPARSE_ROWS)
+#define QMTIK_SPARSE_COLS (QMTIK_ROUND_UP(QMTIK_I, QMTIK_SPARSE_BLOCK)/QMTIK_SPARSE_BLOCK)
+#ifdef QMTIK_PRUNE_PERCENT
+    #if QMTIK_PRUNE_PERCENT<0||QMTIK_PRUNE_PERCENT>=100
+        #error "QMTIK_PRUNE_PERCENT must be in [0, 100)"
+    #endif
+    #ifdef QMTIK_INT4_WGHT
+        #error "QMTIK_PRUNE_PERCENT stores INT8 input blocks and cannot be combined with QMTIK_INT4_WGHT"
+    #endif
+    #ifndef QMTIK_PRUNE_EPOCHS
+        #define QMTIK_PRUNE_EPOCHS (QMTIK_EPOCHS-1)
+    #endif
+    #define QMTIK_SPARSE_KEPT (QMTIK_SPARSE_GROUPS*QMTIK_SPARSE_COLS-QMTIK_SPARSE_GROUPS*QMTIK_SPARSE_COLS*QMTIK_PRUNE_PERCENT/100)
+    #define QMTIK_PRUNE_FIELD uint8_t ih_pruned[QMTIK_SPARSE_GROUPS][QMTIK_SPARSE_COLS];
+    #define QMTIK_SET_SPARSE(isa) QMTIK_sparse_kernel=QMTIK_sparse_##isa;
+    #define QMTIK_MODEL_SPARSE_FLAG QMTIK_MODEL_FLAG_SPARSE
+    #define QMTIK_DENSE_INFER 0
+#else
+    #define QMTIK_PRUNE_FIELD
+    #define QMTIK_SET_SPARSE(isa)
+    #define QMTIK_MODEL_SPARSE_FLAG 0u
+    #define QMTIK_DENSE_INFER (QMTIK_WGHT_BITS==8)
+#endif
+#define QMTIK_COL_STRIDE(rows) QMTIK_ROUND_UP(rows, QMTIK_PANEL_R)
+#ifdef QMTIK_SKIP_ZERO_ACTV
+    #ifdef QMTIK_INT4_WGHT
+        #error "QMTIK_SKIP_ZERO_ACTV stores INT8 weight columns and cannot be combined with QMTIK_INT4_WGHT"
+    #endif
+    #define QMTIK_QCOLUMNS_FIELD QMTIK_QColumns q_columns;
+    #define QMTIK_INFER_COLUMNS(cols, acc_bias, rows, x, acc) QMTIK_infer_columns(cols, acc_bias, rows, QMTIK_H, x, acc)
+    #ifdef QMTIK_ACTV_DENSITY
+        #define QMTIK_SET_COLUMN(isa, density) QMTIK_column_kernel=QMTIK_column_##isa; QMTIK_column_density=QMTIK_ACTV_DENSITY;
+    #else
+        #define QMTIK_SET_COLUMN(isa, density) QMTIK_column_kernel=QMTIK_column_##isa; QMTIK_column_density=density;
+    #endif
+    #define QMTIK_MODEL_COLUMNS_FLAG QMTIK_MODEL_FLAG_COLUMNS
+    #define QMTIK_GEMM_INFER 1
+#else
+    #define QMTIK_QCOLUMNS_FIELD
+    #define QMTIK_INFER_COLUMNS(cols, acc_bias, rows, x, acc) 0
+    #define QMTIK_SET_COLUMN(isa, density)
+    #define QMTIK_MODEL_COLUMNS_FLAG 0u
+    #define QMTIK_GEMM_INFER (!QMTIK_DENSE_INFER)
+#endif
+#define QMTIK_PANEL_ROW(k) QMTIK_WGHT_ROW(QMTIK_ROUND_UP(k, QMTIK_PANEL_KW))
+#define QMTIK_PANEL_SIZE(rows, k) (QMTIK_ROUND_UP(rows, QMTIK_PANEL_R)*QMTIK_PANEL_ROW(k))
+#define QMTIK_ALIGN _Alignas(64)
+#ifdef QMTIK_SIMD
+    #define QMTIK_QPANELS_FIELD QMTIK_QPanels q_panels;
+    #define QMTIK_QPANEL_ARGS(m, p, idx) (m)->q_panels.p##_panel idx, (m)->q_panels.p##_wsum idx
+    #define QMTIK_QMODEL_CORE_SIZE offsetof(QMTIK_QModel, q_panels)
+#else
+    #define QMTIK_QPANELS_FIELD
+    #define QMTIK_QPANEL_ARGS(m, p, idx) NULL, NULL
+    #define QMTIK_QMODEL_CORE_SIZE sizeof(QMTIK_QModel)
+#endif
+#define QMTIK_MODEL_MAGIC "QMTIKMDL"
+#define QMTIK_MODEL_VERSION 2
+#define QMTIK_CHECKPOINT_MAGIC "QMTIKCKP"
+#define QMTIK_CHECKPOINT_VERSION 3
+#define QMTIK_CHECKPOINT_OFFSET 4096
+//the live network and the two snapshot slots each start on a 4KB boundary
+#define QMTIK_CHECKPOINT_STRIDE QMTIK_ROUND_UP(sizeof(QMTIK_Network), QMTIK_CHECKPOINT_OFFSET)
+#define QMTIK_CHECKPOINT_SLOT(base, s) ((uint8_t*)(base)+QMTIK_CHECKPOINT_OFFSET+(1+(s))*QMTIK_CHECKPOINT_STRIDE)
+#define QMTIK_FT_FRAC 8
+#ifdef QMTIK_INT4_WGHT
+    #define QMTIK_FT_W_MIN QMTIK_QW4_MIN
+    #define QMTIK_FT_W_MAX QMTIK_QW4_MAX
+#else
+    #define QMTIK_FT_W_MIN QMTIK_QWghtT_MIN
+    #define QMTIK_FT_W_MAX QMTIK_QWghtT_MAX
+#endif
+#ifdef QMTIK_FINETUNE_HH
+    #define QMTIK_FT_FIRST QMTIK_L
+    #define QMTIK_FT_HH_FIELD int16_t hh_wght[QMTIK_H][QMTIK_H], hh_bias[QMTIK_H], deriv[256]; int32_t hh_gain;
+#else
+    #define QMTIK_FT_FIRST (QMTIK_L+1)
+    #define QMTIK_FT_HH_FIELD
+#endif
+#define QMTIK_MODEL_FLAG_PANELS 1u
+#define QMTIK_MODEL_FLAG_INT4 2u
+#define QMTIK_MODEL_FLAG_SPARSE 4u
+#define QMTIK_MODEL_FLAG_COLUMNS 8u
+#define QMTIK_CHECKSUM_INIT 2166136261u
+#if defined(QMTIK_RELU_ACTV)
+    #define QMTIK_ACTV_ID 1
+#elif defined(QMTIK_LEAKY_RELU_ACTV)
+    #define QMTIK_ACTV_ID 2
+#elif defined(QMTIK_SIGMOID_ACTV)
+    #define QMTIK_ACTV_ID 3
+#elif defined(QMTIK_TANH_ACTV)
+    #define QMTIK_ACTV_ID 4
+#endif
+#if defined(QMTIK_LINEAR_PP)
+    #define QMTIK_PP_ID 1
+#elif defined(QMTIK_SOFT_MAX_PP)
+    #define QMTIK_PP_ID 2
+#elif defined(QMTIK_SIGMOID_PP)
+    #define QMTIK_PP_ID 3
+#endif
+#define QMTIK_RT_LINEAR 0
+#define QMTIK_RT_RELU 1
+#define QMTIK_RT_LEAKY_RELU 2
+#define QMTIK_RT_SIGMOID 3
+#define QMTIK_RT_TANH 4
+#define QMTIK_RT_MAGIC "QMTIKRTM"
+#define QMTIK_RT_VERSION 3
+#ifndef QMTIK_RT_MAX_LAYERS
+    #define QMTIK_RT_MAX_LAYERS 64
+#endif
+#ifndef QMTIK_CALIB_BINS
+    #define QMTIK_CALIB_BINS 1024
+#endif
+#ifndef QMTIK_BATCH
+    #define QMTIK_BATCH 16
+#endif
+#ifndef QMTIK_TRAIN_BATCH
+    #define QMTIK_TRAIN_BATCH 1
+#endif
+#ifndef QMTIK_WARMUP_STEPS
+    #define QMTIK_WARMUP_STEPS 0
+#endif
+#ifndef QMTIK_MIN_ALPHA
+    #define QMTIK_MIN_ALPHA 0.0f
+#endif
+#ifndef QMTIK_LR_GAMMA
+    #define QMTIK_LR_GAMMA 0.1f
+#endif
+#if defined(QMTIK_COSINE_LR)&&defined(QMTIK_STEP_LR)
+    #error "Define at most one of QMTIK_COSINE_LR and QMTIK_STEP_LR"
+#endif
+#ifndef QMTIK_MAX_THREADS
+    #define QMTIK_MAX_THREADS 64
+#endif
+#ifndef QMTIK_SPIN_LIMIT
+    #define QMTIK_SPIN_LIMIT 4096
+#endif
+#if defined(__x86_64__)||defined(__i386__)
+    #define QMTIK_SPIN_PAUSE() __builtin_ia32_pause()
+#else
+    #define QMTIK_SPIN_PAUSE()
+#endif
+//Training runs over more than one context keep one QMTIK_TrainPool for their whole length
+#ifdef QMTIK_THREADS
+    #define QMTIK_TRAIN_POOL_START(pool, network, contexts, n) QMTIK_TrainPool pool##_workers, *pool=NULL; if ((n)>1) {QMTIK_start_train_pool(&pool##_workers, network, contexts, n); pool=&pool##_workers;}
+    #define QMTIK_TRAIN_POOL_STOP(pool) if (pool) QMTIK_pool_stop(&pool->sync, pool->threads);
+#else
+    #define QMTIK_TRAIN_POOL_START(pool, network, contexts, n) struct QMTIK_TrainPool* pool=NULL;
+    #define QMTIK_TRAIN_POOL_STOP(pool)
+#endif
+#ifndef QMTIK_SERVE_QUEUE
+    #define QMTIK_SERVE_QUEUE 1024
+#endif
+#ifndef QMTIK_SERVE_MAX_BATCH
+    #define QMTIK_SERVE_MAX_BATCH 64
+#endif
+#define QMTIK_PROF_INFER 0
+#define QMTIK_PROF_TRAIN 1
+#define QMTIK_PROF_STEP 2
+#define QMTIK_PROF_WGHT 3
+#ifdef QMTIK_PROFILE
+    #ifndef QMTIK_PROFILE_CLOCK
+        #if (defined(__x86_64__)||defined(__i386__))&&defined(__GNUC__)
+            #define QMTIK_PROFILE_CLOCK() __builtin_ia32_rdtsc()
+        #else
+            #define QMTIK_PROFILE_CLOCK() QMTIK_profile_ns()
+        #endif
+    #endif
+    #ifdef __GNUC__
+        #define QMTIK_PROFILE_ADD(x, v) __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+    #else
+        #define QMTIK_PROFILE_ADD(x, v) ((x)+=(v))
+    #endif
+    #define QMTIK_PROFILE_BEGIN(t) uint64_t t=QMTIK_PROFILE_CLOCK();
+    #define QMTIK_PROFILE_END(kind, layer, t, values, clamped) QMTIK_profile_record(kind, layer, t, values, clamped);
+#else
+    #define QMTIK_PROFILE_BEGIN(t)
+    #define QMTIK_PROFILE_END(kind, layer, t, values, clamped)
+#endif
+#ifndef QMTIK_BENCH_LOADS
+    #define QMTIK_BENCH_LOADS 5
+#endif
+#define QMTIK_QACC_STRIDE QMTIK_ROUND_UP(QMTIK_H>QMTIK_O?QMTIK_H:QMTIK_O, QMTIK_PANEL_R)
+#define QMTIK_N_PARAMS (sizeof(QMTIK_Params)/sizeof(QMTIK_MainT))
+#define QMTIK_PARAMS(p) ((QMTIK_MainT*)(p))
 //==================================================
-typedef struct {QMTIK_MainT i_actv[QMTIK_I];} QMTIK_ILayer;
-typedef struct {QMTIK_MainT ih_z[QMTIK_H]; QMTIK_MainT ih_wght[QMTIK_H][QMTIK_I], ih_bias[QMTIK_H];} QMTIK_IHLayer;
-typedef struct {QMTIK_MainT hh_z[QMTIK_H]; QMTIK_MainT hh_wght[QMTIK_H][QMTIK_H], hh_bias[QMTIK_H];} QMTIK_HHLayer;
-typedef struct {QMTIK_MainT o_z[QMTIK_O]; QMTIK_MainT o_wght[QMTIK_O][QMTIK_H], o_bias[QMTIK_O];} QMTIK_OLayer;
+typedef struct {QMTIK_MainT ih_wght[QMTIK_H][QMTIK_I], ih_bias[QMTIK_H];} QMTIK_IHLayer;
+typedef struct {QMTIK_MainT hh_wght[QMTIK_H][QMTIK_H], hh_bias[QMTIK_H];} QMTIK_HHLayer;
+typedef struct {QMTIK_MainT o_wght[QMTIK_O][QMTIK_H], o_bias[QMTIK_O];} QMTIK_OLayer;
+typedef struct {QMTIK_IHLayer ih_layer; QMTIK_HHLayer hh_layers[QMTIK_L]; QMTIK_OLayer o_layer;} QMTIK_Params;
 typedef struct {
-    QMTIK_MainT m_ih_w[QMTIK_H][QMTIK_I], v_ih_w[QMTIK_H][QMTIK_I];
-    QMTIK_MainT m_ih_b[QMTIK_H], v_ih_b[QMTIK_H];
-    QMTIK_MainT m_hh_w[QMTIK_L][QMTIK_H][QMTIK_H], v_hh_w[QMTIK_L][QMTIK_H][QMTIK_H];
-    QMTIK_MainT m_hh_b[QMTIK_L][QMTIK_H], v_hh_b[QMTIK_L][QMTIK_H];
-    QMTIK_MainT m_o_w[QMTIK_O][QMTIK_H], v_o_w[QMTIK_O][QMTIK_H];
-    QMTIK_MainT m_o_b[QMTIK_O], v_o_b[QMTIK_O];
+    QMTIK_MainT i_actv[QMTIK_I], ih_z[QMTIK_H], hh_z[QMTIK_L][QMTIK_H], o_z[QMTIK_O];
+    QMTIK_MainT i_tape[QMTIK_I], ih_tape[QMTIK_H], hh_tape[QMTIK_L][QMTIK_H];
     QMTIK_MainT dO[QMTIK_O], dHH[QMTIK_L][QMTIK_H], dIH[QMTIK_H];
-    size_t t; QMTIK_MainT b1t, b2t;
-} QMTIK_AdamState;
-typedef struct {QMTIK_ILayer i_layer; QMTIK_IHLayer ih_layer; QMTIK_HHLayer hh_layers[QMTIK_L]; QMTIK_OLayer o_layer; QMTIK_AdamState adam_state;} QMTIK_Network;
+    QMTIK_Params grads;
+} QMTIK_TrainContext;
+//epoch drives the QMTIK_COSINE_LR/QMTIK_STEP_LR schedules
+typedef struct {QMTIK_Params m, v; size_t t, epoch; QMTIK_MainT b1t, b2t;} QMTIK_AdamState;
+typedef struct {QMTIK_MainT scale, lr, eps;} QMTIK_AdamStep;
+typedef struct {QMTIK_IHLayer ih_layer; QMTIK_HHLayer hh_layers[QMTIK_L]; QMTIK_OLayer o_layer; QMTIK_Params wght_shadow; QMTIK_AdamState adam_state; QMTIK_TrainContext train_context; QMTIK_PRUNE_FIELD} QMTIK_Network;
+_Static_assert(offsetof(QMTIK_Network, wght_shadow)==sizeof(QMTIK_Params), "QMTIK_Network must start with a QMTIK_Params layout");
 typedef struct {QMTIK_QActvT input[QMTIK_I], output[QMTIK_O];} QMTIK_SamplePair;
-typedef struct {QMTIK_QWghtT q_ih_wght[QMTIK_H][QMTIK_I], q_ih_bias[QMTIK_H], q_hh_wghts[QMTIK_L][QMTIK_H][QMTIK_H], q_hh_biases[QMTIK_L][QMTIK_H], q_o_wght[QMTIK_O][QMTIK_H], q_o_bias[QMTIK_O];} QMTIK_Model;
-typedef struct {QMTIK_QActvT q_i_actv[QMTIK_I];} QMTIK_QILayer;
-typedef struct {QMTIK_QActvT q_ih_actv[QMTIK_H]; QMTIK_QWghtT q_ih_wght[QMTIK_H][QMTIK_I], q_ih_bias[QMTIK_H];} QMTIK_QIHLayer;
-typedef struct {QMTIK_QActvT q_hh_actv[QMTIK_H]; QMTIK_QWghtT q_hh_wght[QMTIK_H][QMTIK_H], q_hh_bias[QMTIK_H];} QMTIK_QHHLayer;
-typedef struct {QMTIK_QActvT q_o_z[QMTIK_O]; QMTIK_QWghtT q_o_wght[QMTIK_O][QMTIK_H], q_o_bias[QMTIK_O];} QMTIK_QOLayer;
-typedef struct {QMTIK_QILayer q_i_layer; QMTIK_QIHLayer q_ih_layer; QMTIK_QHHLayer q_hh_layers[QMTIK_L]; QMTIK_QOLayer q_o_layer;} QMTIK_QNetwork;
+_Static_assert(sizeof(QMTIK_SamplePair)==QMTIK_I+QMTIK_O, "QMTIK_SamplePair must match the dataset record layout");
+typedef struct {
+    const QMTIK_SamplePair* samples; size_t n_samples;
+    void* base; size_t size;
+    FILE* file; QMTIK_SamplePair* chunks[2]; size_t chunk_size, chunk_count[2], chunk, pos, avail, pending;
+    uint8_t chunk_ready[2], holding, eof, stop, reading;
+    uint64_t seed, key; size_t epoch, next;
+    #ifdef QMTIK_THREADS
+    pthread_t reader; pthread_mutex_t lock; pthread_cond_t cond;
+    #endif
+} QMTIK_Dataset;
+typedef struct {QMTIK_QWghtT q_ih_wght[QMTIK_H][QMTIK_WGHT_ROW(QMTIK_I)], q_ih_bias[QMTIK_H], q_hh_wghts[QMTIK_L][QMTIK_H][QMTIK_WGHT_ROW(QMTIK_H)], q_hh_biases[QMTIK_L][QMTIK_H], q_o_wght[QMTIK_O][QMTIK_WGHT_ROW(QMTIK_H)], q_o_bias[QMTIK_O]; QMTIK_MODEL_SCALES_FIELD} QMTIK_Model;
+typedef struct {int32_t mult; int32_t shift;} QMTIK_QRequant;
+//Sigmoid/tanh as breakpoints: step[v] is the largest accumulator whose output is still below level low+v+1
+typedef struct {QMTIK_QAccT step[255]; int32_t low;} QMTIK_QStepLut;
+//exp[d]=2^23*e^(-d*a_scale) for the integer softmax, sigmoid[z+128] for QMTIK_SIGMOID_PP
+typedef struct {uint32_t exp[256]; QMTIK_QActvT sigmoid[256];} QMTIK_QPpLut;
+#ifdef QMTIK_PRUNE_PERCENT
+//Block CSR: rows 4g..4g+3 own blocks [q_ih_group_end[g-1], q_ih_group_end[g]), block b covers inputs 16*q_ih_block_col[b] onwards
+typedef struct {
+    QMTIK_ALIGN QMTIK_QWghtT q_ih_blocks[QMTIK_SPARSE_KEPT][QMTIK_SPARSE_ROWS*QMTIK_SPARSE_BLOCK]; uint16_t q_ih_block_col[QMTIK_SPARSE_KEPT]; uint32_t q_ih_group_end[QMTIK_SPARSE_GROUPS];
+    QMTIK_QAccT q_ih_wsum[QMTIK_SPARSE_GROUPS*QMTIK_SPARSE_ROWS];
+    QMTIK_QWghtT q_ih_bias[QMTIK_H]; QMTIK_QAccT q_ih_acc_bias[QMTIK_H]; QMTIK_QRequant q_ih_rq[2];
+} QMTIK_QIHLayer;
+_Static_assert(QMTIK_SPARSE_COLS<=65536, "QMTIK_PRUNE_PERCENT block columns are stored as uint16_t");
+#else
+typedef struct {QMTIK_ALIGN QMTIK_QWghtT q_ih_wght[QMTIK_H][QMTIK_WGHT_ROW(QMTIK_I)]; QMTIK_QWghtT q_ih_bias[QMTIK_H]; QMTIK_QAccT q_ih_acc_bias[QMTIK_H]; QMTIK_QRequant q_ih_rq[2]; QMTIK_QROW_FIELDS(q_ih, QMTIK_H)} QMTIK_QIHLayer;
+#endif
+typedef struct {QMTIK_ALIGN QMTIK_QWghtT q_hh_wght[QMTIK_H][QMTIK_WGHT_ROW(QMTIK_H)]; QMTIK_QWghtT q_hh_bias[QMTIK_H]; QMTIK_QAccT q_hh_acc_bias[QMTIK_H]; QMTIK_QRequant q_hh_rq[2]; QMTIK_QROW_FIELDS(q_hh, QMTIK_H)} QMTIK_QHHLayer;
+typedef struct {QMTIK_ALIGN QMTIK_QWghtT q_o_wght[QMTIK_O][QMTIK_WGHT_ROW(QMTIK_H)]; QMTIK_QWghtT q_o_bias[QMTIK_O]; QMTIK_QAccT q_o_acc_bias[QMTIK_O]; QMTIK_QRequant q_o_rq; QMTIK_QROW_FIELDS(q_o, QMTIK_O)} QMTIK_QOLayer;
+typedef struct {
+    #ifndef QMTIK_PRUNE_PERCENT
+    QMTIK_ALIGN QMTIK_QWghtT q_ih_panel[QMTIK_PANEL_SIZE(QMTIK_H, QMTIK_I)]; QMTIK_QAccT q_ih_wsum[QMTIK_ROUND_UP(QMTIK_H, QMTIK_PANEL_R)];
+    #endif
+    QMTIK_ALIGN QMTIK_QWghtT q_hh_panel[QMTIK_L][QMTIK_PANEL_SIZE(QMTIK_H, QMTIK_H)]; QMTIK_QAccT q_hh_wsum[QMTIK_L][QMTIK_ROUND_UP(QMTIK_H, QMTIK_PANEL_R)];
+    QMTIK_ALIGN QMTIK_QWghtT q_o_panel[QMTIK_PANEL_SIZE(QMTIK_O, QMTIK_H)]; QMTIK_QAccT q_o_wsum[QMTIK_ROUND_UP(QMTIK_O, QMTIK_PANEL_R)];
+} QMTIK_QPanels;
+//Transposed weights, column j of a layer is the QMTIK_COL_STRIDE(rows) zero padded weights multiplying input j
+typedef struct {
+    QMTIK_ALIGN QMTIK_QWghtT q_hh_cols[QMTIK_L][QMTIK_H][QMTIK_COL_STRIDE(QMTIK_H)];
+    QMTIK_ALIGN QMTIK_QWghtT q_o_cols[QMTIK_H][QMTIK_COL_STRIDE(QMTIK_O)];
+} QMTIK_QColumns;
+typedef struct {QMTIK_QIHLayer q_ih_layer; QMTIK_QHHLayer q_hh_layers[QMTIK_L]; QMTIK_QOLayer q_o_layer; QMTIK_QCOLUMNS_FIELD QMTIK_QPANELS_FIELD} QMTIK_QModel;
+typedef struct {QMTIK_QActvT q_i_actv[QMTIK_I], q_ih_actv[QMTIK_H], q_hh_actv[QMTIK_L][QMTIK_H], q_o_z[QMTIK_O];} QMTIK_QContext;
+typedef struct {QMTIK_QModel q_model; QMTIK_QContext q_context;} QMTIK_QNetwork;
+//Q8 master copies of the weight codes being fine-tuned, deriv is the Q8 activation derivative per activation code
+typedef struct {int16_t o_wght[QMTIK_O][QMTIK_H], o_bias[QMTIK_O]; QMTIK_FT_HH_FIELD int32_t bias_gain; uint32_t rng; uint8_t shift;} QMTIK_FineTune;
+//Input layer dot products (no bias, before INT4 row rescaling) of the last q_i_prev, valid is 0 until the first full pass
+typedef struct {QMTIK_QAccT q_ih_dot[QMTIK_H]; QMTIK_QActvT q_i_prev[QMTIK_I]; uint8_t valid;} QMTIK_QDelta;
+//Only defined with QMTIK_THREADS, the single threaded QMTIK_train_batch is passed NULL
+struct QMTIK_TrainPool;
+#ifdef QMTIK_THREADS
+//generation announces a job, phase/arrived make up the sense reversing barrier between its steps
+typedef struct {size_t n_threads, generation, phase, arrived, sleepers; uint8_t stop; pthread_mutex_t lock; pthread_cond_t wake;} QMTIK_PoolSync;
+struct QMTIK_InferPool;
+typedef struct {struct QMTIK_InferPool* pool; size_t t; uint8_t pin;} QMTIK_InferWorker;
+typedef struct QMTIK_InferPool {
+    const QMTIK_QModel* q_model; QMTIK_QContext* q_context; QMTIK_PoolSync sync;
+    pthread_t threads[QMTIK_MAX_THREADS]; QMTIK_InferWorker workers[QMTIK_MAX_THREADS];
+} QMTIK_InferPool;
+typedef struct {struct QMTIK_TrainPool* pool; size_t t;} QMTIK_TrainWorker;
+//One job per mini-batch: n samples in n_shards sample shards, then the same number of parameter shards for the update
+typedef struct QMTIK_TrainPool {
+    QMTIK_Network* network; const QMTIK_SamplePair* const* batch; QMTIK_TrainContext* contexts; size_t n, n_shards; QMTIK_AdamStep step; QMTIK_PoolSync sync;
+    pthread_t threads[QMTIK_MAX_THREADS]; QMTIK_TrainWorker workers[QMTIK_MAX_THREADS];
+} QMTIK_TrainPool;
+#endif
+typedef struct {
+    char magic[8]; uint32_t version, header_size;
+    uint32_t i, h, l, o; float w_scale, a_scale; uint32_t actv_id, pp_id;
+    uint32_t flags, payload_size, checksum, reserved;
+} QMTIK_ModelHeader;
+#ifdef QMTIK_MMAP
+typedef struct {const QMTIK_QModel* q_model; void* base; size_t size;} QMTIK_MappedModel;
+#endif
+//epoch/sample is the next sample the live network trains on. Slot s holds the network as it was at
+//slot_epoch[s]/slot_sample[s] once slot_seq[s] is nonzero, and a reopened file resumes from the higher slot_seq
+typedef struct {
+    char magic[8]; uint32_t version, header_size;
+    uint32_t i, h, l, o, train_batch, reserved;
+    uint64_t network_size, epoch, sample;
+    uint64_t slot_epoch[2], slot_sample[2], slot_seq[2];
+} QMTIK_CheckpointHeader;
+typedef struct {QMTIK_CheckpointHeader* header; QMTIK_Network* network; void* base; size_t size, every; uint8_t resumed;} QMTIK_Checkpoint;
+//Set by the caller: valid_file, patience (epochs without a better cost before stopping, 0 runs every epoch), the model
+//and q_model the epochs are quantized into and best (NULL keeps the last weights). Filled per epoch: the quantized
+//validation cost (-1 when not scored) and accuracy, the step size in use and the seconds taken
+typedef struct {
+    FILE* valid_file; size_t patience; QMTIK_Model* model; QMTIK_QModel* q_model; QMTIK_Params* best;
+    size_t epochs, best_epoch; QMTIK_MainT cost[QMTIK_EPOCHS], accuracy[QMTIK_EPOCHS], alpha[QMTIK_EPOCHS]; double seconds[QMTIK_EPOCHS];
+} QMTIK_Validation;
+//Runtime topology: layer l maps widths[l] inputs to widths[l+1] outputs through activation actvs[l] (QMTIK_RT_*),
+//the output of the last layer then goes through post processing pp_id (QMTIK_PP_ID numbering)
+typedef struct {size_t n_layers; const uint32_t* widths; const uint8_t* actvs; uint8_t pp_id; QMTIK_MainT w_scale, a_scale;} QMTIK_RtDesc;
+//acc_fold holds accumulator units folded in from removed inputs, added to the rounded bias
+//w_scale scales the weights and biases, a_scale the outputs, steps is the sigmoid or tanh table
+typedef struct {uint32_t in, out; uint8_t actv; QMTIK_MainT w_scale, a_scale; QMTIK_QRequant rq[2]; QMTIK_QWghtT* wght, *bias, *panel; QMTIK_QAccT* acc_bias, *wsum, *acc_fold; QMTIK_QStepLut* steps;} QMTIK_RtLayer;
+//Weights live in the arena given to QMTIK_rt_instantiate, activations in a per-thread scratch_size scratch buffer
+//With n_inputs set, input j of the first layer is input[gather[j]] of an n_inputs wide input
+//a_scale scales the inputs, w_scale and a_scale are also the layer scales until QMTIK_rt_set_scales
+typedef struct {size_t n_layers, scratch_size, buf_off[3]; uint8_t pp_id; QMTIK_MainT w_scale, a_scale; QMTIK_RtLayer* layers; QMTIK_QPpLut* pp_lut; uint32_t n_inputs, *gather;} QMTIK_RtNetwork;
+//Version 1 files end the header at checksum and have no gather map or folds, version 2 files have no layer scales
+typedef struct {char magic[8]; uint32_t version, n_layers, pp_id; float w_scale, a_scale; uint32_t checksum, n_inputs;} QMTIK_RtHeader;
+//Value ranges seen by QMTIK_rt_plan_model over a sample set: i_* for the inputs, h_*[l] for hidden layer l (0 is the input
+//layer's output), keep_* the neurons the planned runtime network still computes, macs its multiply-accumulates vs dense
+typedef struct {
+    QMTIK_QActvT i_low[QMTIK_I], i_high[QMTIK_I], h_low[QMTIK_L+1][QMTIK_H], h_high[QMTIK_L+1][QMTIK_H];
+    uint8_t keep_i[QMTIK_I], keep_h[QMTIK_L+1][QMTIK_H];
+    uint32_t widths[QMTIK_L+3]; uint8_t actvs[QMTIK_L+2]; QMTIK_RtDesc desc; uint64_t macs, dense_macs;
+} QMTIK_RtPlan;
+//Scales picked by QMTIK_calibrate: w_scale[l] for layer l, a_scale[l+1] for its outputs and a_scale[0]=QMTIK_A_SCALE
+//for the inputs, a_max[l] is the largest |output| of layer l seen
+typedef struct {QMTIK_MainT w_scale[QMTIK_L+2], a_scale[QMTIK_L+3], a_max[QMTIK_L+2];} QMTIK_Calibration;
+#ifdef QMTIK_PROFILE
+//ticks of QMTIK_PROFILE_CLOCK, int8 values produced and how many of them hit the int8 limits
+typedef struct {uint64_t calls, ticks, values, clamped;} QMTIK_ProfileCounter;
+//Layer 0 is the input layer and QMTIK_L+1 the output layer, step counts whole QMTIK_train_batch updates
+typedef struct {QMTIK_ProfileCounter infer[QMTIK_L+2], train[QMTIK_L+2], wght[QMTIK_L+2], step;} QMTIK_Profile;
+typedef void (*QMTIK_ProfileHook)(uint8_t kind, size_t layer, const QMTIK_ProfileCounter* sample, void* user);
+#endif
+#ifdef QMTIK_SERVE
+_Static_assert((QMTIK_SERVE_QUEUE&(QMTIK_SERVE_QUEUE-1))==0, "QMTIK_SERVE_QUEUE must be a power of two");
+//Owned by the caller from QMTIK_serve_submit until QMTIK_serve_wait returns
+typedef struct {QMTIK_QActvT input[QMTIK_I], output[QMTIK_O]; uint64_t submit_ns; sem_t done;} QMTIK_ServeRequest;
+//Bounded MPMC ring: a slot is free for position p when seq==p and holds a request when seq==p+1
+typedef struct {QMTIK_ServeRequest* request; size_t seq;} QMTIK_ServeSlot;
+//latency_us is mean, p50, p99 (bucket upper bounds) and max from submit to reply, depth is the queue length when read
+typedef struct {uint64_t requests, batches, depth, max_depth; double mean_batch, latency_us[4];} QMTIK_ServeStats;
+typedef struct {
+    QMTIK_ServeSlot slots[QMTIK_SERVE_QUEUE];
+    size_t head, tail;
+    const QMTIK_QModel* q_model; size_t max_batch, n_workers; uint64_t max_wait_ns;
+    sem_t queued; uint8_t stop;
+    pthread_t workers[QMTIK_MAX_THREADS];
+    uint64_t requests, batches, max_depth, latency_ns, latency_max_ns, latency_hist[64];
+} QMTIK_Server;
+#endif
+#ifdef QMTIK_BENCH
+//latency_us is mean, p50, p99, p999, layer_us[0] the input layer and layer_us[QMTIK_L+1] the output layer with post processing
+typedef struct {size_t samples, iterations, n_threads; double load_ms, latency_us[4], layer_us[QMTIK_L+2], gops, batch_per_s, train_per_s;} QMTIK_BenchResult;
+#endif
 //==================================================
 //==============USER VISIBLE FUNCTIONS==============
 //==================================================
 void QMTIK_init_weights(QMTIK_Network* network);
 
 void QMTIK_train(QMTIK_Network* network, FILE* train_file);
+#ifdef QMTIK_THREADS
+void QMTIK_train_parallel(QMTIK_Network* network, FILE* train_file, QMTIK_TrainContext* contexts, size_t n_threads);
+#endif
+void QMTIK_train_dataset(QMTIK_Network* network, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_threads);
+void QMTIK_train_validated(QMTIK_Network* network, FILE* train_file, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_threads, QMTIK_Validation* validation);
+
+#ifdef QMTIK_MMAP
+uint8_t QMTIK_map_dataset(QMTIK_Dataset* dataset, const char* path);
+#endif
+uint8_t QMTIK_stream_dataset(QMTIK_Dataset* dataset, FILE* file, QMTIK_SamplePair* buffer, size_t chunk_size);
+void QMTIK_close_dataset(QMTIK_Dataset* dataset);
+void QMTIK_shuffle_dataset(QMTIK_Dataset* dataset, uint64_t seed);
+void QMTIK_rewind_dataset(QMTIK_Dataset* dataset);
+size_t QMTIK_dataset_batch(QMTIK_Dataset* dataset, const QMTIK_SamplePair** batch, size_t n);
 
 void QMTIK_quantize_to_model(QMTIK_Network* network, QMTIK_Model* model);
-void QMTIK_store_model(QMTIK_Model* model, FILE* q_model_file);
+uint8_t QMTIK_store_model(QMTIK_Model* model, FILE* q_model_file);
 uint8_t QMTIK_load_model(QMTIK_QNetwork* q_network, FILE* q_model_file);
+uint8_t QMTIK_load_q_model(QMTIK_QModel* q_model, FILE* q_model_file);
+uint8_t QMTIK_compile_model(const QMTIK_QModel* q_model, const char* name, unsigned unroll, FILE* c_file, FILE* h_file);
+#ifdef QMTIK_MMAP
+uint8_t QMTIK_map_model(QMTIK_MappedModel* mapped, const char* path);
+void QMTIK_unmap_model(QMTIK_MappedModel* mapped);
+uint8_t QMTIK_open_checkpoint(QMTIK_Checkpoint* checkpoint, const char* path, size_t every);
+uint8_t QMTIK_resume_training(QMTIK_Checkpoint* checkpoint, FILE* train_file, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_threads);
+uint8_t QMTIK_sync_checkpoint(QMTIK_Checkpoint* checkpoint);
+void QMTIK_close_checkpoint(QMTIK_Checkpoint* checkpoint);
+#endif
 
 void QMTIK_infer_forward(QMTIK_QNetwork* q_network);
+void QMTIK_infer(const QMTIK_QModel* q_model, QMTIK_QContext* q_context);
+void QMTIK_infer_forward_batch(const QMTIK_QModel* q_model, QMTIK_QActvT inputs[][QMTIK_I], QMTIK_QActvT outputs[][QMTIK_O], size_t n);
+void QMTIK_reset_delta(QMTIK_QDelta* q_delta);
+void QMTIK_infer_forward_delta(QMTIK_QNetwork* q_network, QMTIK_QDelta* q_delta);
+void QMTIK_infer_delta(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, QMTIK_QDelta* q_delta);
+#ifdef QMTIK_CROSS_ENTROPY_COST
+size_t QMTIK_infer_class(const QMTIK_QModel* q_model, QMTIK_QContext* q_context);
+#endif
+void QMTIK_finetune_begin(QMTIK_FineTune* fine_tune, const QMTIK_QModel* q_model, uint8_t shift, uint32_t seed);
+QMTIK_MainT QMTIK_finetune_step(QMTIK_FineTune* fine_tune, QMTIK_QModel* q_model, QMTIK_QContext* q_context, QMTIK_QActvT expected[QMTIK_O]);
 
 QMTIK_MainT QMTIK_test_before_quant(QMTIK_Network* network, FILE* test_file);
 QMTIK_MainT QMTIK_test_after_quant(QMTIK_QNetwork* q_network, FILE* test_file);
+#ifdef QMTIK_THREADS
+QMTIK_MainT QMTIK_test_after_quant_parallel(const QMTIK_QModel* q_model, FILE* test_file, size_t n_threads);
+uint8_t QMTIK_start_infer_pool(QMTIK_InferPool* pool, size_t n_threads, uint8_t pin);
+void QMTIK_infer_parallel(QMTIK_InferPool* pool, const QMTIK_QModel* q_model, QMTIK_QContext* q_context);
+void QMTIK_stop_infer_pool(QMTIK_InferPool* pool);
+#endif
+QMTIK_MainT QMTIK_test_dataset(const QMTIK_QModel* q_model, QMTIK_Dataset* dataset);
 
 void QMTIK_load_network_input(QMTIK_QNetwork* q_network, QMTIK_QActvT input[QMTIK_I]);
 void QMTIK_get_network_output(QMTIK_QNetwork* q_network, QMTIK_QActvT output[QMTIK_O]);
 
+size_t QMTIK_rt_arena_size(const QMTIK_RtDesc* desc);
+uint8_t QMTIK_rt_instantiate(QMTIK_RtNetwork* rt, const QMTIK_RtDesc* desc, void* arena, size_t arena_size);
+void QMTIK_rt_set_layer(QMTIK_RtNetwork* rt, size_t l, const QMTIK_QWghtT* wght, const QMTIK_QWghtT* bias);
+uint8_t QMTIK_rt_set_scales(QMTIK_RtNetwork* rt, const QMTIK_MainT* w_scales, const QMTIK_MainT* a_scales);
+uint8_t QMTIK_rt_set_gather(QMTIK_RtNetwork* rt, uint32_t n_inputs, const uint32_t* gather);
+void QMTIK_rt_infer(const QMTIK_RtNetwork* rt, void* scratch, const QMTIK_QActvT* input, QMTIK_QActvT* output);
+uint8_t QMTIK_rt_store(const QMTIK_RtNetwork* rt, FILE* file);
+size_t QMTIK_rt_file_arena_size(FILE* file);
+uint8_t QMTIK_rt_load(QMTIK_RtNetwork* rt, void* arena, size_t arena_size, FILE* file);
+#if QMTIK_DENSE_INFER
+void QMTIK_rt_model_desc(QMTIK_RtDesc* desc, uint32_t widths[QMTIK_L+3], uint8_t actvs[QMTIK_L+2]);
+void QMTIK_rt_from_q_model(QMTIK_RtNetwork* rt, const QMTIK_QModel* q_model);
+void QMTIK_rt_plan_model(QMTIK_RtPlan* plan, const QMTIK_QModel* q_model, const QMTIK_SamplePair* samples, size_t n_samples);
+uint8_t QMTIK_rt_from_plan(QMTIK_RtNetwork* rt, const QMTIK_RtPlan* plan, const QMTIK_QModel* q_model);
+uint8_t QMTIK_calibrate(QMTIK_Calibration* calibration, const QMTIK_Network* network, FILE* calib_file, QMTIK_MainT percentile, uint8_t pow2);
+uint8_t QMTIK_rt_from_network(QMTIK_RtNetwork* rt, const QMTIK_Network* network, const QMTIK_Calibration* calibration);
+#endif
+
+#ifdef QMTIK_BENCH
+uint8_t QMTIK_bench_infer(QMTIK_BenchResult* result, QMTIK_QNetwork* q_network, const char* model_path, const QMTIK_SamplePair* samples, size_t n_samples, double* latencies, size_t iterations);
+void QMTIK_bench_train(QMTIK_BenchResult* result, QMTIK_Network* network, QMTIK_TrainContext* contexts, size_t n_threads, const QMTIK_SamplePair* samples, size_t n_samples);
+void QMTIK_write_bench_json(const QMTIK_BenchResult* result, FILE* json_file);
+#endif
+
+#ifdef QMTIK_SERVE
+uint8_t QMTIK_serve_start(QMTIK_Server* server, const QMTIK_QModel* q_model, size_t n_workers, size_t max_batch, double max_wait_us);
+uint8_t QMTIK_serve_submit(QMTIK_Server* server, QMTIK_ServeRequest* request);
+void QMTIK_serve_wait(QMTIK_ServeRequest* request);
+void QMTIK_serve_stats(QMTIK_Server* server, QMTIK_ServeStats* stats);
+void QMTIK_serve_stop(QMTIK_Server* server);
+#endif
+
+#ifdef QMTIK_PROFILE
+void QMTIK_get_profile(QMTIK_Profile* profile);
+void QMTIK_reset_profile(void);
+void QMTIK_set_profile_hook(QMTIK_ProfileHook hook, void* user);
+#endif
+
 size_t QMTIK_get_network_memory_usage(void);
 size_t QMTIK_get_model_memory_usage(void);
 size_t QMTIK_get_inference_memory_usage(void);
+size_t QMTIK_get_context_memory_usage(void);
+size_t QMTIK_get_train_context_memory_usage(void);
+size_t QMTIK_get_finetune_memory_usage(void);
+const char* QMTIK_get_kernel_name(void);
 //==================================================
 static inline QMTIK_MainT QMTIK_train_activation(QMTIK_MainT x);
 static inline QMTIK_MainT QMTIK_train_activation_deriv(QMTIK_MainT x);
 static inline QMTIK_QActvT QMTIK_infer_activation(QMTIK_MainT x);
+static inline QMTIK_QActvT QMTIK_infer_activation_q(QMTIK_QAccT acc, const QMTIK_QRequant rq[2]);
 static inline void QMTIK_train_post_process(QMTIK_MainT z[QMTIK_O]);
 static inline void QMTIK_infer_post_process(QMTIK_QActvT z[QMTIK_O]);
-static inline QMTIK_MainT QMTIK_train_cost(QMTIK_MainT output[QMTIK_O], QMTIK_QActvT expected[QMTIK_O]);
-static inline QMTIK_MainT QMTIK_infer_cost(QMTIK_QActvT output[QMTIK_O], QMTIK_QActvT expected[QMTIK_O]);
+static inline QMTIK_MainT QMTIK_train_cost(QMTIK_MainT output[QMTIK_O], const QMTIK_QActvT expected[QMTIK_O]);
+static inline QMTIK_MainT QMTIK_infer_cost(QMTIK_QActvT output[QMTIK_O], const QMTIK_QActvT expected[QMTIK_O]);
+static inline QMTIK_QActvT QMTIK_smooth_activation(QMTIK_QAccT acc, QMTIK_MainT acc_scale, QMTIK_MainT a_scale, uint8_t actv);
+static inline void QMTIK_build_steps(QMTIK_QStepLut* lut, QMTIK_MainT acc_scale, QMTIK_MainT a_scale, uint8_t actv);
+static inline QMTIK_QActvT QMTIK_step_lookup(const QMTIK_QStepLut* lut, QMTIK_QAccT acc);
+static inline void QMTIK_build_pp_lut(QMTIK_QPpLut* lut, QMTIK_MainT a_scale);
+static inline void QMTIK_softmax_q(const QMTIK_QPpLut* lut, QMTIK_QActvT* z, size_t n);
+static inline void QMTIK_run_once(int* state, void (*init)(void));
+static inline void QMTIK_build_luts_once(void);
+static inline void QMTIK_build_luts(void);
+#ifdef QMTIK_SERVE
+    static inline uint64_t QMTIK_serve_ns(void);
+    static inline QMTIK_ServeRequest* QMTIK_serve_pop(QMTIK_Server* server);
+    static inline QMTIK_ServeRequest* QMTIK_serve_take(QMTIK_Server* server);
+    static inline void QMTIK_serve_max(uint64_t* x, uint64_t v);
+    static void* QMTIK_serve_worker(void* arg);
+#endif
+#ifdef QMTIK_PROFILE
+    static inline uint64_t QMTIK_profile_ns(void);
+    static inline void QMTIK_profile_record(uint8_t kind, size_t layer, uint64_t start, uint64_t values, uint64_t clamped);
+    static inline uint64_t QMTIK_count_clamped_q(const QMTIK_QActvT* y, size_t n);
+    static inline uint64_t QMTIK_count_clamped_f(const QMTIK_MainT* x, size_t n, QMTIK_MainT scale, uint8_t activate);
+    static inline const QMTIK_QActvT* QMTIK_layer_actv(const QMTIK_QContext* q_context, size_t l);
+#endif
 //==================================================
 static inline QMTIK_QWghtT QMTIK_quantize_w(QMTIK_MainT x);
 static inline QMTIK_MainT QMTIK_fake_quantize_w(QMTIK_MainT x);
 static inline QMTIK_QActvT QMTIK_quantize_a(QMTIK_MainT x);
 static inline QMTIK_MainT QMTIK_fake_quantize_a(QMTIK_MainT x);
+static inline QMTIK_QWghtT QMTIK_get_w(const QMTIK_QWghtT* row, size_t j);
+static inline void QMTIK_set_w(QMTIK_QWghtT* row, size_t j, QMTIK_QWghtT w);
+static inline void QMTIK_quantize_row(const QMTIK_MainT* w, size_t k, QMTIK_QWghtT* q_w, QMTIK_MainT* scale);
+static inline void QMTIK_make_row_rq(const QMTIK_MainT* scale, size_t rows, QMTIK_QRequant* row_rq);
+static inline QMTIK_QRequant QMTIK_make_requant(QMTIK_MainT m);
+static inline int32_t QMTIK_requantize(QMTIK_QAccT acc, QMTIK_QRequant rq);
+static inline QMTIK_QActvT QMTIK_saturate_a(int32_t x);
+static inline void QMTIK_fold_bias(const QMTIK_QWghtT* bias, size_t n, QMTIK_QAccT* acc_bias);
+static inline void QMTIK_prepare_q_model(QMTIK_QModel* q_model);
+static inline void QMTIK_prepare_q_panels(QMTIK_QModel* q_model);
+static inline uint32_t QMTIK_checksum(uint32_t hash, const void* data, size_t size);
+static inline uint8_t QMTIK_check_model_header(const QMTIK_ModelHeader* header);
+static inline void QMTIK_emit_array(FILE* c_file, const char* type, const char* name, const char* array, const void* data, size_t size, size_t n);
+static inline void QMTIK_emit_layer(FILE* c_file, const char* name, const char* layer, size_t rows, size_t k, const char* x, const char* out, unsigned unroll);
+static inline uint8_t QMTIK_rt_check_desc(const QMTIK_RtDesc* desc);
+static inline size_t QMTIK_rt_layout(const QMTIK_RtDesc* desc, uint8_t* base, QMTIK_RtNetwork* rt);
+static inline void QMTIK_rt_prepare_layer(const QMTIK_RtNetwork* rt, QMTIK_RtLayer* layer);
+static inline QMTIK_QRequant QMTIK_rt_make_requant(QMTIK_MainT m);
+static inline int32_t QMTIK_rt_requantize(QMTIK_QAccT acc, QMTIK_QRequant rq);
+static inline QMTIK_QActvT QMTIK_rt_activation(const QMTIK_RtNetwork* rt, const QMTIK_RtLayer* layer, QMTIK_QAccT acc);
+static inline void QMTIK_rt_post_process(const QMTIK_RtNetwork* rt, QMTIK_QActvT* z, size_t n);
+static inline uint8_t QMTIK_rt_read_desc(FILE* file, QMTIK_RtHeader* header, QMTIK_RtDesc* desc, uint32_t widths[QMTIK_RT_MAX_LAYERS+1], uint8_t actvs[QMTIK_RT_MAX_LAYERS]);
+#if QMTIK_DENSE_INFER
+    static inline uint32_t QMTIK_rt_plan_keep(const QMTIK_QWghtT* wght, size_t rows, size_t cols, const uint8_t* row_keep, const QMTIK_QActvT* low, const QMTIK_QActvT* high, uint8_t* keep);
+    static inline void QMTIK_calib_forward(const QMTIK_Network* network, const QMTIK_QActvT* input, QMTIK_MainT z[QMTIK_L+2][QMTIK_H>QMTIK_O?QMTIK_H:QMTIK_O]);
+    static inline QMTIK_MainT QMTIK_calib_clip(const uint32_t* hist, uint64_t count, QMTIK_MainT max, QMTIK_MainT percentile);
+    static inline QMTIK_MainT QMTIK_calib_scale(QMTIK_MainT clip, QMTIK_MainT fallback, uint8_t pow2);
+    static inline QMTIK_MainT QMTIK_calib_weights(const QMTIK_MainT* wght, size_t n, QMTIK_MainT percentile, uint8_t pow2);
+    static inline void QMTIK_rt_quantize_layer(const QMTIK_RtNetwork* rt, QMTIK_RtLayer* layer, const QMTIK_MainT* wght, const QMTIK_MainT* bias);
+    static inline void QMTIK_rt_plan_layer(const QMTIK_RtNetwork* rt, QMTIK_RtLayer* layer, const QMTIK_QWghtT* wght, const QMTIK_QWghtT* bias, size_t rows, size_t cols, const uint8_t* row_keep, const uint8_t* col_keep, const QMTIK_QActvT* col_value);
+#endif
+//==================================================
+typedef void (*QMTIK_QGemvKernel)(const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc);
+static inline void QMTIK_repack_panel(const QMTIK_QWghtT* wght, size_t rows, size_t k, QMTIK_QWghtT* panel, QMTIK_QAccT* wsum);
+static inline void QMTIK_select_kernel_once(void);
+static inline void QMTIK_select_kernel(void);
+static inline void QMTIK_infer_gemm(const QMTIK_QWghtT* wght, const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, const QMTIK_QAccT* acc_bias, const QMTIK_QRequant* row_rq, size_t rows, size_t k, const QMTIK_QActvT* x, size_t n, QMTIK_QAccT* acc);
+typedef void (*QMTIK_QSparseKernel)(const QMTIK_QWghtT* blocks, const uint16_t* cols, const uint32_t* group_end, const QMTIK_QAccT* wsum, size_t rows, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc);
+static inline void QMTIK_infer_ih(const QMTIK_QModel* q_model, const QMTIK_QActvT* x, size_t n, QMTIK_QAccT* acc);
+typedef void (*QMTIK_QColumnKernel)(const QMTIK_QWghtT* cols, size_t stride, const uint16_t* nz, size_t n, const QMTIK_QActvT* x, QMTIK_QAccT* acc);
+static inline void QMTIK_gather_column(const QMTIK_QWghtT* wght, size_t rows, size_t k, size_t j, QMTIK_QWghtT* col);
+#ifdef QMTIK_SKIP_ZERO_ACTV
+    static inline uint8_t QMTIK_infer_columns(const QMTIK_QWghtT* cols, const QMTIK_QAccT* acc_bias, size_t rows, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc);
+#endif
 //==================================================
 static inline uint8_t QMTIK_load_sample_pair(FILE* file, QMTIK_SamplePair* pair);
-static inline void QMTIK_train_forward(QMTIK_Network* network);
-static inline void QMTIK_train_step(QMTIK_Network* network, QMTIK_SamplePair sample_pair);
+static inline size_t QMTIK_load_train_batch(FILE* file, QMTIK_SamplePair samples[QMTIK_TRAIN_BATCH], const QMTIK_SamplePair* batch[QMTIK_TRAIN_BATCH]);
+static inline uint64_t QMTIK_mix64(uint64_t x);
+static inline size_t QMTIK_permute_index(size_t i, size_t n, uint64_t key);
+static inline const QMTIK_SamplePair* QMTIK_next_sample(QMTIK_Dataset* dataset);
+static inline void QMTIK_refresh_wght_shadow(QMTIK_Network* network);
+static inline void QMTIK_refresh_row_shadow(QMTIK_Network* network);
+static inline void QMTIK_record_tape(const QMTIK_MainT* z, QMTIK_MainT* tape, size_t n);
+static inline void QMTIK_train_forward(const QMTIK_Network* network, QMTIK_TrainContext* context);
+static inline void QMTIK_infer_logits(const QMTIK_QModel* q_model, QMTIK_QContext* q_context);
+static inline void QMTIK_infer_layers(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, size_t first);
+static inline void QMTIK_infer_layer(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, size_t l);
+static inline void QMTIK_delta_dots(const QMTIK_QModel* q_model, const QMTIK_QActvT* x, QMTIK_QAccT* dot);
+static inline void QMTIK_delta_update(const QMTIK_QModel* q_model, const uint16_t* idx, const int16_t* dx, size_t n, QMTIK_QAccT* dot);
+static inline uint32_t QMTIK_ft_random(uint32_t* state);
+static inline int16_t QMTIK_ft_update(int16_t master, int64_t g, uint8_t shift, uint32_t* rng);
+static inline QMTIK_QWghtT QMTIK_ft_code(int16_t master, int32_t low, int32_t high);
+static inline void QMTIK_finetune_commit(const QMTIK_FineTune* fine_tune, QMTIK_QModel* q_model);
+#ifdef QMTIK_THREADS
+static inline void QMTIK_infer_rows(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, size_t l, size_t r0, size_t r1);
+static inline void QMTIK_pool_init(QMTIK_PoolSync* sync);
+static inline uint8_t QMTIK_pool_wait(QMTIK_PoolSync* sync, size_t seen);
+static inline void QMTIK_pool_announce(QMTIK_PoolSync* sync);
+static inline void QMTIK_pool_barrier(QMTIK_PoolSync* sync, size_t* phase);
+static inline void QMTIK_pool_stop(QMTIK_PoolSync* sync, const pthread_t* threads);
+static inline void QMTIK_pool_layers(QMTIK_InferPool* pool, size_t t, size_t* phase);
+static void* QMTIK_pool_worker(void* arg);
+#endif
+static inline void QMTIK_train_backward(const QMTIK_Network* network, QMTIK_TrainContext* context, const QMTIK_SamplePair* sample_pair);
+#ifdef QMTIK_PRUNE_PERCENT
+static inline QMTIK_MainT QMTIK_block_norm(const QMTIK_IHLayer* layer, size_t g, size_t c);
+static inline void QMTIK_prune_input_layer(QMTIK_Network* network, QMTIK_MainT fraction);
+#endif
+typedef void (*QMTIK_AdamKernel)(QMTIK_MainT* w, QMTIK_MainT* fq_w, QMTIK_MainT* m, QMTIK_MainT* v, QMTIK_MainT* g, size_t n, const QMTIK_AdamStep* step);
+static inline QMTIK_MainT QMTIK_schedule_alpha(const QMTIK_AdamState* adam_state);
+static inline QMTIK_AdamStep QMTIK_adam_begin(QMTIK_AdamState* adam_state, QMTIK_MainT scale);
+static inline void QMTIK_adam_apply(QMTIK_Network* network, QMTIK_Params* grads, const QMTIK_AdamStep* step, size_t first, size_t count);
+static inline void QMTIK_train_update(QMTIK_Network* network, QMTIK_Params* grads, QMTIK_MainT scale);
+#ifdef QMTIK_THREADS
+static inline void QMTIK_train_pool_step(QMTIK_TrainPool* pool, size_t t, size_t* phase);
+static void* QMTIK_train_worker(void* arg);
+static inline void QMTIK_start_train_pool(QMTIK_TrainPool* pool, QMTIK_Network* network, QMTIK_TrainContext* contexts, size_t n_threads);
+#endif
+static inline void QMTIK_train_batch(QMTIK_Network* network, const QMTIK_SamplePair* const* batch, size_t n, QMTIK_TrainContext* contexts, size_t n_contexts, struct QMTIK_TrainPool* pool);
+static inline void QMTIK_train_epochs(QMTIK_Network* network, FILE* train_file, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_contexts, QMTIK_Checkpoint* checkpoint, QMTIK_Validation* validation);
+static inline double QMTIK_wall_seconds(void);
+static inline uint8_t QMTIK_validate_epoch(QMTIK_Network* network, QMTIK_Validation* validation, FILE* model_file, size_t epoch, double start);
 //==================================================
 #ifdef QMTIK_IMPLEMENTATION
 //==================================================
+//Float reference for the int8 sigmoid/tanh of an accumulator, only evaluated while building the tables
+static inline QMTIK_QActvT QMTIK_smooth_activation(QMTIK_QAccT acc, QMTIK_MainT acc_scale, QMTIK_MainT a_scale, uint8_t actv) {
+    QMTIK_MainT x=fmaxf(QMTIK_CLAMP_MIN, fminf(QMTIK_CLAMP_MAX, acc*acc_scale));
+    x=(actv==QMTIK_RT_SIGMOID)?1.0f/(1.0f+expf(-x)):tanhf(x);
+    return (QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(x/a_scale)));
+}
+//The reference is monotonic in acc, so every output level starts at one accumulator value, found by bisection
+//Levels above the output at INT32_MAX keep INT32_MAX, which no accumulator exceeds
+static inline void QMTIK_build_steps(QMTIK_QStepLut* lut, QMTIK_MainT acc_scale, QMTIK_MainT a_scale, uint8_t actv) {
+    int64_t lo=INT32_MIN;
+    int32_t high=QMTIK_smooth_activation(INT32_MAX, acc_scale, a_scale, actv);
+    lut->low=QMTIK_smooth_activation(INT32_MIN, acc_scale, a_scale, actv);
+    for (size_t v=0; v<255; ++v){
+        int32_t level=lut->low+(int32_t)v+1;
+        int64_t hi=INT32_MAX;
+        if (level>high) {lut->step[v]=INT32_MAX; continue;}
+        while (lo+1<hi){
+            int64_t mid=lo+(hi-lo)/2;
+            if (QMTIK_smooth_activation((QMTIK_QAccT)mid, acc_scale, a_scale, actv)>=level) hi=mid; else lo=mid;
+        }
+        lut->step[v]=(QMTIK_QAccT)lo;
+    }
+}
+//Counts the breakpoints below acc in 8 branchless steps
+static inline QMTIK_QActvT QMTIK_step_lookup(const QMTIK_QStepLut* lut, QMTIK_QAccT acc) {
+    size_t v=0;
+    for (size_t s=128; s; s>>=1) v+=(acc>lut->step[v+s-1])?s:0;
+    return (QMTIK_QActvT)(lut->low+(int32_t)v);
+}
+static inline void QMTIK_build_pp_lut(QMTIK_QPpLut* lut, QMTIK_MainT a_scale) {
+    for (size_t d=0; d<256; ++d) lut->exp[d]=(uint32_t)lroundf(8388608.0f*expf(-(QMTIK_MainT)d*a_scale));
+    for (int z=QMTIK_QActvT_MIN; z<=QMTIK_QActvT_MAX; ++z) lut->sigmoid[z-QMTIK_QActvT_MIN]=(QMTIK_QActvT)roundf((1.0f/(1.0f+expf(-fmaxf(QMTIK_CLAMP_MIN, fminf(QMTIK_CLAMP_MAX, z*a_scale)))))*127.0f);
+}
+//Softmax in integers: max_z-z[i] indexes the exp table, then one rounded up 2^40 reciprocal of the sum scales every output to 127
+static inline void QMTIK_softmax_q(const QMTIK_QPpLut* lut, QMTIK_QActvT* z, size_t n) {
+    QMTIK_QActvT max_z=z[0];
+    uint64_t sum=0;
+    for (size_t i=1; i<n; ++i) if (z[i]>max_z) max_z=z[i];
+    for (size_t i=0; i<n; ++i) sum+=lut->exp[max_z-z[i]];
+    uint64_t recip=((127ull<<40)+sum-1)/sum;
+    for (size_t i=0; i<n; ++i) z[i]=(QMTIK_QActvT)((lut->exp[max_z-z[i]]*recip+(1ull<<39))>>40);
+}
+#if defined(QMTIK_SIGMOID_ACTV)||defined(QMTIK_TANH_ACTV)
+    static QMTIK_QStepLut QMTIK_actv_lut;
+#endif
+#if defined(QMTIK_SOFT_MAX_PP)||defined(QMTIK_SIGMOID_PP)
+    static QMTIK_QPpLut QMTIK_pp_lut;
+#endif
+//state goes 0 (not run), 1 (running), 2 (done): the first caller runs init, concurrent callers wait until it is done
+static inline void QMTIK_run_once(int* state, void (*init)(void)) {
+    #ifdef __GNUC__
+        int expected=0;
+        if (__atomic_load_n(state, __ATOMIC_ACQUIRE)==2) return;
+        if (__atomic_compare_exchange_n(state, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {init(); __atomic_store_n(state, 2, __ATOMIC_RELEASE); return;}
+        while (__atomic_load_n(state, __ATOMIC_ACQUIRE)!=2) QMTIK_SPIN_PAUSE();
+    #else
+        if (*state!=2) {init(); *state=2;}
+    #endif
+}
+static inline void QMTIK_build_luts_once(void) {
+    #if defined(QMTIK_SIGMOID_ACTV)||defined(QMTIK_TANH_ACTV)
+        QMTIK_build_steps(&QMTIK_actv_lut, QMTIK_QACC_SCALE, QMTIK_A_SCALE, QMTIK_ACTV_ID);
+    #endif
+    #if defined(QMTIK_SOFT_MAX_PP)||defined(QMTIK_SIGMOID_PP)
+        QMTIK_build_pp_lut(&QMTIK_pp_lut, QMTIK_A_SCALE);
+    #endif
+}
+//The compiled-in scales never change, so the tables are built once, on the first model load, while other threads may infer
+static inline void QMTIK_build_luts(void) {static int built=0; QMTIK_run_once(&built, QMTIK_build_luts_once);}
+//==================================================
 #ifdef QMTIK_RELU_ACTV
     static inline QMTIK_MainT QMTIK_train_activation(QMTIK_MainT x) {return x>0?x:0.0f;}
     static inline QMTIK_MainT QMTIK_train_activation_deriv(QMTIK_MainT x) {return x>0?1.0f:0.0f;}
     static inline QMTIK_QActvT QMTIK_infer_activation(QMTIK_MainT x) {return (QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(QMTIK_train_activation(x)/QMTIK_A_SCALE)));}
+    static inline QMTIK_QActvT QMTIK_infer_activation_q(QMTIK_QAccT acc, const QMTIK_QRequant rq[2]) {return acc>0?QMTIK_saturate_a(QMTIK_requantize(acc, rq[0])):0;}
 #endif
 #ifdef QMTIK_LEAKY_RELU_ACTV
     static inline QMTIK_MainT QMTIK_train_activation(QMTIK_MainT x) {return x>0?x:QMTIK_LEAK*x;}
     static inline QMTIK_MainT QMTIK_train_activation_deriv(QMTIK_MainT x) {return x>0?1.0f:QMTIK_LEAK;}
     static inline QMTIK_QActvT QMTIK_infer_activation(QMTIK_MainT x) {return (QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(QMTIK_train_activation(x)/QMTIK_A_SCALE)));}
+    static inline QMTIK_QActvT QMTIK_infer_activation_q(QMTIK_QAccT acc, const QMTIK_QRequant rq[2]) {return QMTIK_saturate_a(QMTIK_requantize(acc, rq[acc>0?0:1]));}
 #endif
 #ifdef QMTIK_SIGMOID_ACTV
     static inline QMTIK_MainT QMTIK_train_activation(QMTIK_MainT x) {return 1.0f/(1.0f+expf(-(fmaxf(QMTIK_CLAMP_MIN, fminf(QMTIK_CLAMP_MAX, x)))));}    
     static inline QMTIK_MainT QMTIK_train_activation_deriv(QMTIK_MainT x) {return QMTIK_train_activation(x)*(1.0f-QMTIK_train_activation(x));}
     static inline QMTIK_QActvT QMTIK_infer_activation(QMTIK_MainT x) {return (QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(QMTIK_train_activation(x)/QMTIK_A_SCALE)));}
+    static inline QMTIK_QActvT QMTIK_infer_activation_q(QMTIK_QAccT acc, const QMTIK_QRequant rq[2]) {(void)rq; return QMTIK_step_lookup(&QMTIK_actv_lut, acc);}
 #endif
 #ifdef QMTIK_TANH_ACTV
     static inline QMTIK_MainT QMTIK_train_activation(QMTIK_MainT x) {return tanhf(fmaxf(QMTIK_CLAMP_MIN, fminf(QMTIK_CLAMP_MAX, x)));}
     static inline QMTIK_MainT QMTIK_train_activation_deriv(QMTIK_MainT x) {return 1.0f-QMTIK_train_activation(x)*QMTIK_train_activation(x);}
     static inline QMTIK_QActvT QMTIK_infer_activation(QMTIK_MainT x) {return (QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(QMTIK_train_activation(x)/QMTIK_A_SCALE)));}
+    static inline QMTIK_QActvT QMTIK_infer_activation_q(QMTIK_QAccT acc, const QMTIK_QRequant rq[2]) {(void)rq; return QMTIK_step_lookup(&QMTIK_actv_lut, acc);}
 #endif
 //==================================================
 #ifdef QMTIK_LINEAR_PP
@@ -275,41 +1083,34 @@ static inline void QMTIK_train_step(QMTIK_Network* network, QMTIK_SamplePair sam
         for (size_t i=0; i<QMTIK_O; ++i) {z[i]=expf(z[i]-max_z); sum+=z[i];}
         for (size_t i=0; i<QMTIK_O; ++i) z[i]=(z[i]/sum)*127;
     }
-    static inline void QMTIK_infer_post_process(QMTIK_QActvT z[QMTIK_O]) {
-        float temp[QMTIK_O];
-        float max_z=z[0]*QMTIK_A_SCALE;
-        for (size_t i=1; i<QMTIK_O; ++i) if (z[i]*QMTIK_A_SCALE>max_z) max_z=z[i]*QMTIK_A_SCALE;
-        float sum = 0.0f;
-        for (size_t i=0; i<QMTIK_O; ++i) {temp[i]=expf(z[i]*QMTIK_A_SCALE-max_z); sum+=temp[i];}
-        for (size_t i=0; i<QMTIK_O; ++i) {z[i]=(QMTIK_QActvT)roundf((temp[i]/sum)*127);}
-    }
+    static inline void QMTIK_infer_post_process(QMTIK_QActvT z[QMTIK_O]) {QMTIK_softmax_q(&QMTIK_pp_lut, z, QMTIK_O);}
 #endif
 #ifdef QMTIK_SIGMOID_PP
     static inline void QMTIK_train_post_process(QMTIK_MainT z[QMTIK_O]) {for (size_t i=0; i<QMTIK_O; ++i){z[i]=fmaxf(QMTIK_CLAMP_MIN, fminf(QMTIK_CLAMP_MAX, z[i])); z[i]=(1.0f/(1.0f+expf(-z[i])))*127.0f;}}
-    static inline void QMTIK_infer_post_process(QMTIK_QActvT z[QMTIK_O]) {for (size_t i=0; i<QMTIK_O; ++i) z[i]=(QMTIK_QActvT)roundf((1.0f/(1.0f+expf(-fmaxf(QMTIK_CLAMP_MIN, fminf(QMTIK_CLAMP_MAX, z[i]*QMTIK_A_SCALE)))))*127.0f);}
+    static inline void QMTIK_infer_post_process(QMTIK_QActvT z[QMTIK_O]) {for (size_t i=0; i<QMTIK_O; ++i) z[i]=QMTIK_pp_lut.sigmoid[z[i]-QMTIK_QActvT_MIN];}
 #endif
 //==================================================
 #ifdef QMTIK_MSE_COST
-    static inline QMTIK_MainT QMTIK_train_cost(QMTIK_MainT output[QMTIK_O], QMTIK_QActvT expected[QMTIK_O]) {
+    static inline QMTIK_MainT QMTIK_train_cost(QMTIK_MainT output[QMTIK_O], const QMTIK_QActvT expected[QMTIK_O]) {
         QMTIK_MainT total_error=0.0f;
         for (size_t i=0; i<QMTIK_O; ++i) {QMTIK_MainT diff=output[i]-(QMTIK_MainT)expected[i]; total_error+=diff*diff;}
         return total_error/QMTIK_O;
     }
-    static inline QMTIK_MainT QMTIK_infer_cost(QMTIK_QActvT output[QMTIK_O], QMTIK_QActvT expected[QMTIK_O]) {
+    static inline QMTIK_MainT QMTIK_infer_cost(QMTIK_QActvT output[QMTIK_O], const QMTIK_QActvT expected[QMTIK_O]) {
         QMTIK_MainT total_error=0.0f;
         for (size_t i = 0; i < QMTIK_O; ++i) {QMTIK_MainT diff=(QMTIK_MainT)output[i]-(QMTIK_MainT)expected[i]; total_error+=diff*diff;}
         return total_error/QMTIK_O;
     }
 #endif
 #ifdef QMTIK_CROSS_ENTROPY_COST
-    static inline QMTIK_MainT QMTIK_train_cost(QMTIK_MainT output[QMTIK_O], QMTIK_QActvT expected[QMTIK_O]){
+    static inline QMTIK_MainT QMTIK_train_cost(QMTIK_MainT output[QMTIK_O], const QMTIK_QActvT expected[QMTIK_O]){
         int32_t pred_class=0;
         for(size_t i=1; i<QMTIK_O; ++i) if (output[i]>output[pred_class]) pred_class=i;
         int32_t exp_class=0;
         for(size_t i=1; i<QMTIK_O; ++i) if(expected[i]>expected[exp_class]) exp_class=i;
         return (pred_class==exp_class)?1:0;
     }
-    static inline QMTIK_MainT QMTIK_infer_cost(QMTIK_QActvT output[QMTIK_O], QMTIK_QActvT expected[QMTIK_O]){
+    static inline QMTIK_MainT QMTIK_infer_cost(QMTIK_QActvT output[QMTIK_O], const QMTIK_QActvT expected[QMTIK_O]){
         int32_t pred_class=0;
         for(size_t i=1; i<QMTIK_O; ++i) if(output[i]>output[pred_class]) pred_class=i;
         int32_t exp_class=0;
@@ -318,236 +1119,2406 @@ static inline void QMTIK_train_step(QMTIK_Network* network, QMTIK_SamplePair sam
     }
 #endif
 //==================================================
-static inline uint8_t QMTIK_load_sample_pair(FILE* file, QMTIK_SamplePair* pair) {
-    size_t r1=fread(pair->input, 1, QMTIK_I, file);
-    size_t r2=fread(pair->output, 1, QMTIK_O, file);
-    return (r1==QMTIK_I&&r2==QMTIK_O);
+#ifdef QMTIK_PROFILE
+static QMTIK_Profile QMTIK_profile;
+static QMTIK_ProfileHook QMTIK_profile_hook=NULL;
+static void* QMTIK_profile_user=NULL;
+static inline uint64_t QMTIK_profile_ns(void) {struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (uint64_t)ts.tv_sec*1000000000u+(uint64_t)ts.tv_nsec;}
+static inline void QMTIK_profile_record(uint8_t kind, size_t layer, uint64_t start, uint64_t values, uint64_t clamped) {
+    QMTIK_ProfileCounter sample={1, QMTIK_PROFILE_CLOCK()-start, values, clamped};
+    QMTIK_ProfileCounter* counter=(kind==QMTIK_PROF_INFER)?&QMTIK_profile.infer[layer]:(kind==QMTIK_PROF_TRAIN)?&QMTIK_profile.train[layer]:(kind==QMTIK_PROF_WGHT)?&QMTIK_profile.wght[layer]:&QMTIK_profile.step;
+    QMTIK_PROFILE_ADD(counter->calls, sample.calls);
+    QMTIK_PROFILE_ADD(counter->ticks, sample.ticks);
+    QMTIK_PROFILE_ADD(counter->values, sample.values);
+    QMTIK_PROFILE_ADD(counter->clamped, sample.clamped);
+    if (QMTIK_profile_hook) QMTIK_profile_hook(kind, layer, &sample, QMTIK_profile_user);
+}
+//Integer outputs can only be seen at the limits, the float paths below count values rounded past them
+static inline uint64_t QMTIK_count_clamped_q(const QMTIK_QActvT* y, size_t n) {
+    uint64_t clamped=0;
+    for (size_t i=0; i<n; ++i) clamped+=(y[i]==QMTIK_QActvT_MAX||y[i]==QMTIK_QActvT_MIN);
+    return clamped;
+}
+static inline uint64_t QMTIK_count_clamped_f(const QMTIK_MainT* x, size_t n, QMTIK_MainT scale, uint8_t activate) {
+    uint64_t clamped=0;
+    for (size_t i=0; i<n; ++i){
+        QMTIK_MainT q=roundf((activate?QMTIK_train_activation(x[i]):x[i])/scale);
+        clamped+=(q>QMTIK_QActvT_MAX||q<QMTIK_QActvT_MIN);
+    }
+    return clamped;
 }
+static inline const QMTIK_QActvT* QMTIK_layer_actv(const QMTIK_QContext* q_context, size_t l) {return (l==0)?q_context->q_ih_actv:(l<=QMTIK_L)?q_context->q_hh_actv[l-1]:q_context->q_o_z;}
+void QMTIK_get_profile(QMTIK_Profile* profile) {*profile=QMTIK_profile;}
+void QMTIK_reset_profile(void) {memset(&QMTIK_profile, 0, sizeof(QMTIK_profile));}
+//hook sees every recorded layer right away, set it before starting threads that infer or train
+void QMTIK_set_profile_hook(QMTIK_ProfileHook hook, void* user) {QMTIK_profile_hook=hook; QMTIK_profile_user=user;}
+#endif
+//==================================================
+static inline uint8_t QMTIK_load_sample_pair(FILE* file, QMTIK_SamplePair* pair) {return fread(pair, sizeof(QMTIK_SamplePair), 1, file)==1;}
 //==================================================
 static inline QMTIK_QWghtT QMTIK_quantize_w(QMTIK_MainT x) {return (QMTIK_QWghtT)fmaxf(QMTIK_QWghtT_MIN, fminf(QMTIK_QWghtT_MAX, roundf(x/QMTIK_W_SCALE)));}
 static inline QMTIK_MainT QMTIK_fake_quantize_w(QMTIK_MainT x) {return QMTIK_quantize_w(x)*QMTIK_W_SCALE;}
 static inline QMTIK_QActvT QMTIK_quantize_a(QMTIK_MainT x) {return (QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(x/QMTIK_A_SCALE)));}
 static inline QMTIK_MainT QMTIK_fake_quantize_a(QMTIK_MainT x) {return QMTIK_quantize_a(x)*QMTIK_A_SCALE;}
+#ifdef QMTIK_INT4_WGHT
+    //INT4 rows are symmetric around zero with scale max|w|/7, taken from the float weights at every shadow refresh
+    static inline QMTIK_MainT QMTIK_row_scale(const QMTIK_MainT* w, size_t k) {
+        QMTIK_MainT max_w=0.0f;
+        for (size_t j=0; j<k; ++j) max_w=fmaxf(max_w, fabsf(w[j]));
+        return (max_w>0.0f)?max_w/QMTIK_QW4_MAX:QMTIK_W_SCALE;
+    }
+    static inline QMTIK_QWghtT QMTIK_quantize_w4(QMTIK_MainT x, QMTIK_MainT scale) {return (QMTIK_QWghtT)fmaxf(QMTIK_QW4_MIN, fminf(QMTIK_QW4_MAX, roundf(x/scale)));}
+    static inline QMTIK_MainT QMTIK_fake_quantize_w4(QMTIK_MainT x, QMTIK_MainT scale) {return QMTIK_quantize_w4(x, scale)*scale;}
+    static inline void QMTIK_fake_quantize_row(const QMTIK_MainT* w, size_t k, QMTIK_MainT* fq_w) {
+        QMTIK_MainT scale=QMTIK_row_scale(w, k);
+        for (size_t j=0; j<k; ++j) fq_w[j]=QMTIK_fake_quantize_w4(w[j], scale);
+    }
+    static inline QMTIK_QWghtT QMTIK_get_w(const QMTIK_QWghtT* row, size_t j) {return (QMTIK_QWghtT)(((((uint8_t)row[j>>1]>>(4*(j&1)))&0xF)^8)-8);}
+    static inline void QMTIK_set_w(QMTIK_QWghtT* row, size_t j, QMTIK_QWghtT w) {
+        unsigned shift=4*(j&1);
+        row[j>>1]=(QMTIK_QWghtT)(((uint8_t)row[j>>1]&~(0xFu<<shift))|(((unsigned)w&0xFu)<<shift));
+    }
+    static inline void QMTIK_quantize_row(const QMTIK_MainT* w, size_t k, QMTIK_QWghtT* q_w, QMTIK_MainT* scale) {
+        *scale=QMTIK_row_scale(w, k);
+        for (size_t j=0; j<k; ++j) QMTIK_set_w(q_w, j, QMTIK_quantize_w4(w[j], *scale));
+    }
+#else
+    static inline QMTIK_QWghtT QMTIK_get_w(const QMTIK_QWghtT* row, size_t j) {return row[j];}
+    static inline void QMTIK_set_w(QMTIK_QWghtT* row, size_t j, QMTIK_QWghtT w) {row[j]=w;}
+    static inline void QMTIK_quantize_row(const QMTIK_MainT* w, size_t k, QMTIK_QWghtT* q_w, QMTIK_MainT* scale) {(void)scale; for (size_t j=0; j<k; ++j) q_w[j]=QMTIK_quantize_w(w[j]);}
+#endif
 //==================================================
-static inline void QMTIK_train_forward(QMTIK_Network* network) {
-    QMTIK_MainT acc;
-    for(size_t i=0; i<QMTIK_H; i++){
-        acc=network->ih_layer.ih_bias[i];
-        for(size_t j=0; j<QMTIK_I; ++j) acc+=QMTIK_fake_quantize_w(network->ih_layer.ih_wght[i][j])*QMTIK_fake_quantize_a(network->i_layer.i_actv[j]);
-        network->ih_layer.ih_z[i]=acc;
+//Fixed-point requantization: acc*m ~= (acc*mult)>>shift, mult in [2^30, 2^31)
+static inline QMTIK_QRequant QMTIK_make_requant(QMTIK_MainT m) {
+    QMTIK_QRequant rq={0, 1};
+    if (m<=0.0f) return rq;
+    int e;
+    QMTIK_MainT f=frexpf(m, &e);
+    int64_t mult=(int64_t)llroundf(f*2147483648.0f);
+    if (mult==((int64_t)1<<31)) {mult>>=1; ++e;}
+    rq.shift=31-e;
+    if (rq.shift>62) {rq.mult=0; rq.shift=1; return rq;}
+    //m at or above 2^30 needs a shift below 1, saturate to the largest multiplier instead
+    if (rq.shift<1){
+        fprintf(stderr, "[QMTIK] Requantization multiplier %g too large, clamped to 2^30\n", (double)m);
+        rq.mult=INT32_MAX; rq.shift=1; return rq;
     }
-    for(size_t i=0; i<QMTIK_H; ++i){
-        acc=network->hh_layers[0].hh_bias[i];
-        for(size_t j=0; j<QMTIK_H; ++j) acc+=QMTIK_fake_quantize_w(network->hh_layers[0].hh_wght[i][j])*QMTIK_fake_quantize_a(QMTIK_train_activation(network->ih_layer.ih_z[j]));
-        network->hh_layers[0].hh_z[i]=acc;
+    rq.mult=(int32_t)mult;
+    return rq;
+}
+static inline int32_t QMTIK_requantize(QMTIK_QAccT acc, QMTIK_QRequant rq) {return (int32_t)(((int64_t)acc*rq.mult+((int64_t)1<<(rq.shift-1)))>>rq.shift);}
+static inline QMTIK_QActvT QMTIK_saturate_a(int32_t x) {return (QMTIK_QActvT)(x>QMTIK_QActvT_MAX?QMTIK_QActvT_MAX:(x<QMTIK_QActvT_MIN?QMTIK_QActvT_MIN:x));}
+static inline void QMTIK_fold_bias(const QMTIK_QWghtT* bias, size_t n, QMTIK_QAccT* acc_bias) {for (size_t i=0; i<n; ++i) acc_bias[i]=(QMTIK_QAccT)lroundf(bias[i]/QMTIK_A_SCALE);}
+//Brings a row accumulated in its own weight scale back to QMTIK_QACC_SCALE, so biases and activations stay shared
+static inline void QMTIK_make_row_rq(const QMTIK_MainT* scale, size_t rows, QMTIK_QRequant* row_rq) {for (size_t i=0; i<rows; ++i) row_rq[i]=QMTIK_make_requant(scale[i]/QMTIK_W_SCALE);}
+static inline void QMTIK_prepare_q_model(QMTIK_QModel* q_model) {
+    QMTIK_QRequant rq_pos=QMTIK_make_requant(QMTIK_W_SCALE), rq_neg=QMTIK_make_requant(QMTIK_W_SCALE*QMTIK_LEAK);
+    QMTIK_fold_bias(q_model->q_ih_layer.q_ih_bias, QMTIK_H, q_model->q_ih_layer.q_ih_acc_bias);
+    q_model->q_ih_layer.q_ih_rq[0]=rq_pos; q_model->q_ih_layer.q_ih_rq[1]=rq_neg;
+    for (size_t l=0; l<QMTIK_L; ++l){
+        QMTIK_fold_bias(q_model->q_hh_layers[l].q_hh_bias, QMTIK_H, q_model->q_hh_layers[l].q_hh_acc_bias);
+        q_model->q_hh_layers[l].q_hh_rq[0]=rq_pos; q_model->q_hh_layers[l].q_hh_rq[1]=rq_neg;
     }
-    for(size_t l=1; l<QMTIK_L; ++l){
-        for(size_t i=0; i<QMTIK_H; ++i){
-            acc=network->hh_layers[l].hh_bias[i];
-            for(size_t j=0; j<QMTIK_H; j++) acc+=QMTIK_fake_quantize_w(network->hh_layers[l].hh_wght[i][j])*QMTIK_fake_quantize_a(QMTIK_train_activation(network->hh_layers[l-1].hh_z[j]));
-            network->hh_layers[l].hh_z[i]=acc;
+    QMTIK_fold_bias(q_model->q_o_layer.q_o_bias, QMTIK_O, q_model->q_o_layer.q_o_acc_bias);
+    q_model->q_o_layer.q_o_rq=rq_pos;
+    #ifdef QMTIK_INT4_WGHT
+        QMTIK_make_row_rq(q_model->q_ih_layer.q_ih_scale, QMTIK_H, q_model->q_ih_layer.q_ih_row_rq);
+        for (size_t l=0; l<QMTIK_L; ++l) QMTIK_make_row_rq(q_model->q_hh_layers[l].q_hh_scale, QMTIK_H, q_model->q_hh_layers[l].q_hh_row_rq);
+        QMTIK_make_row_rq(q_model->q_o_layer.q_o_scale, QMTIK_O, q_model->q_o_layer.q_o_row_rq);
+    #endif
+    #ifdef QMTIK_SKIP_ZERO_ACTV
+        for (size_t l=0; l<QMTIK_L; ++l) for (size_t j=0; j<QMTIK_H; ++j) QMTIK_gather_column(&q_model->q_hh_layers[l].q_hh_wght[0][0], QMTIK_H, QMTIK_H, j, q_model->q_columns.q_hh_cols[l][j]);
+        for (size_t j=0; j<QMTIK_H; ++j) QMTIK_gather_column(&q_model->q_o_layer.q_o_wght[0][0], QMTIK_O, QMTIK_H, j, q_model->q_columns.q_o_cols[j]);
+    #endif
+    QMTIK_prepare_q_panels(q_model);
+    QMTIK_select_kernel();
+}
+static inline void QMTIK_prepare_q_panels(QMTIK_QModel* q_model) {
+    #ifdef QMTIK_SIMD
+        #ifndef QMTIK_PRUNE_PERCENT
+        QMTIK_repack_panel(&q_model->q_ih_layer.q_ih_wght[0][0], QMTIK_H, QMTIK_I, q_model->q_panels.q_ih_panel, q_model->q_panels.q_ih_wsum);
+        #endif
+        for (size_t l=0; l<QMTIK_L; ++l) QMTIK_repack_panel(&q_model->q_hh_layers[l].q_hh_wght[0][0], QMTIK_H, QMTIK_H, q_model->q_panels.q_hh_panel[l], q_model->q_panels.q_hh_wsum[l]);
+        QMTIK_repack_panel(&q_model->q_o_layer.q_o_wght[0][0], QMTIK_O, QMTIK_H, q_model->q_panels.q_o_panel, q_model->q_panels.q_o_wsum);
+    #else
+        (void)q_model;
+    #endif
+}
+//==================================================
+//Panel layout: blocks of QMTIK_PANEL_R rows, each stored as [k/QMTIK_PANEL_K][QMTIK_PANEL_R][QMTIK_PANEL_K], zero padded
+//INT4 panels hold k groups 2g and 2g+1 in the low and high nibbles of one [QMTIK_PANEL_R][QMTIK_PANEL_K] byte tile
+static inline void QMTIK_repack_panel(const QMTIK_QWghtT* wght, size_t rows, size_t k, QMTIK_QWghtT* panel, QMTIK_QAccT* wsum) {
+    size_t k_pad=QMTIK_ROUND_UP(k, QMTIK_PANEL_KW);
+    for (size_t b=0; b<QMTIK_ROUND_UP(rows, QMTIK_PANEL_R); b+=QMTIK_PANEL_R){
+        for (size_t r=0; r<QMTIK_PANEL_R; ++r){
+            size_t row=b+r;
+            wsum[row]=0;
+            for (size_t j=0; j<k_pad; ++j){
+                QMTIK_QWghtT w=(row<rows&&j<k)?QMTIK_get_w(wght+row*QMTIK_WGHT_ROW(k), j):0;
+                QMTIK_set_w(panel+b*QMTIK_PANEL_ROW(k), QMTIK_PANEL_INDEX(r, j), w);
+                wsum[row]+=w;
+            }
         }
     }
-    for(size_t i=0; i<QMTIK_O; ++i){
-        acc=network->o_layer.o_bias[i];
-        for(size_t j=0; j<QMTIK_H; ++j) acc+=QMTIK_fake_quantize_w(network->o_layer.o_wght[i][j])*QMTIK_fake_quantize_a(QMTIK_train_activation(network->hh_layers[QMTIK_L-1].hh_z[j]));
-        network->o_layer.o_z[i]=acc;
-    }
-    QMTIK_train_post_process(network->o_layer.o_z);
 }
-void QMTIK_infer_forward(QMTIK_QNetwork* q_network) {
-    QMTIK_MainT acc;
-    for (size_t i=0; i<QMTIK_H; ++i){
-        acc=q_network->q_ih_layer.q_ih_bias[i]*QMTIK_W_SCALE;
-        for (size_t j=0; j<QMTIK_I; ++j) acc+=(q_network->q_ih_layer.q_ih_wght[i][j]*QMTIK_W_SCALE)*(q_network->q_i_layer.q_i_actv[j]*QMTIK_A_SCALE);
-        q_network->q_ih_layer.q_ih_actv[i]=QMTIK_infer_activation(acc);
+static QMTIK_QGemvKernel QMTIK_gemv_kernel=NULL;
+static const char* QMTIK_gemv_kernel_name="portable";
+#ifdef QMTIK_INT4_WGHT
+    static QMTIK_QGemvKernel QMTIK_gemv4_kernel=NULL;
+    //Expands a packed INT4 panel block into the INT8 panel layout, so a batch pays for the unpacking once
+    static inline void QMTIK_unpack_panel(const QMTIK_QWghtT* panel, size_t k, QMTIK_QWghtT* unpacked) {
+        for (size_t g=0; g<QMTIK_ROUND_UP(k, QMTIK_PANEL_KW)/QMTIK_PANEL_KW; ++g, panel+=QMTIK_PANEL_R*QMTIK_PANEL_K, unpacked+=2*QMTIK_PANEL_R*QMTIK_PANEL_K){
+            for (size_t t=0; t<QMTIK_PANEL_R*QMTIK_PANEL_K; ++t){
+                uint8_t v=(uint8_t)panel[t];
+                unpacked[t]=(QMTIK_QWghtT)(((v&0xF)^8)-8);
+                unpacked[t+QMTIK_PANEL_R*QMTIK_PANEL_K]=(QMTIK_QWghtT)(((v>>4)^8)-8);
+            }
+        }
     }
-    for (size_t i=0; i<QMTIK_H; ++i){
-        acc=q_network->q_hh_layers[0].q_hh_bias[i]*QMTIK_W_SCALE;
-        for (size_t j=0; j<QMTIK_H; ++j) acc+=(q_network->q_hh_layers[0].q_hh_wght[i][j]*QMTIK_W_SCALE)*(q_network->q_ih_layer.q_ih_actv[j]*QMTIK_A_SCALE);
-        q_network->q_hh_layers[0].q_hh_actv[i]=QMTIK_infer_activation(acc);
+#endif
+#ifdef QMTIK_PRUNE_PERCENT
+    //Sparse kernels walk the kept [QMTIK_SPARSE_ROWS][QMTIK_SPARSE_BLOCK] blocks of each row group, the partial last
+    //block column reads x through a zero padded copy
+    static inline size_t QMTIK_sparse_tail(const QMTIK_QActvT* x, size_t k, QMTIK_QActvT tail[QMTIK_SPARSE_BLOCK]) {
+        memset(tail, 0, QMTIK_SPARSE_BLOCK);
+        memcpy(tail, x+k/QMTIK_SPARSE_BLOCK*QMTIK_SPARSE_BLOCK, k%QMTIK_SPARSE_BLOCK);
+        return k/QMTIK_SPARSE_BLOCK;
     }
-    for (size_t l=1; l<QMTIK_L; ++l){
-        for (size_t i=0; i<QMTIK_H; ++i){
-            acc=q_network->q_hh_layers[l].q_hh_bias[i]*QMTIK_W_SCALE;
-            for (size_t j=0; j<QMTIK_H; ++j) acc+=(q_network->q_hh_layers[l].q_hh_wght[i][j]*QMTIK_W_SCALE)*(q_network->q_hh_layers[l-1].q_hh_actv[j]*QMTIK_A_SCALE);
-            q_network->q_hh_layers[l].q_hh_actv[i]=QMTIK_infer_activation(acc);
+    static void QMTIK_sparse_portable(const QMTIK_QWghtT* blocks, const uint16_t* cols, const uint32_t* group_end, const QMTIK_QAccT* wsum, size_t rows, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        QMTIK_QActvT tail[QMTIK_SPARSE_BLOCK];
+        size_t full=QMTIK_sparse_tail(x, k, tail), b=0;
+        (void)wsum;
+        for (size_t i=0; i<rows; i+=QMTIK_SPARSE_ROWS){
+            QMTIK_QAccT sum[QMTIK_SPARSE_ROWS]={0};
+            for (; b<group_end[i/QMTIK_SPARSE_ROWS]; ++b, blocks+=QMTIK_SPARSE_ROWS*QMTIK_SPARSE_BLOCK){
+                const QMTIK_QActvT* xb=(cols[b]<full)?x+cols[b]*QMTIK_SPARSE_BLOCK:tail;
+                for (size_t r=0; r<QMTIK_SPARSE_ROWS; ++r) for (size_t j=0; j<QMTIK_SPARSE_BLOCK; ++j) sum[r]+=(QMTIK_QAccT)blocks[r*QMTIK_SPARSE_BLOCK+j]*xb[j];
+            }
+            for (size_t r=0; r<QMTIK_SPARSE_ROWS&&i+r<rows; ++r) acc[i+r]+=sum[r];
         }
     }
-    for (size_t i=0; i<QMTIK_O; ++i){
-        acc=q_network->q_o_layer.q_o_bias[i]*QMTIK_W_SCALE;
-        for (size_t j=0; j<QMTIK_H; ++j) acc+=(q_network->q_o_layer.q_o_wght[i][j]*QMTIK_W_SCALE)*(q_network->q_hh_layers[QMTIK_L-1].q_hh_actv[j]*QMTIK_A_SCALE);
-        q_network->q_o_layer.q_o_z[i]=(QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(acc/QMTIK_A_SCALE)));
+    static QMTIK_QSparseKernel QMTIK_sparse_kernel=QMTIK_sparse_portable;
+#endif
+#ifdef QMTIK_SKIP_ZERO_ACTV
+    //Column kernels add x[nz[p]]*column nz[p] for the n gathered non-zero inputs to acc[stride]
+    static void QMTIK_column_portable(const QMTIK_QWghtT* cols, size_t stride, const uint16_t* nz, size_t n, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        for (size_t p=0; p<n; ++p){
+            const QMTIK_QWghtT* col=cols+nz[p]*stride;
+            QMTIK_QAccT x_j=x[nz[p]];
+            for (size_t i=0; i<stride; ++i) acc[i]+=col[i]*x_j;
+        }
     }
-    QMTIK_infer_post_process(q_network->q_o_layer.q_o_z);
-}
-//==================================================
-static inline void QMTIK_train_step(QMTIK_Network* network, QMTIK_SamplePair sample_pair) {
-    ++network->adam_state.t;
-    network->adam_state.b1t*=QMTIK_BETA1;
-    network->adam_state.b2t*=QMTIK_BETA2;
-    for (size_t i=0; i<QMTIK_I; ++i) network->i_layer.i_actv[i]=sample_pair.input[i];
-    QMTIK_train_forward(network);
-    for (size_t i=0; i<QMTIK_O; i++) network->adam_state.dO[i]=network->o_layer.o_z[i]-(QMTIK_MainT)sample_pair.output[i];
-    for (size_t i=0; i<QMTIK_H; ++i){
-        QMTIK_MainT sum=0;
-        for (size_t j=0; j<QMTIK_O; ++j) sum+=QMTIK_fake_quantize_w(network->o_layer.o_wght[j][i])*network->adam_state.dO[j];
-        network->adam_state.dHH[QMTIK_L-1][i]=sum*QMTIK_train_activation_deriv(network->hh_layers[QMTIK_L-1].hh_z[i]);
+    static QMTIK_QColumnKernel QMTIK_column_kernel=QMTIK_column_portable;
+    static QMTIK_MainT QMTIK_column_density=0;
+#endif
+#ifdef QMTIK_SIMD
+    static inline int32_t QMTIK_load_x4(const QMTIK_QActvT* x, size_t j, size_t k) {
+        QMTIK_QActvT tail[QMTIK_PANEL_K]={0};
+        int32_t x4;
+        if (j+QMTIK_PANEL_K<=k) {memcpy(&x4, x+j, sizeof(x4)); return x4;}
+        if (j>=k) return 0;
+        memcpy(tail, x+j, k-j);
+        memcpy(&x4, tail, sizeof(x4));
+        return x4;
     }
-    for (int l=QMTIK_L-2; l>=0; --l){
-        for (size_t i=0; i<QMTIK_H; ++i){
-            QMTIK_MainT sum=0;
-            for(size_t j=0; j<QMTIK_H; ++j) sum+=QMTIK_fake_quantize_w(network->hh_layers[l+1].hh_wght[j][i])*network->adam_state.dHH[l+1][j];
-            network->adam_state.dHH[l][i]=sum*QMTIK_train_activation_deriv(network->hh_layers[l].hh_z[i]);
+    __attribute__((target("sse4.1")))
+    static void QMTIK_gemv_sse41(const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        __m128i sum[8];
+        (void)wsum;
+        for (size_t c=0; c<8; ++c) sum[c]=_mm_setzero_si128();
+        for (size_t j=0; j<k; j+=QMTIK_PANEL_K, panel+=QMTIK_PANEL_R*QMTIK_PANEL_K){
+            __m128i x4=_mm_cvtepi8_epi16(_mm_cvtsi32_si128(QMTIK_load_x4(x, j, k)));
+            x4=_mm_unpacklo_epi64(x4, x4);
+            for (size_t c=0; c<8; ++c) sum[c]=_mm_add_epi32(sum[c], _mm_madd_epi16(_mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(panel+8*c))), x4));
+        }
+        for (size_t c=0; c<8; c+=2){
+            __m128i* out=(__m128i*)(acc+2*c);
+            _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), _mm_hadd_epi32(sum[c], sum[c+1])));
         }
     }
-    for (size_t i=0; i<QMTIK_H; ++i){
-        QMTIK_MainT sum=0;
-        for (size_t j=0; j<QMTIK_H; ++j) sum+=QMTIK_fake_quantize_w(network->hh_layers[0].hh_wght[j][i])*network->adam_state.dHH[0][j];
-        network->adam_state.dIH[i]=sum*QMTIK_train_activation_deriv(network->ih_layer.ih_z[i]);
+    __attribute__((target("avx2")))
+    static void QMTIK_gemv_avx2(const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        __m256i sum[4];
+        (void)wsum;
+        for (size_t c=0; c<4; ++c) sum[c]=_mm256_setzero_si256();
+        for (size_t j=0; j<k; j+=QMTIK_PANEL_K, panel+=QMTIK_PANEL_R*QMTIK_PANEL_K){
+            __m256i x4=_mm256_broadcastq_epi64(_mm_cvtepi8_epi16(_mm_cvtsi32_si128(QMTIK_load_x4(x, j, k))));
+            for (size_t c=0; c<4; ++c) sum[c]=_mm256_add_epi32(sum[c], _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(panel+16*c))), x4));
+        }
+        for (size_t c=0; c<4; c+=2){
+            __m256i* out=(__m256i*)(acc+4*c);
+            __m256i rows=_mm256_permute4x64_epi64(_mm256_hadd_epi32(sum[c], sum[c+1]), 0xD8);
+            _mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), rows));
+        }
     }
-    for (size_t i=0; i<QMTIK_H; ++i){
-        QMTIK_MainT dB=network->adam_state.dIH[i];
-        network->adam_state.m_ih_b[i]=QMTIK_BETA1*network->adam_state.m_ih_b[i]+(1-QMTIK_BETA1)*dB;
-        network->adam_state.v_ih_b[i]=QMTIK_BETA2*network->adam_state.v_ih_b[i]+(1-QMTIK_BETA2)*dB*dB;
-        network->ih_layer.ih_bias[i]-=QMTIK_ALPHA*(network->adam_state.m_ih_b[i]/(1-network->adam_state.b1t))/(sqrtf(network->adam_state.v_ih_b[i]/(1-network->adam_state.b2t))+QMTIK_EPS);
-        for (size_t j=0; j<QMTIK_I; ++j){
-            QMTIK_MainT dW=network->adam_state.dIH[i]*QMTIK_fake_quantize_a(network->i_layer.i_actv[j]);
-            network->adam_state.m_ih_w[i][j]=QMTIK_BETA1*network->adam_state.m_ih_w[i][j]+(1-QMTIK_BETA1)*dW;
-            network->adam_state.v_ih_w[i][j]=QMTIK_BETA2*network->adam_state.v_ih_w[i][j]+(1-QMTIK_BETA2)*dW*dW;
-            network->ih_layer.ih_wght[i][j]-=QMTIK_ALPHA*(network->adam_state.m_ih_w[i][j]/(1-network->adam_state.b1t))/(sqrtf(network->adam_state.v_ih_w[i][j]/(1-network->adam_state.b2t))+QMTIK_EPS);
+    __attribute__((target("avx512f,avx512vnni")))
+    static void QMTIK_gemv_avx512vnni(const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        //vpdpbusd takes unsigned activations: x+128, corrected with 128*sum(w) per row
+        const __m512i flip=_mm512_set1_epi32((int32_t)0x80808080);
+        __m512i sum0=_mm512_setzero_si512(), sum1=_mm512_setzero_si512();
+        size_t j=0;
+        for (; j+2*QMTIK_PANEL_K<=k; j+=2*QMTIK_PANEL_K, panel+=2*QMTIK_PANEL_R*QMTIK_PANEL_K){
+            sum0=_mm512_dpbusd_epi32(sum0, _mm512_xor_si512(_mm512_set1_epi32(QMTIK_load_x4(x, j, k)), flip), _mm512_loadu_si512(panel));
+            sum1=_mm512_dpbusd_epi32(sum1, _mm512_xor_si512(_mm512_set1_epi32(QMTIK_load_x4(x, j+QMTIK_PANEL_K, k)), flip), _mm512_loadu_si512(panel+QMTIK_PANEL_R*QMTIK_PANEL_K));
         }
+        for (; j<k; j+=QMTIK_PANEL_K, panel+=QMTIK_PANEL_R*QMTIK_PANEL_K)
+            sum0=_mm512_dpbusd_epi32(sum0, _mm512_xor_si512(_mm512_set1_epi32(QMTIK_load_x4(x, j, k)), flip), _mm512_loadu_si512(panel));
+        sum0=_mm512_sub_epi32(_mm512_add_epi32(sum0, sum1), _mm512_slli_epi32(_mm512_loadu_si512(wsum), 7));
+        _mm512_storeu_si512(acc, _mm512_add_epi32(_mm512_loadu_si512(acc), sum0));
     }
-    for (size_t l=0; l<QMTIK_L; ++l){
-        for (size_t i=0; i<QMTIK_H; ++i){
-            QMTIK_MainT dB=network->adam_state.dHH[l][i];
-            network->adam_state.m_hh_b[l][i]=QMTIK_BETA1*network->adam_state.m_hh_b[l][i]+ (1-QMTIK_BETA1)*dB;
-            network->adam_state.v_hh_b[l][i]=QMTIK_BETA2*network->adam_state.v_hh_b[l][i]+(1-QMTIK_BETA2)*dB*dB;
-            network->hh_layers[l].hh_bias[i]-=QMTIK_ALPHA*(network->adam_state.m_hh_b[l][i]/(1-network->adam_state.b1t))/(sqrtf(network->adam_state.v_hh_b[l][i]/(1-network->adam_state.b2t))+QMTIK_EPS);
-            for (size_t j=0; j<QMTIK_H; ++j){
-                QMTIK_MainT dW=network->adam_state.dHH[l][i]*((l==0)?QMTIK_fake_quantize_a(QMTIK_train_activation(network->ih_layer.ih_z[j])):QMTIK_fake_quantize_a(QMTIK_train_activation(network->hh_layers[l-1].hh_z[j])));
-                network->adam_state.m_hh_w[l][i][j]=QMTIK_BETA1*network->adam_state.m_hh_w[l][i][j]+(1-QMTIK_BETA1)*dW;
-                network->adam_state.v_hh_w[l][i][j]=QMTIK_BETA2*network->adam_state.v_hh_w[l][i][j]+(1-QMTIK_BETA2)*dW*dW;
-                network->hh_layers[l].hh_wght[i][j]-=QMTIK_ALPHA*(network->adam_state.m_hh_w[l][i][j]/(1-network->adam_state.b1t))/(sqrtf(network->adam_state.v_hh_w[l][i][j]/(1-network->adam_state.b2t))+QMTIK_EPS);
+    #ifdef QMTIK_INT4_WGHT
+    //INT4 kernels split each packed tile into the two INT8 tiles of the layout above, nibbles sign extended by (v^8)-8
+    __attribute__((target("sse4.1")))
+    static void QMTIK_gemv4_sse41(const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        const __m128i mask=_mm_set1_epi8(0x0F), eight=_mm_set1_epi8(8);
+        __m128i sum[8];
+        (void)wsum;
+        for (size_t c=0; c<8; ++c) sum[c]=_mm_setzero_si128();
+        for (size_t j=0; j<k; j+=QMTIK_PANEL_KW, panel+=QMTIK_PANEL_R*QMTIK_PANEL_K){
+            __m128i x_lo=_mm_cvtepi8_epi16(_mm_cvtsi32_si128(QMTIK_load_x4(x, j, k))), x_hi=_mm_cvtepi8_epi16(_mm_cvtsi32_si128(QMTIK_load_x4(x, j+QMTIK_PANEL_K, k)));
+            x_lo=_mm_unpacklo_epi64(x_lo, x_lo);
+            x_hi=_mm_unpacklo_epi64(x_hi, x_hi);
+            for (size_t c=0; c<8; c+=2){
+                __m128i p=_mm_loadu_si128((const __m128i*)(panel+8*c));
+                __m128i lo=_mm_sub_epi8(_mm_xor_si128(_mm_and_si128(p, mask), eight), eight);
+                __m128i hi=_mm_sub_epi8(_mm_xor_si128(_mm_and_si128(_mm_srli_epi16(p, 4), mask), eight), eight);
+                sum[c]=_mm_add_epi32(sum[c], _mm_add_epi32(_mm_madd_epi16(_mm_cvtepi8_epi16(lo), x_lo), _mm_madd_epi16(_mm_cvtepi8_epi16(hi), x_hi)));
+                sum[c+1]=_mm_add_epi32(sum[c+1], _mm_add_epi32(_mm_madd_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(lo, 8)), x_lo), _mm_madd_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(hi, 8)), x_hi)));
             }
         }
+        for (size_t c=0; c<8; c+=2){
+            __m128i* out=(__m128i*)(acc+2*c);
+            _mm_storeu_si128(out, _mm_add_epi32(_mm_loadu_si128(out), _mm_hadd_epi32(sum[c], sum[c+1])));
+        }
     }
-    for (size_t i=0; i<QMTIK_O; ++i){
-        QMTIK_MainT dB=network->adam_state.dO[i];
-        network->adam_state.m_o_b[i]=QMTIK_BETA1*network->adam_state.m_o_b[i]+(1-QMTIK_BETA1)*dB;
-        network->adam_state.v_o_b[i]=QMTIK_BETA2*network->adam_state.v_o_b[i]+(1-QMTIK_BETA2)*dB*dB;
-        network->o_layer.o_bias[i]-=QMTIK_ALPHA*(network->adam_state.m_o_b[i]/(1-network->adam_state.b1t))/(sqrtf(network->adam_state.v_o_b[i]/(1-network->adam_state.b2t))+QMTIK_EPS);
-        for (size_t j=0; j<QMTIK_H; ++j){
-            QMTIK_MainT dW=network->adam_state.dO[i]*QMTIK_fake_quantize_a(QMTIK_train_activation(network->hh_layers[QMTIK_L-1].hh_z[j]));
-            network->adam_state.m_o_w[i][j]=QMTIK_BETA1*network->adam_state.m_o_w[i][j]+(1-QMTIK_BETA1)*dW;
-            network->adam_state.v_o_w[i][j]=QMTIK_BETA2*network->adam_state.v_o_w[i][j]+(1-QMTIK_BETA2)*dW*dW;
-            network->o_layer.o_wght[i][j]-=QMTIK_ALPHA*(network->adam_state.m_o_w[i][j]/(1-network->adam_state.b1t))/(sqrtf(network->adam_state.v_o_w[i][j]/(1-network->adam_state.b2t))+QMTIK_EPS);
+    __attribute__((target("avx2")))
+    static void QMTIK_gemv4_avx2(const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        const __m256i mask=_mm256_set1_epi8(0x0F), eight=_mm256_set1_epi8(8);
+        __m256i sum[4];
+        (void)wsum;
+        for (size_t c=0; c<4; ++c) sum[c]=_mm256_setzero_si256();
+        for (size_t j=0; j<k; j+=QMTIK_PANEL_KW, panel+=QMTIK_PANEL_R*QMTIK_PANEL_K){
+            __m256i x_lo=_mm256_broadcastq_epi64(_mm_cvtepi8_epi16(_mm_cvtsi32_si128(QMTIK_load_x4(x, j, k))));
+            __m256i x_hi=_mm256_broadcastq_epi64(_mm_cvtepi8_epi16(_mm_cvtsi32_si128(QMTIK_load_x4(x, j+QMTIK_PANEL_K, k))));
+            for (size_t c=0; c<4; c+=2){
+                __m256i p=_mm256_loadu_si256((const __m256i*)(panel+16*c));
+                __m256i lo=_mm256_sub_epi8(_mm256_xor_si256(_mm256_and_si256(p, mask), eight), eight);
+                __m256i hi=_mm256_sub_epi8(_mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi16(p, 4), mask), eight), eight);
+                sum[c]=_mm256_add_epi32(sum[c], _mm256_add_epi32(_mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(lo)), x_lo), _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(hi)), x_hi)));
+                sum[c+1]=_mm256_add_epi32(sum[c+1], _mm256_add_epi32(_mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(lo, 1)), x_lo), _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(hi, 1)), x_hi)));
+            }
+        }
+        for (size_t c=0; c<4; c+=2){
+            __m256i* out=(__m256i*)(acc+4*c);
+            __m256i rows=_mm256_permute4x64_epi64(_mm256_hadd_epi32(sum[c], sum[c+1]), 0xD8);
+            _mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), rows));
         }
     }
-}
-void QMTIK_train(QMTIK_Network* network, FILE* train_file){
-    QMTIK_SamplePair sample;
-    int _sample_number=0;
-    #ifdef QMTIK_TRAIN_DEBUG
-        printf("[QMTIK] ====TRAINING BEGIN====\n");
+    __attribute__((target("avx512f,avx512bw,avx512vnni")))
+    static void QMTIK_gemv4_avx512vnni(const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        const __m512i flip=_mm512_set1_epi32((int32_t)0x80808080), mask=_mm512_set1_epi8(0x0F), eight=_mm512_set1_epi8(8);
+        __m512i sum0=_mm512_setzero_si512(), sum1=_mm512_setzero_si512();
+        for (size_t j=0; j<k; j+=QMTIK_PANEL_KW, panel+=QMTIK_PANEL_R*QMTIK_PANEL_K){
+            __m512i p=_mm512_loadu_si512(panel);
+            __m512i lo=_mm512_sub_epi8(_mm512_xor_si512(_mm512_and_si512(p, mask), eight), eight);
+            __m512i hi=_mm512_sub_epi8(_mm512_xor_si512(_mm512_and_si512(_mm512_srli_epi16(p, 4), mask), eight), eight);
+            sum0=_mm512_dpbusd_epi32(sum0, _mm512_xor_si512(_mm512_set1_epi32(QMTIK_load_x4(x, j, k)), flip), lo);
+            sum1=_mm512_dpbusd_epi32(sum1, _mm512_xor_si512(_mm512_set1_epi32(QMTIK_load_x4(x, j+QMTIK_PANEL_K, k)), flip), hi);
+        }
+        sum0=_mm512_sub_epi32(_mm512_add_epi32(sum0, sum1), _mm512_slli_epi32(_mm512_loadu_si512(wsum), 7));
+        _mm512_storeu_si512(acc, _mm512_add_epi32(_mm512_loadu_si512(acc), sum0));
+    }
     #endif
-    for (int _epoch=0; _epoch<QMTIK_EPOCHS; ++_epoch){
-        #ifdef QMTIK_TRAIN_DEBUG
-            if (_epoch%QMTIK_EPOCHS_DEBUG_UPDATE_POINT==0) printf("[QMTIK] EPOCH: %d\n", _epoch);
-        #endif
-        rewind(train_file);
-        _sample_number=0;
-        while (1){
-            if (!QMTIK_load_sample_pair(train_file, &sample)) break;
-            _sample_number++;
-            #ifdef QMTIK_TRAIN_DEBUG
-                if (_sample_number%QMTIK_SAMPLE_NUMBER_DEBUG_UPDATE_POINT==0) 
-                    printf("[QMTIK] SAMPLE_NUMBER: %d\n", _sample_number);
-            #endif
-            QMTIK_train_step(network, sample);
+    #ifdef QMTIK_PRUNE_PERCENT
+    __attribute__((target("sse4.1")))
+    static inline void QMTIK_sparse_store(QMTIK_QAccT* acc, size_t i, size_t rows, __m128i sum) {
+        QMTIK_QAccT out[QMTIK_SPARSE_ROWS];
+        if (i+QMTIK_SPARSE_ROWS<=rows) {_mm_storeu_si128((__m128i*)(acc+i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc+i)), sum)); return;}
+        _mm_storeu_si128((__m128i*)out, sum);
+        for (size_t r=0; i+r<rows; ++r) acc[i+r]+=out[r];
+    }
+    __attribute__((target("sse4.1")))
+    static void QMTIK_sparse_sse41(const QMTIK_QWghtT* blocks, const uint16_t* cols, const uint32_t* group_end, const QMTIK_QAccT* wsum, size_t rows, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        QMTIK_QActvT tail[QMTIK_SPARSE_BLOCK];
+        size_t full=QMTIK_sparse_tail(x, k, tail), b=0;
+        (void)wsum;
+        for (size_t i=0; i<rows; i+=QMTIK_SPARSE_ROWS){
+            __m128i sum[QMTIK_SPARSE_ROWS];
+            for (size_t r=0; r<QMTIK_SPARSE_ROWS; ++r) sum[r]=_mm_setzero_si128();
+            for (; b<group_end[i/QMTIK_SPARSE_ROWS]; ++b, blocks+=QMTIK_SPARSE_ROWS*QMTIK_SPARSE_BLOCK){
+                __m128i xb=_mm_loadu_si128((const __m128i*)((cols[b]<full)?x+cols[b]*QMTIK_SPARSE_BLOCK:tail));
+                __m128i x_lo=_mm_cvtepi8_epi16(xb), x_hi=_mm_cvtepi8_epi16(_mm_srli_si128(xb, 8));
+                for (size_t r=0; r<QMTIK_SPARSE_ROWS; ++r){
+                    __m128i w=_mm_loadu_si128((const __m128i*)(blocks+r*QMTIK_SPARSE_BLOCK));
+                    sum[r]=_mm_add_epi32(sum[r], _mm_add_epi32(_mm_madd_epi16(_mm_cvtepi8_epi16(w), x_lo), _mm_madd_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(w, 8)), x_hi)));
+                }
+            }
+            QMTIK_sparse_store(acc, i, rows, _mm_hadd_epi32(_mm_hadd_epi32(sum[0], sum[1]), _mm_hadd_epi32(sum[2], sum[3])));
         }
     }
-}
-//==================================================
-void QMTIK_quantize_to_model(QMTIK_Network* network, QMTIK_Model* model){
-    for (size_t i=0; i<QMTIK_H; ++i){
-        model->q_ih_bias[i]=QMTIK_quantize_w(network->ih_layer.ih_bias[i]);
-        for (size_t j=0; j<QMTIK_I; ++j) model->q_ih_wght[i][j]=QMTIK_quantize_w(network->ih_layer.ih_wght[i][j]);
+    __attribute__((target("avx2")))
+    static void QMTIK_sparse_avx2(const QMTIK_QWghtT* blocks, const uint16_t* cols, const uint32_t* group_end, const QMTIK_QAccT* wsum, size_t rows, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        QMTIK_QActvT tail[QMTIK_SPARSE_BLOCK];
+        size_t full=QMTIK_sparse_tail(x, k, tail), b=0;
+        (void)wsum;
+        for (size_t i=0; i<rows; i+=QMTIK_SPARSE_ROWS){
+            __m256i sum[QMTIK_SPARSE_ROWS];
+            for (size_t r=0; r<QMTIK_SPARSE_ROWS; ++r) sum[r]=_mm256_setzero_si256();
+            for (; b<group_end[i/QMTIK_SPARSE_ROWS]; ++b, blocks+=QMTIK_SPARSE_ROWS*QMTIK_SPARSE_BLOCK){
+                __m256i xb=_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)((cols[b]<full)?x+cols[b]*QMTIK_SPARSE_BLOCK:tail)));
+                for (size_t r=0; r<QMTIK_SPARSE_ROWS; ++r) sum[r]=_mm256_add_epi32(sum[r], _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(blocks+r*QMTIK_SPARSE_BLOCK))), xb));
+            }
+            __m256i rows4=_mm256_hadd_epi32(_mm256_hadd_epi32(sum[0], sum[1]), _mm256_hadd_epi32(sum[2], sum[3]));
+            QMTIK_sparse_store(acc, i, rows, _mm_add_epi32(_mm256_castsi256_si128(rows4), _mm256_extracti128_si256(rows4, 1)));
+        }
     }
-    for (size_t l=0; l<QMTIK_L; ++l){
-        for (size_t i=0; i<QMTIK_H; ++i){
-            model->q_hh_biases[l][i]=QMTIK_quantize_w(network->hh_layers[l].hh_bias[i]);
-            for (size_t j=0; j<QMTIK_H; ++j) model->q_hh_wghts[l][i][j]=QMTIK_quantize_w(network->hh_layers[l].hh_wght[i][j]);
+    __attribute__((target("avx512f,avx512vnni")))
+    static void QMTIK_sparse_avx512vnni(const QMTIK_QWghtT* blocks, const uint16_t* cols, const uint32_t* group_end, const QMTIK_QAccT* wsum, size_t rows, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        //one vpdpbusd per block: x broadcast to the four 128 bit lanes, lane r accumulates row r
+        const __m512i flip=_mm512_set1_epi32((int32_t)0x80808080), first=_mm512_setr_epi32(0, 4, 8, 12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        QMTIK_QActvT tail[QMTIK_SPARSE_BLOCK];
+        size_t full=QMTIK_sparse_tail(x, k, tail), b=0;
+        for (size_t i=0; i<rows; i+=QMTIK_SPARSE_ROWS){
+            __m512i sum=_mm512_setzero_si512();
+            for (; b<group_end[i/QMTIK_SPARSE_ROWS]; ++b, blocks+=QMTIK_SPARSE_ROWS*QMTIK_SPARSE_BLOCK){
+                __m512i xb=_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)((cols[b]<full)?x+cols[b]*QMTIK_SPARSE_BLOCK:tail)));
+                sum=_mm512_dpbusd_epi32(sum, _mm512_xor_si512(xb, flip), _mm512_loadu_si512(blocks));
+            }
+            sum=_mm512_add_epi32(sum, _mm512_shuffle_epi32(sum, (_MM_PERM_ENUM)0x4E));
+            sum=_mm512_add_epi32(sum, _mm512_shuffle_epi32(sum, (_MM_PERM_ENUM)0xB1));
+            __m128i rows4=_mm512_castsi512_si128(_mm512_permutexvar_epi32(first, sum));
+            QMTIK_sparse_store(acc, i, rows, _mm_sub_epi32(rows4, _mm_slli_epi32(_mm_loadu_si128((const __m128i*)(wsum+i)), 7)));
         }
     }
-    for (size_t i=0; i<QMTIK_O; ++i){
-        model->q_o_bias[i]=QMTIK_quantize_w(network->o_layer.o_bias[i]);
-        for (size_t j=0; j<QMTIK_H; ++j) model->q_o_wght[i][j]=QMTIK_quantize_w(network->o_layer.o_wght[i][j]);
+    #endif
+    #ifdef QMTIK_SKIP_ZERO_ACTV
+    //Non-zero inputs go in pairs: the two columns are interleaved byte-wise so one vpmaddwd adds both to 8 rows
+    static inline int32_t QMTIK_column_pair(const QMTIK_QActvT* x, const uint16_t* nz, size_t p, size_t n) {
+        uint16_t x0=(uint16_t)(int16_t)x[nz[p]], x1=(p+1<n)?(uint16_t)(int16_t)x[nz[p+1]]:0;
+        return (int32_t)((uint32_t)x0|((uint32_t)x1<<16));
     }
-}
-void QMTIK_store_model(QMTIK_Model* model, FILE* q_model_file){fwrite(model, sizeof(QMTIK_Model), 1, q_model_file);}
-uint8_t QMTIK_load_model(QMTIK_QNetwork* q_network, FILE* q_model_file) {
-    QMTIK_Model model;
-    if (!fread(&model, sizeof(QMTIK_Model), 1, q_model_file)){perror("[QMTIK] Failed to read model file"); return 1;}
-    for (size_t i=0; i<QMTIK_H; ++i){
-        q_network->q_ih_layer.q_ih_bias[i]=model.q_ih_bias[i];
-        for (size_t j=0; j<QMTIK_I; ++j) q_network->q_ih_layer.q_ih_wght[i][j]=model.q_ih_wght[i][j];
+    __attribute__((target("sse4.1"), always_inline))
+    static inline void QMTIK_column_rows_sse41(const QMTIK_QWghtT* cols, size_t stride, const uint16_t* nz, size_t n, const QMTIK_QActvT* x, QMTIK_QAccT* acc, const size_t blocks) {
+        __m128i sum[8];
+        for (size_t c=0; c<4*blocks; ++c) sum[c]=_mm_setzero_si128();
+        for (size_t p=0; p<n; p+=2){
+            const QMTIK_QWghtT* col0=cols+nz[p]*stride, *col1=(p+1<n)?cols+nz[p+1]*stride:col0;
+            __m128i x2=_mm_set1_epi32(QMTIK_column_pair(x, nz, p, n));
+            for (size_t b=0; b<blocks; ++b){
+                __m128i w0=_mm_loadu_si128((const __m128i*)(col0+16*b)), w1=_mm_loadu_si128((const __m128i*)(col1+16*b));
+                __m128i lo=_mm_unpacklo_epi8(w0, w1), hi=_mm_unpackhi_epi8(w0, w1);
+                sum[4*b]=_mm_add_epi32(sum[4*b], _mm_madd_epi16(_mm_cvtepi8_epi16(lo), x2));
+                sum[4*b+1]=_mm_add_epi32(sum[4*b+1], _mm_madd_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(lo, 8)), x2));
+                sum[4*b+2]=_mm_add_epi32(sum[4*b+2], _mm_madd_epi16(_mm_cvtepi8_epi16(hi), x2));
+                sum[4*b+3]=_mm_add_epi32(sum[4*b+3], _mm_madd_epi16(_mm_cvtepi8_epi16(_mm_srli_si128(hi, 8)), x2));
+            }
+        }
+        for (size_t c=0; c<4*blocks; ++c) _mm_storeu_si128((__m128i*)(acc+4*c), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc+4*c)), sum[c]));
     }
-    for (size_t l=0; l<QMTIK_L; ++l){
-        for (size_t i=0; i<QMTIK_H; ++i){
-            q_network->q_hh_layers[l].q_hh_bias[i]=model.q_hh_biases[l][i];
-            for (size_t j=0; j<QMTIK_H; ++j) q_network->q_hh_layers[l].q_hh_wght[i][j]=model.q_hh_wghts[l][i][j];
+    __attribute__((target("sse4.1")))
+    static void QMTIK_column_sse41(const QMTIK_QWghtT* cols, size_t stride, const uint16_t* nz, size_t n, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        size_t i=0;
+        for (; i+32<=stride; i+=32) QMTIK_column_rows_sse41(cols+i, stride, nz, n, x, acc+i, 2);
+        if (i<stride) QMTIK_column_rows_sse41(cols+i, stride, nz, n, x, acc+i, 1);
+    }
+    __attribute__((target("avx2"), always_inline))
+    static inline void QMTIK_column_rows_avx2(const QMTIK_QWghtT* cols, size_t stride, const uint16_t* nz, size_t n, const QMTIK_QActvT* x, QMTIK_QAccT* acc, const size_t blocks) {
+        __m256i sum[8];
+        for (size_t c=0; c<2*blocks; ++c) sum[c]=_mm256_setzero_si256();
+        for (size_t p=0; p<n; p+=2){
+            const QMTIK_QWghtT* col0=cols+nz[p]*stride, *col1=(p+1<n)?cols+nz[p+1]*stride:col0;
+            __m256i x2=_mm256_set1_epi32(QMTIK_column_pair(x, nz, p, n));
+            for (size_t b=0; b<blocks; ++b){
+                __m128i w0=_mm_loadu_si128((const __m128i*)(col0+16*b)), w1=_mm_loadu_si128((const __m128i*)(col1+16*b));
+                sum[2*b]=_mm256_add_epi32(sum[2*b], _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_unpacklo_epi8(w0, w1)), x2));
+                sum[2*b+1]=_mm256_add_epi32(sum[2*b+1], _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_unpackhi_epi8(w0, w1)), x2));
+            }
         }
+        for (size_t c=0; c<2*blocks; ++c) _mm256_storeu_si256((__m256i*)(acc+8*c), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(acc+8*c)), sum[c]));
     }
-    for(size_t i=0; i<QMTIK_O; ++i){
-        q_network->q_o_layer.q_o_bias[i]=model.q_o_bias[i];
-        for(size_t j=0; j<QMTIK_H; ++j) q_network->q_o_layer.q_o_wght[i][j]=model.q_o_wght[i][j];
+    __attribute__((target("avx2")))
+    static void QMTIK_column_avx2(const QMTIK_QWghtT* cols, size_t stride, const uint16_t* nz, size_t n, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+        size_t i=0;
+        for (; i+64<=stride; i+=64) QMTIK_column_rows_avx2(cols+i, stride, nz, n, x, acc+i, 4);
+        for (; i<stride; i+=16) QMTIK_column_rows_avx2(cols+i, stride, nz, n, x, acc+i, 1);
+    }
+    #endif
+#endif
+static void QMTIK_adam_portable(QMTIK_MainT* w, QMTIK_MainT* fq_w, QMTIK_MainT* m, QMTIK_MainT* v, QMTIK_MainT* g, size_t n, const QMTIK_AdamStep* step) {
+    for (size_t i=0; i<n; ++i){
+        QMTIK_MainT dW=g[i]*step->scale;
+        m[i]=QMTIK_BETA1*m[i]+(1-QMTIK_BETA1)*dW;
+        v[i]=QMTIK_BETA2*v[i]+(1-QMTIK_BETA2)*dW*dW;
+        w[i]-=step->lr*m[i]/(sqrtf(v[i])+step->eps);
+        fq_w[i]=QMTIK_fake_quantize_w(w[i]);
+        g[i]=0;
     }
-    return 0;
 }
-//==================================================
-void QMTIK_init_weights(QMTIK_Network* network){
-    srand(time(NULL));
-    for (size_t i=0; i<QMTIK_H; ++i){
-        network->ih_layer.ih_bias[i]=0.0f;
-        for (size_t j=0; j<QMTIK_I; ++j) network->ih_layer.ih_wght[i][j]=sqrtf(2.0f/(QMTIK_I+QMTIK_H))*((QMTIK_MainT)rand()/RAND_MAX-0.5f)*2.0f;
+static QMTIK_AdamKernel QMTIK_adam_kernel=QMTIK_adam_portable;
+#ifdef QMTIK_SIMD
+    //fake quantization has to match roundf() (ties away from zero), the SIMD round instructions only tie to even
+    __attribute__((target("sse4.1")))
+    static void QMTIK_adam_sse41(QMTIK_MainT* w, QMTIK_MainT* fq_w, QMTIK_MainT* m, QMTIK_MainT* v, QMTIK_MainT* g, size_t n, const QMTIK_AdamStep* step) {
+        const __m128 b1=_mm_set1_ps(QMTIK_BETA1), b1c=_mm_set1_ps(1-QMTIK_BETA1), b2=_mm_set1_ps(QMTIK_BETA2), b2c=_mm_set1_ps(1-QMTIK_BETA2);
+        const __m128 scale=_mm_set1_ps(step->scale), lr=_mm_set1_ps(step->lr), eps=_mm_set1_ps(step->eps), w_scale=_mm_set1_ps(QMTIK_W_SCALE);
+        const __m128 half=_mm_set1_ps(0.5f), one=_mm_set1_ps(1.0f), sign=_mm_set1_ps(-0.0f), q_min=_mm_set1_ps(QMTIK_QWghtT_MIN), q_max=_mm_set1_ps(QMTIK_QWghtT_MAX);
+        size_t i=0;
+        for (; i+4<=n; i+=4){
+            __m128 dW=_mm_mul_ps(_mm_loadu_ps(g+i), scale);
+            __m128 m4=_mm_add_ps(_mm_mul_ps(b1, _mm_loadu_ps(m+i)), _mm_mul_ps(b1c, dW));
+            __m128 v4=_mm_add_ps(_mm_mul_ps(b2, _mm_loadu_ps(v+i)), _mm_mul_ps(_mm_mul_ps(b2c, dW), dW));
+            __m128 w4=_mm_sub_ps(_mm_loadu_ps(w+i), _mm_div_ps(_mm_mul_ps(lr, m4), _mm_add_ps(_mm_sqrt_ps(v4), eps)));
+            __m128 y=_mm_div_ps(w4, w_scale), t=_mm_round_ps(y, _MM_FROUND_TO_ZERO|_MM_FROUND_NO_EXC);
+            t=_mm_add_ps(t, _mm_and_ps(_mm_cmpge_ps(_mm_andnot_ps(sign, _mm_sub_ps(y, t)), half), _mm_or_ps(one, _mm_and_ps(sign, y))));
+            _mm_storeu_ps(m+i, m4);
+            _mm_storeu_ps(v+i, v4);
+            _mm_storeu_ps(w+i, w4);
+            _mm_storeu_ps(fq_w+i, _mm_mul_ps(_mm_max_ps(q_min, _mm_min_ps(q_max, t)), w_scale));
+            _mm_storeu_ps(g+i, _mm_setzero_ps());
+        }
+        QMTIK_adam_portable(w+i, fq_w+i, m+i, v+i, g+i, n-i, step);
     }
-    for (size_t l=0; l<QMTIK_L; ++l){
-        for (size_t i=0; i<QMTIK_H; ++i) {
-            network->hh_layers[l].hh_bias[i]=0.0f;
-            for (size_t j=0; j<QMTIK_H; ++j) network->hh_layers[l].hh_wght[i][j]=sqrtf(2.0f/(QMTIK_H+QMTIK_H))*((QMTIK_MainT)rand()/RAND_MAX-0.5f)*2.0f;
+    __attribute__((target("avx2")))
+    static void QMTIK_adam_avx2(QMTIK_MainT* w, QMTIK_MainT* fq_w, QMTIK_MainT* m, QMTIK_MainT* v, QMTIK_MainT* g, size_t n, const QMTIK_AdamStep* step) {
+        const __m256 b1=_mm256_set1_ps(QMTIK_BETA1), b1c=_mm256_set1_ps(1-QMTIK_BETA1), b2=_mm256_set1_ps(QMTIK_BETA2), b2c=_mm256_set1_ps(1-QMTIK_BETA2);
+        const __m256 scale=_mm256_set1_ps(step->scale), lr=_mm256_set1_ps(step->lr), eps=_mm256_set1_ps(step->eps), w_scale=_mm256_set1_ps(QMTIK_W_SCALE);
+        const __m256 half=_mm256_set1_ps(0.5f), one=_mm256_set1_ps(1.0f), sign=_mm256_set1_ps(-0.0f), q_min=_mm256_set1_ps(QMTIK_QWghtT_MIN), q_max=_mm256_set1_ps(QMTIK_QWghtT_MAX);
+        size_t i=0;
+        for (; i+8<=n; i+=8){
+            __m256 dW=_mm256_mul_ps(_mm256_loadu_ps(g+i), scale);
+            __m256 m8=_mm256_add_ps(_mm256_mul_ps(b1, _mm256_loadu_ps(m+i)), _mm256_mul_ps(b1c, dW));
+            __m256 v8=_mm256_add_ps(_mm256_mul_ps(b2, _mm256_loadu_ps(v+i)), _mm256_mul_ps(_mm256_mul_ps(b2c, dW), dW));
+            __m256 w8=_mm256_sub_ps(_mm256_loadu_ps(w+i), _mm256_div_ps(_mm256_mul_ps(lr, m8), _mm256_add_ps(_mm256_sqrt_ps(v8), eps)));
+            __m256 y=_mm256_div_ps(w8, w_scale), t=_mm256_round_ps(y, _MM_FROUND_TO_ZERO|_MM_FROUND_NO_EXC);
+            t=_mm256_add_ps(t, _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(y, t)), half, _CMP_GE_OQ), _mm256_or_ps(one, _mm256_and_ps(sign, y))));
+            _mm256_storeu_ps(m+i, m8);
+            _mm256_storeu_ps(v+i, v8);
+            _mm256_storeu_ps(w+i, w8);
+            _mm256_storeu_ps(fq_w+i, _mm256_mul_ps(_mm256_max_ps(q_min, _mm256_min_ps(q_max, t)), w_scale));
+            _mm256_storeu_ps(g+i, _mm256_setzero_ps());
         }
+        QMTIK_adam_portable(w+i, fq_w+i, m+i, v+i, g+i, n-i, step);
     }
-    for (size_t i=0; i<QMTIK_O; ++i){
-        network->o_layer.o_bias[i]=0.0f;
-        for (size_t j=0; j<QMTIK_H; ++j) network->o_layer.o_wght[i][j]=sqrtf(2.0f/(QMTIK_H+QMTIK_O))*((QMTIK_MainT)rand()/RAND_MAX-0.5f)*2.0f;
+#endif
+//Kernels are only ever assigned here, before any inference can read them, so a thread past the QMTIK_gemv_kernel
+//check never finds a pointer that a later model load has reset
+static inline void QMTIK_select_kernel_once(void) {
+    QMTIK_gemv_kernel=NULL;
+    QMTIK_gemv_kernel_name="portable";
+    #ifdef QMTIK_INT4_WGHT
+        QMTIK_gemv4_kernel=NULL;
+    #endif
+    QMTIK_adam_kernel=QMTIK_adam_portable;
+    #ifdef QMTIK_PRUNE_PERCENT
+        QMTIK_sparse_kernel=QMTIK_sparse_portable;
+    #endif
+    QMTIK_SET_COLUMN(portable, 0.75f)
+    #ifdef QMTIK_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1")) {QMTIK_gemv_kernel=QMTIK_gemv_sse41; QMTIK_SET_GEMV4(sse41) QMTIK_SET_SPARSE(sse41) QMTIK_SET_COLUMN(sse41, 0.5f) QMTIK_gemv_kernel_name=QMTIK_GEMV_NAME("sse4.1"); QMTIK_adam_kernel=QMTIK_adam_sse41;}
+        if (__builtin_cpu_supports("avx2")) {QMTIK_gemv_kernel=QMTIK_gemv_avx2; QMTIK_SET_GEMV4(avx2) QMTIK_SET_SPARSE(avx2) QMTIK_SET_COLUMN(avx2, 0.5f) QMTIK_gemv_kernel_name=QMTIK_GEMV_NAME("avx2"); QMTIK_adam_kernel=QMTIK_adam_avx2;}
+        if (__builtin_cpu_supports("avx512f")&&__builtin_cpu_supports("avx512bw")&&__builtin_cpu_supports("avx512vnni")) {QMTIK_gemv_kernel=QMTIK_gemv_avx512vnni; QMTIK_SET_GEMV4(avx512vnni) QMTIK_SET_SPARSE(avx512vnni) QMTIK_SET_COLUMN(avx2, 0.2f) QMTIK_gemv_kernel_name=QMTIK_GEMV_NAME("avx512vnni");}
+    #endif
+}
+static inline void QMTIK_select_kernel(void) {
+    static int selected=0;
+    QMTIK_run_once(&selected, QMTIK_select_kernel_once);
+    QMTIK_build_luts();
+}
+//acc[n][QMTIK_QACC_STRIDE]=acc_bias+wght*x[n][k], one weight tile (panel block or row) reused across all n samples
+//With row_rq (INT4) each row is summed in its own scale and rescaled to QMTIK_QACC_SCALE before the bias is added
+static inline void QMTIK_infer_gemm(const QMTIK_QWghtT* wght, const QMTIK_QWghtT* panel, const QMTIK_QAccT* wsum, const QMTIK_QAccT* acc_bias, const QMTIK_QRequant* row_rq, size_t rows, size_t k, const QMTIK_QActvT* x, size_t n, QMTIK_QAccT* acc) {
+    if (panel&&QMTIK_gemv_kernel){
+        for (size_t s=0; s<n; ++s) for (size_t i=0; i<QMTIK_ROUND_UP(rows, QMTIK_PANEL_R); ++i) acc[s*QMTIK_QACC_STRIDE+i]=(i<rows&&!row_rq)?acc_bias[i]:0;
+        for (size_t b=0; b<rows; b+=QMTIK_PANEL_R){
+            const QMTIK_QWghtT* tile=panel+b*QMTIK_PANEL_ROW(k);
+            #ifdef QMTIK_INT4_WGHT
+                QMTIK_ALIGN QMTIK_QWghtT unpacked[QMTIK_PANEL_R*QMTIK_ROUND_UP(QMTIK_I>QMTIK_H?QMTIK_I:QMTIK_H, QMTIK_PANEL_KW)];
+                if (n==1) {QMTIK_gemv4_kernel(tile, wsum+b, k, x, acc+b); continue;}
+                QMTIK_unpack_panel(tile, k, unpacked);
+                tile=unpacked;
+            #endif
+            for (size_t s=0; s<n; ++s) QMTIK_gemv_kernel(tile, wsum+b, k, x+s*k, acc+s*QMTIK_QACC_STRIDE+b);
+        }
+        if (row_rq) for (size_t s=0; s<n; ++s) for (size_t i=0; i<rows; ++i) acc[s*QMTIK_QACC_STRIDE+i]=acc_bias[i]+QMTIK_requantize(acc[s*QMTIK_QACC_STRIDE+i], row_rq[i]);
+        return;
+    }
+    for (size_t i=0; i<rows; ++i){
+        //rows are QMTIK_WGHT_ROW(k) apart and unpacked in place, gcc 12 reuses the stack slot of a local unpack buffer while it is still read
+        const QMTIK_QWghtT* w=wght+i*QMTIK_WGHT_ROW(k);
+        QMTIK_QAccT bias=row_rq?0:acc_bias[i];
+        size_t s=0;
+        for (; s+4<=n; s+=4){
+            QMTIK_QAccT sum0=bias, sum1=bias, sum2=bias, sum3=bias;
+            for (size_t j=0; j<k; ++j){
+                QMTIK_QAccT w_j=QMTIK_get_w(w, j);
+                sum0+=w_j*x[s*k+j]; sum1+=w_j*x[(s+1)*k+j]; sum2+=w_j*x[(s+2)*k+j]; sum3+=w_j*x[(s+3)*k+j];
+            }
+            acc[s*QMTIK_QACC_STRIDE+i]=sum0; acc[(s+1)*QMTIK_QACC_STRIDE+i]=sum1; acc[(s+2)*QMTIK_QACC_STRIDE+i]=sum2; acc[(s+3)*QMTIK_QACC_STRIDE+i]=sum3;
+        }
+        for (; s<n; ++s){
+            QMTIK_QAccT sum=bias;
+            for (size_t j=0; j<k; ++j) sum+=(QMTIK_QAccT)QMTIK_get_w(w, j)*x[s*k+j];
+            acc[s*QMTIK_QACC_STRIDE+i]=sum;
+        }
+        if (row_rq) for (s=0; s<n; ++s) acc[s*QMTIK_QACC_STRIDE+i]=acc_bias[i]+QMTIK_requantize(acc[s*QMTIK_QACC_STRIDE+i], row_rq[i]);
     }
-    memset(&network->adam_state, 0, sizeof(QMTIK_AdamState));
-    network->adam_state.b1t = 1.0f;
-    network->adam_state.b2t = 1.0f;
 }
+//A pruned input layer only multiplies its kept blocks, the dense one goes through QMTIK_infer_gemm
+static inline void QMTIK_infer_ih(const QMTIK_QModel* q_model, const QMTIK_QActvT* x, size_t n, QMTIK_QAccT* acc) {
+    const QMTIK_QIHLayer* layer=&q_model->q_ih_layer;
+    #ifdef QMTIK_PRUNE_PERCENT
+        for (size_t s=0; s<n; ++s){
+            memcpy(acc+s*QMTIK_QACC_STRIDE, layer->q_ih_acc_bias, sizeof(layer->q_ih_acc_bias));
+            QMTIK_sparse_kernel(layer->q_ih_blocks[0], layer->q_ih_block_col, layer->q_ih_group_end, layer->q_ih_wsum, QMTIK_H, QMTIK_I, x+s*QMTIK_I, acc+s*QMTIK_QACC_STRIDE);
+        }
+    #else
+        QMTIK_infer_gemm(&layer->q_ih_wght[0][0], QMTIK_QPANEL_ARGS(q_model, q_ih, ), layer->q_ih_acc_bias, QMTIK_QROW_RQ(layer->q_ih_row_rq), QMTIK_H, QMTIK_I, x, n, acc);
+    #endif
+}
+static inline void QMTIK_gather_column(const QMTIK_QWghtT* wght, size_t rows, size_t k, size_t j, QMTIK_QWghtT* col) {for (size_t i=0; i<QMTIK_COL_STRIDE(rows); ++i) col[i]=(i<rows)?wght[i*k+j]:0;}
+#ifdef QMTIK_SKIP_ZERO_ACTV
+//Gathers the non-zero inputs once, and when they are rarer than QMTIK_column_density only their weight columns are summed
+//Returns 0 without touching acc otherwise, so the caller falls back to the dense layer
+static inline uint8_t QMTIK_infer_columns(const QMTIK_QWghtT* cols, const QMTIK_QAccT* acc_bias, size_t rows, size_t k, const QMTIK_QActvT* x, QMTIK_QAccT* acc) {
+    uint16_t nz[QMTIK_H];
+    size_t n=0;
+    for (size_t j=0; j<k; ++j) {nz[n]=(uint16_t)j; n+=(x[j]!=0);}
+    if ((QMTIK_MainT)n>=QMTIK_column_density*(QMTIK_MainT)k) return 0;
+    for (size_t i=0; i<QMTIK_COL_STRIDE(rows); ++i) acc[i]=(i<rows)?acc_bias[i]:0;
+    QMTIK_column_kernel(cols, QMTIK_COL_STRIDE(rows), nz, n, x, acc);
+    return 1;
+}
+#endif
 //==================================================
-void QMTIK_load_network_input(QMTIK_QNetwork* q_network, QMTIK_QActvT input[QMTIK_I]) {for(size_t i=0; i<QMTIK_I; ++i) q_network->q_i_layer.q_i_actv[i]=input[i];}
-void QMTIK_get_network_output(QMTIK_QNetwork* q_network, QMTIK_QActvT output[QMTIK_O]) {for(size_t i=0; i<QMTIK_O; ++i) output[i]=q_network->q_o_layer.q_o_z[i];}
-//==================================================
-QMTIK_MainT QMTIK_test_before_quant(QMTIK_Network* network, FILE* test_file){
-    QMTIK_SamplePair pair;
-    uint64_t total_cost=0;
-    int _sample_number=0;
-    rewind(test_file);
-    #ifdef QMTIK_TEST_BEFORE_QUANT_DEBUG
-        printf("[QMTIK] ====TEST BEFORE QUANT====\n");
+static inline void QMTIK_refresh_wght_shadow(QMTIK_Network* network) {
+    const QMTIK_MainT* w=QMTIK_PARAMS(&network->ih_layer);
+    QMTIK_MainT* fq_w=QMTIK_PARAMS(&network->wght_shadow);
+    for (size_t i=0; i<QMTIK_N_PARAMS; ++i) fq_w[i]=QMTIK_fake_quantize_w(w[i]);
+    QMTIK_refresh_row_shadow(network);
+}
+//The fused Adam kernels fake quantize with QMTIK_W_SCALE, INT4 weight rows are redone here once the whole row has moved
+static inline void QMTIK_refresh_row_shadow(QMTIK_Network* network) {
+    #ifdef QMTIK_INT4_WGHT
+        QMTIK_Params* shadow=&network->wght_shadow;
+        for (size_t i=0; i<QMTIK_H; ++i) QMTIK_fake_quantize_row(network->ih_layer.ih_wght[i], QMTIK_I, shadow->ih_layer.ih_wght[i]);
+        for (size_t l=0; l<QMTIK_L; ++l) for (size_t i=0; i<QMTIK_H; ++i) QMTIK_fake_quantize_row(network->hh_layers[l].hh_wght[i], QMTIK_H, shadow->hh_layers[l].hh_wght[i]);
+        for (size_t i=0; i<QMTIK_O; ++i) QMTIK_fake_quantize_row(network->o_layer.o_wght[i], QMTIK_H, shadow->o_layer.o_wght[i]);
+    #else
+        (void)network;
     #endif
-    while (1){
+}
+static inline void QMTIK_record_tape(const QMTIK_MainT* z, QMTIK_MainT* tape, size_t n) {for (size_t i=0; i<n; ++i) tape[i]=QMTIK_fake_quantize_a(QMTIK_train_activation(z[i]));}
+static inline void QMTIK_train_forward(const QMTIK_Network* network, QMTIK_TrainContext* context) {
+    const QMTIK_Params* shadow=&network->wght_shadow;
+    QMTIK_MainT acc;
+    QMTIK_PROFILE_BEGIN(ih_start)
+    for(size_t j=0; j<QMTIK_I; ++j) context->i_tape[j]=QMTIK_fake_quantize_a(context->i_actv[j]);
+    for(size_t i=0; i<QMTIK_H; i++){
+        acc=network->ih_layer.ih_bias[i];
+        #ifdef QMTIK_PRUNE_PERCENT
+        for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) if (!network->ih_pruned[i/QMTIK_SPARSE_ROWS][c])
+            for (size_t j=c*QMTIK_SPARSE_BLOCK; j<QMTIK_I&&j<(c+1)*QMTIK_SPARSE_BLOCK; ++j) acc+=shadow->ih_layer.ih_wght[i][j]*context->i_tape[j];
+        #else
+        for(size_t j=0; j<QMTIK_I; ++j) acc+=shadow->ih_layer.ih_wght[i][j]*context->i_tape[j];
+        #endif
+        context->ih_z[i]=acc;
+    }
+    QMTIK_record_tape(context->ih_z, context->ih_tape, QMTIK_H);
+    QMTIK_PROFILE_END(QMTIK_PROF_TRAIN, 0, ih_start, QMTIK_H, QMTIK_count_clamped_f(context->ih_z, QMTIK_H, QMTIK_A_SCALE, 1))
+    for(size_t l=0; l<QMTIK_L; ++l){
+        QMTIK_PROFILE_BEGIN(hh_start)
+        const QMTIK_MainT* x=(l==0)?context->ih_tape:context->hh_tape[l-1];
+        for(size_t i=0; i<QMTIK_H; ++i){
+            acc=network->hh_layers[l].hh_bias[i];
+            for(size_t j=0; j<QMTIK_H; j++) acc+=shadow->hh_layers[l].hh_wght[i][j]*x[j];
+            context->hh_z[l][i]=acc;
+        }
+        QMTIK_record_tape(context->hh_z[l], context->hh_tape[l], QMTIK_H);
+        QMTIK_PROFILE_END(QMTIK_PROF_TRAIN, l+1, hh_start, QMTIK_H, QMTIK_count_clamped_f(context->hh_z[l], QMTIK_H, QMTIK_A_SCALE, 1))
+    }
+    QMTIK_PROFILE_BEGIN(o_start)
+    for(size_t i=0; i<QMTIK_O; ++i){
+        acc=network->o_layer.o_bias[i];
+        for(size_t j=0; j<QMTIK_H; ++j) acc+=shadow->o_layer.o_wght[i][j]*context->hh_tape[QMTIK_L-1][j];
+        context->o_z[i]=acc;
+    }
+    QMTIK_train_post_process(context->o_z);
+    QMTIK_PROFILE_END(QMTIK_PROF_TRAIN, QMTIK_L+1, o_start, 0, 0)
+}
+void QMTIK_infer_forward(QMTIK_QNetwork* q_network) {QMTIK_infer(&q_network->q_model, &q_network->q_context);}
+void QMTIK_infer(const QMTIK_QModel* q_model, QMTIK_QContext* q_context) {
+    QMTIK_infer_logits(q_model, q_context);
+    QMTIK_infer_post_process(q_context->q_o_z);
+}
+#ifdef QMTIK_CROSS_ENTROPY_COST
+//Post processing keeps the order of the outputs, so a classifier only needs the argmax of the logits
+size_t QMTIK_infer_class(const QMTIK_QModel* q_model, QMTIK_QContext* q_context) {
+    size_t pred_class=0;
+    QMTIK_infer_logits(q_model, q_context);
+    for (size_t i=1; i<QMTIK_O; ++i) if (q_context->q_o_z[i]>q_context->q_o_z[pred_class]) pred_class=i;
+    return pred_class;
+}
+#endif
+//==================================================
+static inline uint32_t QMTIK_ft_random(uint32_t* state) {uint32_t x=*state; x^=x<<13; x^=x>>17; x^=x<<5; return *state=x;}
+//Moves a Q8 master by g/2^shift codes, the bits below the master rounded stochastically so small steps still add up
+static inline int16_t QMTIK_ft_update(int16_t master, int64_t g, uint8_t shift, uint32_t* rng) {
+    int32_t s=(int32_t)shift-QMTIK_FT_FRAC;
+    int64_t w=master-((s<=0)?g*((int64_t)1<<-s):(g+(int64_t)(QMTIK_ft_random(rng)&(((uint32_t)1<<s)-1)))>>s);
+    return (int16_t)((w<INT16_MIN)?INT16_MIN:(w>INT16_MAX)?INT16_MAX:w);
+}
+static inline QMTIK_QWghtT QMTIK_ft_code(int16_t master, int32_t low, int32_t high) {
+    int32_t code=(master+(1<<(QMTIK_FT_FRAC-1)))>>QMTIK_FT_FRAC;
+    return (QMTIK_QWghtT)((code<low)?low:(code>high)?high:code);
+}
+//Writes the rounded masters back and redoes the bias fold, weight columns and panels of the tuned layers
+static inline void QMTIK_finetune_commit(const QMTIK_FineTune* fine_tune, QMTIK_QModel* q_model) {
+    QMTIK_QOLayer* o_layer=&q_model->q_o_layer;
+    for (size_t i=0; i<QMTIK_O; ++i){
+        o_layer->q_o_bias[i]=QMTIK_ft_code(fine_tune->o_bias[i], QMTIK_QWghtT_MIN, QMTIK_QWghtT_MAX);
+        for (size_t j=0; j<QMTIK_H; ++j) QMTIK_set_w(o_layer->q_o_wght[i], j, QMTIK_ft_code(fine_tune->o_wght[i][j], QMTIK_FT_W_MIN, QMTIK_FT_W_MAX));
+    }
+    QMTIK_fold_bias(o_layer->q_o_bias, QMTIK_O, o_layer->q_o_acc_bias);
+    #ifdef QMTIK_SKIP_ZERO_ACTV
+        for (size_t j=0; j<QMTIK_H; ++j) QMTIK_gather_column(&o_layer->q_o_wght[0][0], QMTIK_O, QMTIK_H, j, q_model->q_columns.q_o_cols[j]);
+    #endif
+    #ifdef QMTIK_SIMD
+        QMTIK_repack_panel(&o_layer->q_o_wght[0][0], QMTIK_O, QMTIK_H, q_model->q_panels.q_o_panel, q_model->q_panels.q_o_wsum);
+    #endif
+    #ifdef QMTIK_FINETUNE_HH
+        QMTIK_QHHLayer* hh_layer=&q_model->q_hh_layers[QMTIK_L-1];
+        for (size_t i=0; i<QMTIK_H; ++i){
+            hh_layer->q_hh_bias[i]=QMTIK_ft_code(fine_tune->hh_bias[i], QMTIK_QWghtT_MIN, QMTIK_QWghtT_MAX);
+            for (size_t j=0; j<QMTIK_H; ++j) QMTIK_set_w(hh_layer->q_hh_wght[i], j, QMTIK_ft_code(fine_tune->hh_wght[i][j], QMTIK_FT_W_MIN, QMTIK_FT_W_MAX));
+        }
+        QMTIK_fold_bias(hh_layer->q_hh_bias, QMTIK_H, hh_layer->q_hh_acc_bias);
+        #ifdef QMTIK_SKIP_ZERO_ACTV
+            for (size_t j=0; j<QMTIK_H; ++j) QMTIK_gather_column(&hh_layer->q_hh_wght[0][0], QMTIK_H, QMTIK_H, j, q_model->q_columns.q_hh_cols[QMTIK_L-1][j]);
+        #endif
+        #ifdef QMTIK_SIMD
+            QMTIK_repack_panel(&hh_layer->q_hh_wght[0][0], QMTIK_H, QMTIK_H, q_model->q_panels.q_hh_panel[QMTIK_L-1], q_model->q_panels.q_hh_wsum[QMTIK_L-1]);
+        #endif
+    #endif
+}
+void QMTIK_finetune_begin(QMTIK_FineTune* fine_tune, const QMTIK_QModel* q_model, uint8_t shift, uint32_t seed) {
+    const QMTIK_QOLayer* o_layer=&q_model->q_o_layer;
+    for (size_t i=0; i<QMTIK_O; ++i){
+        fine_tune->o_bias[i]=(int16_t)(o_layer->q_o_bias[i]*(1<<QMTIK_FT_FRAC));
+        for (size_t j=0; j<QMTIK_H; ++j) fine_tune->o_wght[i][j]=(int16_t)(QMTIK_get_w(o_layer->q_o_wght[i], j)*(1<<QMTIK_FT_FRAC));
+    }
+    #ifdef QMTIK_FINETUNE_HH
+        const QMTIK_QHHLayer* hh_layer=&q_model->q_hh_layers[QMTIK_L-1];
+        for (size_t i=0; i<QMTIK_H; ++i){
+            fine_tune->hh_bias[i]=(int16_t)(hh_layer->q_hh_bias[i]*(1<<QMTIK_FT_FRAC));
+            for (size_t j=0; j<QMTIK_H; ++j) fine_tune->hh_wght[i][j]=(int16_t)(QMTIK_get_w(hh_layer->q_hh_wght[i], j)*(1<<QMTIK_FT_FRAC));
+        }
+        //float only here, the step itself stays integer
+        for (int32_t v=QMTIK_QActvT_MIN; v<=QMTIK_QActvT_MAX; ++v){
+            QMTIK_MainT y=v*QMTIK_A_SCALE, d;
+            #if defined(QMTIK_SIGMOID_ACTV)
+                d=y*(1.0f-y);
+            #elif defined(QMTIK_TANH_ACTV)
+                d=1.0f-y*y;
+            #else
+                d=QMTIK_train_activation_deriv(y);
+            #endif
+            fine_tune->deriv[v-QMTIK_QActvT_MIN]=(int16_t)lroundf(fmaxf(0.0f, d)*(1<<QMTIK_FT_FRAC));
+        }
+        fine_tune->hh_gain=(int32_t)lroundf(QMTIK_W_SCALE*65536.0f);
+    #endif
+    //a bias code moves 1/QMTIK_A_SCALE times as far as a weight code for an input code of one
+    fine_tune->bias_gain=(int32_t)fmaxf(1.0f, roundf(1.0f/QMTIK_A_SCALE));
+    fine_tune->shift=shift; fine_tune->rng=seed?seed:0x9E3779B9u;
+}
+//One integer SGD step on a sample whose trunk activations are already in q_context, returns its cost before the step
+QMTIK_MainT QMTIK_finetune_step(QMTIK_FineTune* fine_tune, QMTIK_QModel* q_model, QMTIK_QContext* q_context, QMTIK_QActvT expected[QMTIK_O]) {
+    int32_t e[QMTIK_O];
+    const QMTIK_QActvT* x=q_context->q_hh_actv[QMTIK_L-1];
+    QMTIK_infer_layers(q_model, q_context, QMTIK_FT_FIRST);
+    QMTIK_infer_post_process(q_context->q_o_z);
+    for (size_t i=0; i<QMTIK_O; ++i) e[i]=(int32_t)q_context->q_o_z[i]-expected[i];
+    #ifdef QMTIK_FINETUNE_HH
+        //the error reaching the last hidden layer through the output codes it was computed with
+        int32_t d[QMTIK_H];
+        size_t l=QMTIK_L;
+        const QMTIK_QActvT* h=(l==1)?q_context->q_ih_actv:q_context->q_hh_actv[l-2];
+        for (size_t j=0; j<QMTIK_H; ++j){
+            int64_t sum=0;
+            for (size_t i=0; i<QMTIK_O; ++i) sum+=(int64_t)QMTIK_get_w(q_model->q_o_layer.q_o_wght[i], j)*e[i];
+            d[j]=(int32_t)((((sum*fine_tune->deriv[x[j]-QMTIK_QActvT_MIN])>>QMTIK_FT_FRAC)*fine_tune->hh_gain)>>16);
+        }
+    #endif
+    for (size_t i=0; i<QMTIK_O; ++i){
+        if (!e[i]) continue;
+        fine_tune->o_bias[i]=QMTIK_ft_update(fine_tune->o_bias[i], (int64_t)e[i]*fine_tune->bias_gain, fine_tune->shift, &fine_tune->rng);
+        for (size_t j=0; j<QMTIK_H; ++j) if (x[j]) fine_tune->o_wght[i][j]=QMTIK_ft_update(fine_tune->o_wght[i][j], (int64_t)e[i]*x[j], fine_tune->shift, &fine_tune->rng);
+    }
+    #ifdef QMTIK_FINETUNE_HH
+        for (size_t i=0; i<QMTIK_H; ++i){
+            if (!d[i]) continue;
+            fine_tune->hh_bias[i]=QMTIK_ft_update(fine_tune->hh_bias[i], (int64_t)d[i]*fine_tune->bias_gain, fine_tune->shift, &fine_tune->rng);
+            for (size_t j=0; j<QMTIK_H; ++j) if (h[j]) fine_tune->hh_wght[i][j]=QMTIK_ft_update(fine_tune->hh_wght[i][j], (int64_t)d[i]*h[j], fine_tune->shift, &fine_tune->rng);
+        }
+    #endif
+    QMTIK_finetune_commit(fine_tune, q_model);
+    return QMTIK_infer_cost(q_context->q_o_z, expected);
+}
+//Fills q_o_z with the requantized output layer, before post processing
+static inline void QMTIK_infer_logits(const QMTIK_QModel* q_model, QMTIK_QContext* q_context) {QMTIK_infer_layers(q_model, q_context, 0);}
+static inline void QMTIK_infer_layers(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, size_t first) {
+    for (size_t l=first; l<QMTIK_L+2; ++l){
+        QMTIK_PROFILE_BEGIN(start)
+        QMTIK_infer_layer(q_model, q_context, l);
+        QMTIK_PROFILE_END(QMTIK_PROF_INFER, l, start, (l>QMTIK_L)?QMTIK_O:QMTIK_H, QMTIK_count_clamped_q(QMTIK_layer_actv(q_context, l), (l>QMTIK_L)?QMTIK_O:QMTIK_H))
+    }
+}
+//Layer l of the forward pass: 0 is the input layer, 1 to QMTIK_L the hidden layers, QMTIK_L+1 the output layer
+static inline void QMTIK_infer_layer(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, size_t l) {
+    const QMTIK_QActvT* x=(l==0)?q_context->q_i_actv:(l==1)?q_context->q_ih_actv:q_context->q_hh_actv[l-2];
+    #if defined(QMTIK_SIMD)||QMTIK_GEMM_INFER
+    //packed INT4 and block-sparse weights are only read through QMTIK_infer_gemm and QMTIK_infer_ih, weight columns through QMTIK_infer_columns
+    if (QMTIK_gemv_kernel||QMTIK_GEMM_INFER){
+        QMTIK_QAccT accs[QMTIK_QACC_STRIDE];
+        if (l==0){
+            QMTIK_infer_ih(q_model, x, 1, accs);
+            for (size_t i=0; i<QMTIK_H; ++i) q_context->q_ih_actv[i]=QMTIK_infer_activation_q(accs[i], q_model->q_ih_layer.q_ih_rq);
+        }
+        else if (l<=QMTIK_L){
+            if (!QMTIK_INFER_COLUMNS(q_model->q_columns.q_hh_cols[l-1][0], q_model->q_hh_layers[l-1].q_hh_acc_bias, QMTIK_H, x, accs))
+                QMTIK_infer_gemm(&q_model->q_hh_layers[l-1].q_hh_wght[0][0], QMTIK_QPANEL_ARGS(q_model, q_hh, [l-1]), q_model->q_hh_layers[l-1].q_hh_acc_bias, QMTIK_QROW_RQ(q_model->q_hh_layers[l-1].q_hh_row_rq), QMTIK_H, QMTIK_H, x, 1, accs);
+            for (size_t i=0; i<QMTIK_H; ++i) q_context->q_hh_actv[l-1][i]=QMTIK_infer_activation_q(accs[i], q_model->q_hh_layers[l-1].q_hh_rq);
+        }
+        else{
+            if (!QMTIK_INFER_COLUMNS(q_model->q_columns.q_o_cols[0], q_model->q_o_layer.q_o_acc_bias, QMTIK_O, x, accs))
+                QMTIK_infer_gemm(&q_model->q_o_layer.q_o_wght[0][0], QMTIK_QPANEL_ARGS(q_model, q_o, ), q_model->q_o_layer.q_o_acc_bias, QMTIK_QROW_RQ(q_model->q_o_layer.q_o_row_rq), QMTIK_O, QMTIK_H, x, 1, accs);
+            for (size_t i=0; i<QMTIK_O; ++i) q_context->q_o_z[i]=QMTIK_saturate_a(QMTIK_requantize(accs[i], q_model->q_o_layer.q_o_rq));
+        }
+        return;
+    }
+    #endif
+    #if !QMTIK_GEMM_INFER
+    QMTIK_QAccT acc;
+    if (l==0){
+        for (size_t i=0; i<QMTIK_H; ++i){
+            acc=q_model->q_ih_layer.q_ih_acc_bias[i];
+            for (size_t j=0; j<QMTIK_I; ++j) acc+=(QMTIK_QAccT)q_model->q_ih_layer.q_ih_wght[i][j]*x[j];
+            q_context->q_ih_actv[i]=QMTIK_infer_activation_q(acc, q_model->q_ih_layer.q_ih_rq);
+        }
+    }
+    else if (l<=QMTIK_L){
+        const QMTIK_QHHLayer* layer=&q_model->q_hh_layers[l-1];
+        for (size_t i=0; i<QMTIK_H; ++i){
+            acc=layer->q_hh_acc_bias[i];
+            for (size_t j=0; j<QMTIK_H; ++j) acc+=(QMTIK_QAccT)layer->q_hh_wght[i][j]*x[j];
+            q_context->q_hh_actv[l-1][i]=QMTIK_infer_activation_q(acc, layer->q_hh_rq);
+        }
+    }
+    else{
+        for (size_t i=0; i<QMTIK_O; ++i){
+            acc=q_model->q_o_layer.q_o_acc_bias[i];
+            for (size_t j=0; j<QMTIK_H; ++j) acc+=(QMTIK_QAccT)q_model->q_o_layer.q_o_wght[i][j]*x[j];
+            q_context->q_o_z[i]=QMTIK_saturate_a(QMTIK_requantize(acc, q_model->q_o_layer.q_o_rq));
+        }
+    }
+    #endif
+}
+void QMTIK_infer_forward_batch(const QMTIK_QModel* q_model, QMTIK_QActvT inputs[][QMTIK_I], QMTIK_QActvT outputs[][QMTIK_O], size_t n) {
+    QMTIK_QActvT actv[2][QMTIK_BATCH][QMTIK_H];
+    QMTIK_QAccT accs[QMTIK_BATCH][QMTIK_QACC_STRIDE];
+    for (size_t s0=0; s0<n; s0+=QMTIK_BATCH){
+        size_t m=(n-s0<QMTIK_BATCH)?n-s0:QMTIK_BATCH;
+        QMTIK_infer_ih(q_model, inputs[s0], m, accs[0]);
+        for (size_t s=0; s<m; ++s) for (size_t i=0; i<QMTIK_H; ++i) actv[0][s][i]=QMTIK_infer_activation_q(accs[s][i], q_model->q_ih_layer.q_ih_rq);
+        for (size_t l=0; l<QMTIK_L; ++l){
+            QMTIK_infer_gemm(&q_model->q_hh_layers[l].q_hh_wght[0][0], QMTIK_QPANEL_ARGS(q_model, q_hh, [l]), q_model->q_hh_layers[l].q_hh_acc_bias, QMTIK_QROW_RQ(q_model->q_hh_layers[l].q_hh_row_rq), QMTIK_H, QMTIK_H, actv[l&1][0], m, accs[0]);
+            for (size_t s=0; s<m; ++s) for (size_t i=0; i<QMTIK_H; ++i) actv[(l+1)&1][s][i]=QMTIK_infer_activation_q(accs[s][i], q_model->q_hh_layers[l].q_hh_rq);
+        }
+        QMTIK_infer_gemm(&q_model->q_o_layer.q_o_wght[0][0], QMTIK_QPANEL_ARGS(q_model, q_o, ), q_model->q_o_layer.q_o_acc_bias, QMTIK_QROW_RQ(q_model->q_o_layer.q_o_row_rq), QMTIK_O, QMTIK_H, actv[QMTIK_L&1][0], m, accs[0]);
+        for (size_t s=0; s<m; ++s){
+            for (size_t i=0; i<QMTIK_O; ++i) outputs[s0+s][i]=QMTIK_saturate_a(QMTIK_requantize(accs[s][i], q_model->q_o_layer.q_o_rq));
+            QMTIK_infer_post_process(outputs[s0+s]);
+        }
+    }
+}
+//==================================================
+//Raw input layer dot products of x, through the dense or sparse kernel when one is selected
+static inline void QMTIK_delta_dots(const QMTIK_QModel* q_model, const QMTIK_QActvT* x, QMTIK_QAccT* dot) {
+    const QMTIK_QIHLayer* layer=&q_model->q_ih_layer;
+    #ifdef QMTIK_PRUNE_PERCENT
+        memset(dot, 0, QMTIK_H*sizeof(QMTIK_QAccT));
+        QMTIK_sparse_kernel(layer->q_ih_blocks[0], layer->q_ih_block_col, layer->q_ih_group_end, layer->q_ih_wsum, QMTIK_H, QMTIK_I, x, dot);
+    #else
+        static const QMTIK_QAccT zero[QMTIK_H];
+        QMTIK_QAccT acc[QMTIK_QACC_STRIDE];
+        if (QMTIK_gemv_kernel) {QMTIK_infer_gemm(&layer->q_ih_wght[0][0], QMTIK_QPANEL_ARGS(q_model, q_ih, ), zero, NULL, QMTIK_H, QMTIK_I, x, 1, acc); memcpy(dot, acc, QMTIK_H*sizeof(QMTIK_QAccT)); return;}
+        for (size_t i=0; i<QMTIK_H; ++i){
+            dot[i]=0;
+            for (size_t j=0; j<QMTIK_I; ++j) dot[i]+=(QMTIK_QAccT)QMTIK_get_w(layer->q_ih_wght[i], j)*x[j];
+        }
+    #endif
+}
+//dot+=W[:,idx[t]]*dx[t] for the n changed inputs, a pruned layer only visits kept blocks whose columns changed
+static inline void QMTIK_delta_update(const QMTIK_QModel* q_model, const uint16_t* idx, const int16_t* dx, size_t n, QMTIK_QAccT* dot) {
+    const QMTIK_QIHLayer* layer=&q_model->q_ih_layer;
+    #ifdef QMTIK_PRUNE_PERCENT
+        int16_t dense[QMTIK_SPARSE_COLS*QMTIK_SPARSE_BLOCK]={0};
+        uint8_t changed[QMTIK_SPARSE_COLS]={0};
+        for (size_t t=0; t<n; ++t) {dense[idx[t]]=dx[t]; changed[idx[t]/QMTIK_SPARSE_BLOCK]=1;}
+        size_t b=0;
+        for (size_t i=0; i<QMTIK_H; i+=QMTIK_SPARSE_ROWS){
+            for (; b<layer->q_ih_group_end[i/QMTIK_SPARSE_ROWS]; ++b){
+                if (!changed[layer->q_ih_block_col[b]]) continue;
+                const QMTIK_QWghtT* block=layer->q_ih_blocks[b];
+                const int16_t* d=dense+layer->q_ih_block_col[b]*QMTIK_SPARSE_BLOCK;
+                for (size_t r=0; r<QMTIK_SPARSE_ROWS&&i+r<QMTIK_H; ++r) for (size_t j=0; j<QMTIK_SPARSE_BLOCK; ++j) dot[i+r]+=(QMTIK_QAccT)block[r*QMTIK_SPARSE_BLOCK+j]*d[j];
+            }
+        }
+    #else
+        for (size_t i=0; i<QMTIK_H; ++i) for (size_t t=0; t<n; ++t) dot[i]+=(QMTIK_QAccT)QMTIK_get_w(layer->q_ih_wght[i], idx[t])*dx[t];
+    #endif
+}
+void QMTIK_reset_delta(QMTIK_QDelta* q_delta) {q_delta->valid=0;}
+void QMTIK_infer_forward_delta(QMTIK_QNetwork* q_network, QMTIK_QDelta* q_delta) {QMTIK_infer_delta(&q_network->q_model, &q_network->q_context, q_delta);}
+//Same outputs as QMTIK_infer, but the input layer only pays for the inputs that changed since the last call with q_delta
+//The integer dot products are exact, so updating them is bit-identical to recomputing. Enough changes fall back to a full pass
+void QMTIK_infer_delta(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, QMTIK_QDelta* q_delta) {
+    const QMTIK_QIHLayer* layer=&q_model->q_ih_layer;
+    QMTIK_PROFILE_BEGIN(start)
+    uint16_t idx[QMTIK_I];
+    int16_t dx[QMTIK_I];
+    size_t n=0;
+    if (q_delta->valid) for (size_t j=0; j<QMTIK_I; ++j){
+        idx[n]=(uint16_t)j;
+        dx[n]=(int16_t)(q_context->q_i_actv[j]-q_delta->q_i_prev[j]);
+        n+=(dx[n]!=0);
+    }
+    //a selected kernel streams the whole layer far faster than the strided column updates
+    if (!q_delta->valid||n*(QMTIK_gemv_kernel?8:1)>=QMTIK_I) QMTIK_delta_dots(q_model, q_context->q_i_actv, q_delta->q_ih_dot);
+    else if (n) QMTIK_delta_update(q_model, idx, dx, n, q_delta->q_ih_dot);
+    memcpy(q_delta->q_i_prev, q_context->q_i_actv, sizeof(q_delta->q_i_prev));
+    q_delta->valid=1;
+    for (size_t i=0; i<QMTIK_H; ++i){
+        #ifdef QMTIK_INT4_WGHT
+            QMTIK_QAccT acc=layer->q_ih_acc_bias[i]+QMTIK_requantize(q_delta->q_ih_dot[i], layer->q_ih_row_rq[i]);
+        #else
+            QMTIK_QAccT acc=layer->q_ih_acc_bias[i]+q_delta->q_ih_dot[i];
+        #endif
+        q_context->q_ih_actv[i]=QMTIK_infer_activation_q(acc, layer->q_ih_rq);
+    }
+    QMTIK_PROFILE_END(QMTIK_PROF_INFER, 0, start, QMTIK_H, QMTIK_count_clamped_q(q_context->q_ih_actv, QMTIK_H))
+    QMTIK_infer_layers(q_model, q_context, 1);
+    QMTIK_infer_post_process(q_context->q_o_z);
+}
+//==================================================
+#ifdef QMTIK_THREADS
+//Rows [r0, r1) of layer l, r0 a multiple of QMTIK_PANEL_R so the packed panels split on tile boundaries
+static inline void QMTIK_infer_rows(const QMTIK_QModel* q_model, QMTIK_QContext* q_context, size_t l, size_t r0, size_t r1) {
+    QMTIK_QAccT accs[QMTIK_QACC_STRIDE];
+    const QMTIK_QWghtT* panel=NULL;
+    const QMTIK_QAccT* wsum=NULL;
+    const QMTIK_QRequant* row_rq=NULL;
+    size_t k=(l==0)?QMTIK_I:QMTIK_H;
+    const QMTIK_QActvT* x=(l==0)?q_context->q_i_actv:(l==1)?q_context->q_ih_actv:q_context->q_hh_actv[l-2];
+    #ifdef QMTIK_PRUNE_PERCENT
+    //the block-sparse input layer is not split, the thread owning row 0 runs all of it
+    if (l==0){
+        if (r0) return;
+        QMTIK_infer_ih(q_model, x, 1, accs);
+        for (size_t i=0; i<QMTIK_H; ++i) q_context->q_ih_actv[i]=QMTIK_infer_activation_q(accs[i], q_model->q_ih_layer.q_ih_rq);
+        return;
+    }
+    #endif
+    if (r0>=r1) return;
+    if (l==0){
+        #ifndef QMTIK_PRUNE_PERCENT
+        const QMTIK_QIHLayer* layer=&q_model->q_ih_layer;
+        #ifdef QMTIK_SIMD
+            panel=q_model->q_panels.q_ih_panel+r0*QMTIK_PANEL_ROW(k); wsum=q_model->q_panels.q_ih_wsum+r0;
+        #endif
+        #ifdef QMTIK_INT4_WGHT
+            row_rq=layer->q_ih_row_rq+r0;
+        #endif
+        QMTIK_infer_gemm(layer->q_ih_wght[r0], panel, wsum, layer->q_ih_acc_bias+r0, row_rq, r1-r0, k, x, 1, accs);
+        for (size_t i=r0; i<r1; ++i) q_context->q_ih_actv[i]=QMTIK_infer_activation_q(accs[i-r0], layer->q_ih_rq);
+        #endif
+    }
+    else if (l<=QMTIK_L){
+        const QMTIK_QHHLayer* layer=&q_model->q_hh_layers[l-1];
+        #ifdef QMTIK_SIMD
+            panel=q_model->q_panels.q_hh_panel[l-1]+r0*QMTIK_PANEL_ROW(k); wsum=q_model->q_panels.q_hh_wsum[l-1]+r0;
+        #endif
+        #ifdef QMTIK_INT4_WGHT
+            row_rq=layer->q_hh_row_rq+r0;
+        #endif
+        QMTIK_infer_gemm(layer->q_hh_wght[r0], panel, wsum, layer->q_hh_acc_bias+r0, row_rq, r1-r0, k, x, 1, accs);
+        for (size_t i=r0; i<r1; ++i) q_context->q_hh_actv[l-1][i]=QMTIK_infer_activation_q(accs[i-r0], layer->q_hh_rq);
+    }
+    else{
+        const QMTIK_QOLayer* layer=&q_model->q_o_layer;
+        #ifdef QMTIK_SIMD
+            panel=q_model->q_panels.q_o_panel+r0*QMTIK_PANEL_ROW(k); wsum=q_model->q_panels.q_o_wsum+r0;
+        #endif
+        #ifdef QMTIK_INT4_WGHT
+            row_rq=layer->q_o_row_rq+r0;
+        #endif
+        QMTIK_infer_gemm(layer->q_o_wght[r0], panel, wsum, layer->q_o_acc_bias+r0, row_rq, r1-r0, k, x, 1, accs);
+        //the explicit bound keeps gcc -O3 from warning about rows past QMTIK_O once the pool's row split is inlined
+        for (size_t i=r0; i<r1&&i<QMTIK_O; ++i) q_context->q_o_z[i]=QMTIK_saturate_a(QMTIK_requantize(accs[i-r0], layer->q_o_rq));
+    }
+}
+static inline void QMTIK_pool_init(QMTIK_PoolSync* sync) {
+    memset(sync, 0, sizeof(QMTIK_PoolSync));
+    sync->n_threads=1;
+    pthread_mutex_init(&sync->lock, NULL);
+    pthread_cond_init(&sync->wake, NULL);
+}
+//Spins on the job after seen, then sleeps until QMTIK_pool_announce or QMTIK_pool_stop wakes us, 1 when stopped
+static inline uint8_t QMTIK_pool_wait(QMTIK_PoolSync* sync, size_t seen) {
+    for (size_t spin=0; __atomic_load_n(&sync->generation, __ATOMIC_ACQUIRE)==seen&&!__atomic_load_n(&sync->stop, __ATOMIC_ACQUIRE); ++spin){
+        if (spin<QMTIK_SPIN_LIMIT) {QMTIK_SPIN_PAUSE(); continue;}
+        pthread_mutex_lock(&sync->lock);
+        __atomic_add_fetch(&sync->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&sync->generation, __ATOMIC_SEQ_CST)==seen&&!__atomic_load_n(&sync->stop, __ATOMIC_SEQ_CST)) pthread_cond_wait(&sync->wake, &sync->lock);
+        __atomic_sub_fetch(&sync->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&sync->lock);
+    }
+    return __atomic_load_n(&sync->stop, __ATOMIC_ACQUIRE);
+}
+static inline void QMTIK_pool_announce(QMTIK_PoolSync* sync) {
+    __atomic_add_fetch(&sync->generation, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sync->sleepers, __ATOMIC_SEQ_CST)) {pthread_mutex_lock(&sync->lock); pthread_cond_broadcast(&sync->wake); pthread_mutex_unlock(&sync->lock);}
+}
+static inline void QMTIK_pool_barrier(QMTIK_PoolSync* sync, size_t* phase) {
+    size_t next=*phase+1;
+    if (__atomic_add_fetch(&sync->arrived, 1, __ATOMIC_ACQ_REL)==sync->n_threads){
+        __atomic_store_n(&sync->arrived, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&sync->phase, next, __ATOMIC_RELEASE);
+    }
+    else for (size_t spin=0; __atomic_load_n(&sync->phase, __ATOMIC_ACQUIRE)!=next; ++spin){
+        if (spin<QMTIK_SPIN_LIMIT) QMTIK_SPIN_PAUSE();
+        else sched_yield();
+    }
+    *phase=next;
+}
+static inline void QMTIK_pool_stop(QMTIK_PoolSync* sync, const pthread_t* threads) {
+    pthread_mutex_lock(&sync->lock);
+    __atomic_store_n(&sync->stop, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&sync->wake);
+    pthread_mutex_unlock(&sync->lock);
+    for (size_t t=1; t<sync->n_threads; ++t) pthread_join(threads[t], NULL);
+    pthread_mutex_destroy(&sync->lock);
+    pthread_cond_destroy(&sync->wake);
+    sync->n_threads=0;
+}
+//Thread t's share of every layer, the barrier after the output layer tells the caller all of q_o_z is written
+static inline void QMTIK_pool_layers(QMTIK_InferPool* pool, size_t t, size_t* phase) {
+    for (size_t l=0; l<QMTIK_L+2; ++l){
+        size_t rows=(l>QMTIK_L)?QMTIK_O:QMTIK_H;
+        size_t chunk=QMTIK_ROUND_UP((rows+pool->sync.n_threads-1)/pool->sync.n_threads, QMTIK_PANEL_R);
+        size_t r0=t*chunk, r1=r0+chunk;
+        QMTIK_infer_rows(pool->q_model, pool->q_context, l, (r0<rows)?r0:rows, (r1<rows)?r1:rows);
+        QMTIK_pool_barrier(&pool->sync, phase);
+    }
+}
+static void* QMTIK_pool_worker(void* arg) {
+    QMTIK_InferWorker* worker=(QMTIK_InferWorker*)arg;
+    QMTIK_InferPool* pool=worker->pool;
+    size_t seen=0, phase=0;
+    #if defined(__linux__)&&defined(CPU_SET)
+    if (worker->pin){
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->t%(size_t)sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    #endif
+    while (!QMTIK_pool_wait(&pool->sync, seen++)){
+        phase=__atomic_load_n(&pool->sync.phase, __ATOMIC_ACQUIRE);
+        QMTIK_pool_layers(pool, worker->t, &phase);
+    }
+    return NULL;
+}
+uint8_t QMTIK_start_infer_pool(QMTIK_InferPool* pool, size_t n_threads, uint8_t pin) {
+    memset(pool, 0, sizeof(QMTIK_InferPool));
+    QMTIK_pool_init(&pool->sync);
+    if (n_threads>QMTIK_MAX_THREADS) n_threads=QMTIK_MAX_THREADS;
+    for (size_t t=1; t<n_threads; ++t){
+        pool->workers[t].pool=pool; pool->workers[t].t=t; pool->workers[t].pin=pin;
+        if (pthread_create(&pool->threads[t], NULL, QMTIK_pool_worker, &pool->workers[t])) {fprintf(stderr, "[QMTIK] Failed to start inference worker %zu\n", t); QMTIK_stop_infer_pool(pool); return 1;}
+        pool->sync.n_threads=t+1;
+    }
+    QMTIK_select_kernel();
+    return 0;
+}
+//Bit-identical to QMTIK_infer, only one request may be in flight per pool
+void QMTIK_infer_parallel(QMTIK_InferPool* pool, const QMTIK_QModel* q_model, QMTIK_QContext* q_context) {
+    if (pool->sync.n_threads<2) {QMTIK_infer(q_model, q_context); return;}
+    size_t phase=__atomic_load_n(&pool->sync.phase, __ATOMIC_RELAXED);
+    pool->q_model=q_model; pool->q_context=q_context;
+    QMTIK_pool_announce(&pool->sync);
+    QMTIK_pool_layers(pool, 0, &phase);
+    QMTIK_infer_post_process(q_context->q_o_z);
+}
+void QMTIK_stop_infer_pool(QMTIK_InferPool* pool) {QMTIK_pool_stop(&pool->sync, pool->threads);}
+#endif
+//==================================================
+static inline void QMTIK_train_backward(const QMTIK_Network* network, QMTIK_TrainContext* context, const QMTIK_SamplePair* sample_pair) {
+    QMTIK_Params* grads=&context->grads;
+    for (size_t i=0; i<QMTIK_I; ++i) context->i_actv[i]=sample_pair->input[i];
+    QMTIK_train_forward(network, context);
+    for (size_t i=0; i<QMTIK_O; i++) context->dO[i]=context->o_z[i]-(QMTIK_MainT)sample_pair->output[i];
+    for (size_t i=0; i<QMTIK_H; ++i){
+        QMTIK_MainT sum=0;
+        for (size_t j=0; j<QMTIK_O; ++j) sum+=network->wght_shadow.o_layer.o_wght[j][i]*context->dO[j];
+        context->dHH[QMTIK_L-1][i]=sum*QMTIK_train_activation_deriv(context->hh_z[QMTIK_L-1][i]);
+    }
+    for (int l=QMTIK_L-2; l>=0; --l){
+        for (size_t i=0; i<QMTIK_H; ++i){
+            QMTIK_MainT sum=0;
+            for(size_t j=0; j<QMTIK_H; ++j) sum+=network->wght_shadow.hh_layers[l+1].hh_wght[j][i]*context->dHH[l+1][j];
+            context->dHH[l][i]=sum*QMTIK_train_activation_deriv(context->hh_z[l][i]);
+        }
+    }
+    for (size_t i=0; i<QMTIK_H; ++i){
+        QMTIK_MainT sum=0;
+        for (size_t j=0; j<QMTIK_H; ++j) sum+=network->wght_shadow.hh_layers[0].hh_wght[j][i]*context->dHH[0][j];
+        context->dIH[i]=sum*QMTIK_train_activation_deriv(context->ih_z[i]);
+    }
+    for (size_t i=0; i<QMTIK_H; ++i){
+        grads->ih_layer.ih_bias[i]+=context->dIH[i];
+        #ifdef QMTIK_PRUNE_PERCENT
+        for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) if (!network->ih_pruned[i/QMTIK_SPARSE_ROWS][c])
+            for (size_t j=c*QMTIK_SPARSE_BLOCK; j<QMTIK_I&&j<(c+1)*QMTIK_SPARSE_BLOCK; ++j) grads->ih_layer.ih_wght[i][j]+=context->dIH[i]*context->i_tape[j];
+        #else
+        for (size_t j=0; j<QMTIK_I; ++j) grads->ih_layer.ih_wght[i][j]+=context->dIH[i]*context->i_tape[j];
+        #endif
+    }
+    for (size_t l=0; l<QMTIK_L; ++l){
+        const QMTIK_MainT* x=(l==0)?context->ih_tape:context->hh_tape[l-1];
+        for (size_t i=0; i<QMTIK_H; ++i){
+            grads->hh_layers[l].hh_bias[i]+=context->dHH[l][i];
+            for (size_t j=0; j<QMTIK_H; ++j) grads->hh_layers[l].hh_wght[i][j]+=context->dHH[l][i]*x[j];
+        }
+    }
+    for (size_t i=0; i<QMTIK_O; ++i){
+        grads->o_layer.o_bias[i]+=context->dO[i];
+        for (size_t j=0; j<QMTIK_H; ++j) grads->o_layer.o_wght[i][j]+=context->dO[i]*context->hh_tape[QMTIK_L-1][j];
+    }
+}
+//Linear warmup over the first QMTIK_WARMUP_STEPS updates on top of the per epoch schedule
+static inline QMTIK_MainT QMTIK_schedule_alpha(const QMTIK_AdamState* adam_state) {
+    QMTIK_MainT alpha=QMTIK_ALPHA;
+    (void)adam_state;
+    #if defined(QMTIK_COSINE_LR)
+        alpha=QMTIK_MIN_ALPHA+(QMTIK_ALPHA-QMTIK_MIN_ALPHA)*0.5f*(1.0f+cosf(3.14159265f*(QMTIK_MainT)adam_state->epoch/QMTIK_EPOCHS));
+    #elif defined(QMTIK_STEP_LR)
+        alpha=fmaxf(QMTIK_MIN_ALPHA, QMTIK_ALPHA*powf(QMTIK_LR_GAMMA, (QMTIK_MainT)(adam_state->epoch/QMTIK_STEP_LR)));
+    #endif
+    #if QMTIK_WARMUP_STEPS
+        if (adam_state->t<QMTIK_WARMUP_STEPS) alpha*=(QMTIK_MainT)adam_state->t/QMTIK_WARMUP_STEPS;
+    #endif
+    return alpha;
+}
+static inline QMTIK_AdamStep QMTIK_adam_begin(QMTIK_AdamState* adam_state, QMTIK_MainT scale) {
+    ++adam_state->t;
+    adam_state->b1t*=QMTIK_BETA1;
+    adam_state->b2t*=QMTIK_BETA2;
+    //alpha*m_hat/(sqrt(v_hat)+eps) with both bias corrections folded into lr and eps
+    QMTIK_MainT v_corr=sqrtf(1-adam_state->b2t);
+    return (QMTIK_AdamStep){scale, QMTIK_schedule_alpha(adam_state)*v_corr/(1-adam_state->b1t), QMTIK_EPS*v_corr};
+}
+static inline void QMTIK_adam_apply(QMTIK_Network* network, QMTIK_Params* grads, const QMTIK_AdamStep* step, size_t first, size_t count) {
+    #ifdef QMTIK_PRUNE_PERCENT
+        //ih_wght leads the flat layout, runs of kept blocks are updated and pruned blocks stay exactly zero
+        size_t end=first+count;
+        while (first<end&&first<QMTIK_H*QMTIK_I){
+            size_t run=first;
+            uint8_t pruned=network->ih_pruned[first/QMTIK_I/QMTIK_SPARSE_ROWS][first%QMTIK_I/QMTIK_SPARSE_BLOCK];
+            while (run<end&&run<QMTIK_H*QMTIK_I&&network->ih_pruned[run/QMTIK_I/QMTIK_SPARSE_ROWS][run%QMTIK_I/QMTIK_SPARSE_BLOCK]==pruned){
+                size_t block_end=run/QMTIK_I*QMTIK_I+QMTIK_ROUND_UP(run%QMTIK_I+1, QMTIK_SPARSE_BLOCK);
+                run=(block_end>(run/QMTIK_I+1)*QMTIK_I)?(run/QMTIK_I+1)*QMTIK_I:block_end;
+            }
+            if (run>end) run=end;
+            if (!pruned) QMTIK_adam_kernel(QMTIK_PARAMS(&network->ih_layer)+first, QMTIK_PARAMS(&network->wght_shadow)+first, QMTIK_PARAMS(&network->adam_state.m)+first, QMTIK_PARAMS(&network->adam_state.v)+first, QMTIK_PARAMS(grads)+first, run-first, step);
+            first=run;
+        }
+        count=end-first;
+    #endif
+    QMTIK_adam_kernel(QMTIK_PARAMS(&network->ih_layer)+first, QMTIK_PARAMS(&network->wght_shadow)+first, QMTIK_PARAMS(&network->adam_state.m)+first, QMTIK_PARAMS(&network->adam_state.v)+first, QMTIK_PARAMS(grads)+first, count, step);
+}
+#ifdef QMTIK_PRUNE_PERCENT
+static inline QMTIK_MainT QMTIK_block_norm(const QMTIK_IHLayer* layer, size_t g, size_t c) {
+    QMTIK_MainT sum=0.0f;
+    for (size_t i=g*QMTIK_SPARSE_ROWS; i<QMTIK_H&&i<(g+1)*QMTIK_SPARSE_ROWS; ++i)
+        for (size_t j=c*QMTIK_SPARSE_BLOCK; j<QMTIK_I&&j<(c+1)*QMTIK_SPARSE_BLOCK; ++j) sum+=layer->ih_wght[i][j]*layer->ih_wght[i][j];
+    return sum;
+}
+//Gradual magnitude pruning: fraction of the way through the ramp, QMTIK_PRUNE_PERCENT*(1-(1-fraction)^3) percent of the
+//QMTIK_SPARSE_ROWS x QMTIK_SPARSE_BLOCK input blocks with the smallest L2 norm are zeroed and frozen, along with their Adam moments
+static inline void QMTIK_prune_input_layer(QMTIK_Network* network, QMTIK_MainT fraction) {
+    QMTIK_MainT left=1.0f-fraction, lo=-1.0f, hi=0.0f;
+    size_t target=(size_t)((QMTIK_MainT)(QMTIK_SPARSE_GROUPS*QMTIK_SPARSE_COLS*QMTIK_PRUNE_PERCENT/100)*(1.0f-left*left*left));
+    if (!target) return;
+    for (size_t g=0; g<QMTIK_SPARSE_GROUPS; ++g) for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) hi=fmaxf(hi, QMTIK_block_norm(&network->ih_layer, g, c));
+    //bisect for the smallest norm covering target blocks, already pruned blocks sit at 0 so the mask only grows
+    for (int it=0; it<64; ++it){
+        QMTIK_MainT mid=lo+(hi-lo)/2;
+        size_t count=0;
+        if (mid<=lo||mid>=hi) break;
+        for (size_t g=0; g<QMTIK_SPARSE_GROUPS; ++g) for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) count+=QMTIK_block_norm(&network->ih_layer, g, c)<=mid;
+        if (count>=target) hi=mid;
+        else lo=mid;
+    }
+    for (size_t g=0; g<QMTIK_SPARSE_GROUPS; ++g){
+        for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c){
+            if (network->ih_pruned[g][c]||QMTIK_block_norm(&network->ih_layer, g, c)>hi) continue;
+            network->ih_pruned[g][c]=1;
+            for (size_t i=g*QMTIK_SPARSE_ROWS; i<QMTIK_H&&i<(g+1)*QMTIK_SPARSE_ROWS; ++i){
+                for (size_t j=c*QMTIK_SPARSE_BLOCK; j<QMTIK_I&&j<(c+1)*QMTIK_SPARSE_BLOCK; ++j){
+                    network->ih_layer.ih_wght[i][j]=network->wght_shadow.ih_layer.ih_wght[i][j]=0.0f;
+                    network->adam_state.m.ih_layer.ih_wght[i][j]=network->adam_state.v.ih_layer.ih_wght[i][j]=0.0f;
+                }
+            }
+        }
+    }
+}
+#endif
+static inline void QMTIK_train_update(QMTIK_Network* network, QMTIK_Params* grads, QMTIK_MainT scale) {
+    QMTIK_AdamStep step=QMTIK_adam_begin(&network->adam_state, scale);
+    QMTIK_adam_apply(network, grads, &step, 0, QMTIK_N_PARAMS);
+    QMTIK_refresh_row_shadow(network);
+}
+#ifdef QMTIK_THREADS
+//Sample shard c backpropagates into contexts[c], parameter shard c sums every context's gradients into contexts[0] and
+//applies Adam to its range. Threads take the shards t, t+n_threads, ..., so the sums do not depend on the thread count
+static inline void QMTIK_train_pool_step(QMTIK_TrainPool* pool, size_t t, size_t* phase) {
+    size_t n=pool->n, n_shards=pool->n_shards;
+    for (size_t c=t; c<n_shards; c+=pool->sync.n_threads)
+        for (size_t s=n*c/n_shards; s<n*(c+1)/n_shards; ++s) QMTIK_train_backward(pool->network, &pool->contexts[c], pool->batch[s]);
+    QMTIK_pool_barrier(&pool->sync, phase);
+    QMTIK_MainT* sum=QMTIK_PARAMS(&pool->contexts[0].grads);
+    for (size_t c=t; c<n_shards; c+=pool->sync.n_threads){
+        size_t first=QMTIK_N_PARAMS*c/n_shards, last=QMTIK_N_PARAMS*(c+1)/n_shards;
+        for (size_t k=1; k<n_shards; ++k){
+            QMTIK_MainT* part=QMTIK_PARAMS(&pool->contexts[k].grads);
+            for (size_t i=first; i<last; ++i) {sum[i]+=part[i]; part[i]=0;}
+        }
+        QMTIK_adam_apply(pool->network, &pool->contexts[0].grads, &pool->step, first, last-first);
+    }
+    QMTIK_pool_barrier(&pool->sync, phase);
+}
+static void* QMTIK_train_worker(void* arg) {
+    QMTIK_TrainWorker* worker=(QMTIK_TrainWorker*)arg;
+    QMTIK_TrainPool* pool=worker->pool;
+    size_t seen=0, phase;
+    while (!QMTIK_pool_wait(&pool->sync, seen++)){
+        phase=__atomic_load_n(&pool->sync.phase, __ATOMIC_ACQUIRE);
+        QMTIK_train_pool_step(pool, worker->t, &phase);
+    }
+    return NULL;
+}
+//The workers live for the whole training run, a thread that fails to start leaves its shards to the others
+static inline void QMTIK_start_train_pool(QMTIK_TrainPool* pool, QMTIK_Network* network, QMTIK_TrainContext* contexts, size_t n_threads) {
+    memset(pool, 0, sizeof(QMTIK_TrainPool));
+    QMTIK_pool_init(&pool->sync);
+    pool->network=network;
+    pool->contexts=contexts;
+    for (size_t t=1; t<n_threads; ++t){
+        pool->workers[t].pool=pool; pool->workers[t].t=t;
+        if (pthread_create(&pool->threads[t], NULL, QMTIK_train_worker, &pool->workers[t])) break;
+        pool->sync.n_threads=t+1;
+    }
+}
+#endif
+//With a pool the batch is split into min(n, n_contexts) shards, one context each
+static inline void QMTIK_train_batch(QMTIK_Network* network, const QMTIK_SamplePair* const* batch, size_t n, QMTIK_TrainContext* contexts, size_t n_contexts, struct QMTIK_TrainPool* pool) {
+    QMTIK_PROFILE_BEGIN(start)
+    #ifdef QMTIK_THREADS
+    if (n_contexts>n) n_contexts=n;
+    if (pool&&n_contexts>1){
+        size_t phase=__atomic_load_n(&pool->sync.phase, __ATOMIC_RELAXED);
+        pool->batch=batch; pool->n=n; pool->n_shards=n_contexts;
+        //the backward pass does not touch the Adam state, so the step is taken before the job is announced
+        pool->step=QMTIK_adam_begin(&network->adam_state, 1.0f/(QMTIK_MainT)n);
+        QMTIK_pool_announce(&pool->sync);
+        QMTIK_train_pool_step(pool, 0, &phase);
+        QMTIK_refresh_row_shadow(network);
+        QMTIK_PROFILE_END(QMTIK_PROF_STEP, 0, start, n, 0)
+        return;
+    }
+    #endif
+    (void)n_contexts; (void)pool;
+    for (size_t s=0; s<n; ++s) QMTIK_train_backward(network, contexts, batch[s]);
+    QMTIK_train_update(network, &contexts[0].grads, 1.0f/(QMTIK_MainT)n);
+    QMTIK_PROFILE_END(QMTIK_PROF_STEP, 0, start, n, 0)
+}
+static inline size_t QMTIK_load_train_batch(FILE* file, QMTIK_SamplePair samples[QMTIK_TRAIN_BATCH], const QMTIK_SamplePair* batch[QMTIK_TRAIN_BATCH]) {
+    size_t n=0;
+    while (n<QMTIK_TRAIN_BATCH&&QMTIK_load_sample_pair(file, &samples[n])) {batch[n]=&samples[n]; ++n;}
+    return n;
+}
+static inline double QMTIK_wall_seconds(void) {struct timespec ts; timespec_get(&ts, TIME_UTC); return (double)ts.tv_sec+ts.tv_nsec*1e-9;}
+//Scores the epoch through QMTIK_store_model and QMTIK_load_q_model, 1 when training should stop
+static inline uint8_t QMTIK_validate_epoch(QMTIK_Network* network, QMTIK_Validation* validation, FILE* model_file, size_t epoch, double start) {
+    QMTIK_SamplePair pairs[QMTIK_BATCH];
+    QMTIK_QActvT inputs[QMTIK_BATCH][QMTIK_I], outputs[QMTIK_BATCH][QMTIK_O];
+    uint64_t total_cost=0, correct=0, count=0;
+    validation->epochs=epoch+1; validation->cost[epoch]=-1.0f; validation->accuracy[epoch]=0.0f;
+    validation->alpha[epoch]=QMTIK_schedule_alpha(&network->adam_state);
+    #ifdef QMTIK_PRUNE_PERCENT
+        //the input layer only fits the block-sparse model once it is pruned to the target
+        if (epoch<QMTIK_PRUNE_EPOCHS) {validation->seconds[epoch]=QMTIK_wall_seconds()-start; return 0;}
+    #endif
+    QMTIK_quantize_to_model(network, validation->model);
+    rewind(model_file);
+    if (QMTIK_store_model(validation->model, model_file)) return 1;
+    rewind(model_file);
+    if (QMTIK_load_q_model(validation->q_model, model_file)) return 1;
+    rewind(validation->valid_file);
+    while (1){
+        size_t n=0;
+        while (n<QMTIK_BATCH&&QMTIK_load_sample_pair(validation->valid_file, &pairs[n])) {memcpy(inputs[n], pairs[n].input, QMTIK_I); ++n;}
+        if (!n) break;
+        QMTIK_infer_forward_batch(validation->q_model, inputs, outputs, n);
+        for (size_t s=0; s<n; ++s){
+            size_t pred=0, label=0;
+            for (size_t i=1; i<QMTIK_O; ++i) {if (outputs[s][i]>outputs[s][pred]) pred=i; if (pairs[s].output[i]>pairs[s].output[label]) label=i;}
+            total_cost+=(uint64_t)QMTIK_infer_cost(outputs[s], pairs[s].output);
+            correct+=pred==label; ++count;
+        }
+    }
+    if (!count) {fprintf(stderr, "[QMTIK] Validation file holds no samples\n"); return 1;}
+    validation->cost[epoch]=(QMTIK_MainT)total_cost/count; validation->accuracy[epoch]=(QMTIK_MainT)correct/count;
+    validation->seconds[epoch]=QMTIK_wall_seconds()-start;
+    #ifdef QMTIK_TRAIN_DEBUG
+        printf("[QMTIK] EPOCH %zu: VALID COST %f, ACCURACY %f, ALPHA %g, %.3fs\n", epoch, validation->cost[epoch], validation->accuracy[epoch], validation->alpha[epoch], validation->seconds[epoch]);
+    #endif
+    QMTIK_MainT best=validation->cost[validation->best_epoch];
+    #ifdef QMTIK_CROSS_ENTROPY_COST
+        //the cross entropy infer cost is the share of correct classes
+        uint8_t improved=validation->cost[epoch]>best;
+    #else
+        uint8_t improved=validation->cost[epoch]<best;
+    #endif
+    if (epoch==validation->best_epoch||best<0||improved){
+        validation->best_epoch=epoch;
+        if (validation->best) memcpy(validation->best, network, sizeof(QMTIK_Params));
+    }
+    return validation->patience&&epoch-validation->best_epoch>=validation->patience;
+}
+//A checkpoint starts at its stored epoch and sample, records the position after every batch and snapshots it
+static inline void QMTIK_train_epochs(QMTIK_Network* network, FILE* train_file, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_contexts, QMTIK_Checkpoint* checkpoint, QMTIK_Validation* validation) {
+    QMTIK_SamplePair samples[QMTIK_TRAIN_BATCH];
+    const QMTIK_SamplePair* batch[QMTIK_TRAIN_BATCH];
+    int _sample_number=0;
+    size_t skip=checkpoint?(size_t)checkpoint->header->sample:0;
+    FILE* model_file=validation?tmpfile():NULL;
+    if (validation&&!model_file) {perror("[QMTIK] Failed to open validation model file"); return;}
+    if (validation) {validation->epochs=0; validation->best_epoch=0;}
+    for (size_t c=0; c<n_contexts; ++c) memset(&contexts[c].grads, 0, sizeof(QMTIK_Params));
+    QMTIK_refresh_wght_shadow(network);
+    QMTIK_select_kernel();
+    QMTIK_TRAIN_POOL_START(pool, network, contexts, n_contexts)
+    #ifdef QMTIK_TRAIN_DEBUG
+        printf("[QMTIK] ====TRAINING BEGIN====\n");
+    #endif
+    for (int _epoch=checkpoint?(int)checkpoint->header->epoch:0; _epoch<QMTIK_EPOCHS; ++_epoch){
+        #ifdef QMTIK_TRAIN_DEBUG
+            if (_epoch%QMTIK_EPOCHS_DEBUG_UPDATE_POINT==0) printf("[QMTIK] EPOCH: %d\n", _epoch);
+        #endif
+        #ifdef QMTIK_PRUNE_PERCENT
+            //a resumed epoch was pruned before its first sample
+            if (_epoch&&!skip) QMTIK_prune_input_layer(network, (_epoch<QMTIK_PRUNE_EPOCHS)?(QMTIK_MainT)_epoch/QMTIK_PRUNE_EPOCHS:1.0f);
+        #endif
+        //checkpointed runs key the shuffle on the training epoch so a resumed epoch sees the same order
+        if (dataset&&checkpoint) dataset->epoch=(size_t)_epoch;
+        if (dataset) QMTIK_rewind_dataset(dataset);
+        else rewind(train_file);
+        network->adam_state.epoch=(size_t)_epoch;
+        double start=QMTIK_wall_seconds();
+        _sample_number=(int)skip;
+        if (skip&&dataset) for (size_t n; skip&&(n=QMTIK_dataset_batch(dataset, batch, (skip<QMTIK_TRAIN_BATCH)?skip:QMTIK_TRAIN_BATCH)); skip-=n);
+        else if (skip) fseek(train_file, (long)(skip*sizeof(QMTIK_SamplePair)), SEEK_SET);
+        skip=0;
+        while (1){
+            size_t n=dataset?QMTIK_dataset_batch(dataset, batch, QMTIK_TRAIN_BATCH):QMTIK_load_train_batch(train_file, samples, batch);
+            if (!n) break;
+            #ifdef QMTIK_TRAIN_DEBUG
+                for (size_t s=0; s<n; ++s) if ((_sample_number+(int)s+1)%QMTIK_SAMPLE_NUMBER_DEBUG_UPDATE_POINT==0) 
+                    printf("[QMTIK] SAMPLE_NUMBER: %d\n", _sample_number+(int)s+1);
+            #endif
+            _sample_number+=(int)n;
+            QMTIK_train_batch(network, batch, n, contexts, n_contexts, pool);
+            #ifdef QMTIK_MMAP
+            if (checkpoint){
+                uint64_t done=checkpoint->header->sample+=n;
+                if (checkpoint->every&&done/checkpoint->every!=(done-n)/checkpoint->every) QMTIK_sync_checkpoint(checkpoint);
+            }
+            #endif
+        }
+        #ifdef QMTIK_MMAP
+        if (checkpoint) {checkpoint->header->epoch=(uint64_t)_epoch+1; checkpoint->header->sample=0; QMTIK_sync_checkpoint(checkpoint);}
+        #endif
+        if (validation&&QMTIK_validate_epoch(network, validation, model_file, (size_t)_epoch, start)) break;
+    }
+    QMTIK_TRAIN_POOL_STOP(pool)
+    if (model_file) fclose(model_file);
+    if (validation&&validation->best&&validation->cost[validation->best_epoch]>=0){
+        memcpy(network, validation->best, sizeof(QMTIK_Params));
+        QMTIK_refresh_wght_shadow(network);
+    }
+    #ifdef QMTIK_PRUNE_PERCENT
+        QMTIK_prune_input_layer(network, 1.0f);
+    #endif
+}
+void QMTIK_train(QMTIK_Network* network, FILE* train_file) {QMTIK_train_epochs(network, train_file, NULL, &network->train_context, 1, NULL, NULL);}
+#ifdef QMTIK_THREADS
+void QMTIK_train_parallel(QMTIK_Network* network, FILE* train_file, QMTIK_TrainContext* contexts, size_t n_threads) {
+    if (!n_threads) {QMTIK_train(network, train_file); return;}
+    QMTIK_train_epochs(network, train_file, NULL, contexts, (n_threads>QMTIK_MAX_THREADS)?QMTIK_MAX_THREADS:n_threads, NULL, NULL);
+}
+#endif
+void QMTIK_train_dataset(QMTIK_Network* network, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_threads) {
+    if (!n_threads) QMTIK_train_epochs(network, NULL, dataset, &network->train_context, 1, NULL, NULL);
+    else QMTIK_train_epochs(network, NULL, dataset, contexts, (n_threads>QMTIK_MAX_THREADS)?QMTIK_MAX_THREADS:n_threads, NULL, NULL);
+}
+//QMTIK_train_dataset, or QMTIK_train over train_file without a dataset, scored on validation->valid_file after every epoch
+void QMTIK_train_validated(QMTIK_Network* network, FILE* train_file, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_threads, QMTIK_Validation* validation) {
+    if (!n_threads||!contexts) QMTIK_train_epochs(network, train_file, dataset, &network->train_context, 1, NULL, validation);
+    else QMTIK_train_epochs(network, train_file, dataset, contexts, (n_threads>QMTIK_MAX_THREADS)?QMTIK_MAX_THREADS:n_threads, NULL, validation);
+}
+//==================================================
+//Profiled weight saturation counts the biases and INT8 weights, INT4 row scales are fitted to each row's largest weight
+#define QMTIK_PROFILE_WGHT(l, t, layer, p, rows, k) QMTIK_PROFILE_END(QMTIK_PROF_WGHT, l, t, rows+(QMTIK_WGHT_BITS==8?(rows)*(k):0), QMTIK_count_clamped_f(layer.p##_bias, rows, QMTIK_W_SCALE, 0)+(QMTIK_WGHT_BITS==8?QMTIK_count_clamped_f(layer.p##_wght[0], (rows)*(k), QMTIK_W_SCALE, 0):0))
+void QMTIK_quantize_to_model(QMTIK_Network* network, QMTIK_Model* model){
+    QMTIK_PROFILE_BEGIN(ih_start)
+    for (size_t i=0; i<QMTIK_H; ++i){
+        model->q_ih_bias[i]=QMTIK_quantize_w(network->ih_layer.ih_bias[i]);
+        QMTIK_quantize_row(network->ih_layer.ih_wght[i], QMTIK_I, model->q_ih_wght[i], QMTIK_ROW_SCALE(model->q_ih_scale[i]));
+    }
+    QMTIK_PROFILE_WGHT(0, ih_start, network->ih_layer, ih, QMTIK_H, QMTIK_I)
+    for (size_t l=0; l<QMTIK_L; ++l){
+        QMTIK_PROFILE_BEGIN(hh_start)
+        for (size_t i=0; i<QMTIK_H; ++i){
+            model->q_hh_biases[l][i]=QMTIK_quantize_w(network->hh_layers[l].hh_bias[i]);
+            QMTIK_quantize_row(network->hh_layers[l].hh_wght[i], QMTIK_H, model->q_hh_wghts[l][i], QMTIK_ROW_SCALE(model->q_hh_scales[l][i]));
+        }
+        QMTIK_PROFILE_WGHT(l+1, hh_start, network->hh_layers[l], hh, QMTIK_H, QMTIK_H)
+    }
+    QMTIK_PROFILE_BEGIN(o_start)
+    for (size_t i=0; i<QMTIK_O; ++i){
+        model->q_o_bias[i]=QMTIK_quantize_w(network->o_layer.o_bias[i]);
+        QMTIK_quantize_row(network->o_layer.o_wght[i], QMTIK_H, model->q_o_wght[i], QMTIK_ROW_SCALE(model->q_o_scale[i]));
+    }
+    QMTIK_PROFILE_WGHT(QMTIK_L+1, o_start, network->o_layer, o, QMTIK_O, QMTIK_H)
+}
+typedef struct {FILE* file; size_t pos; uint32_t checksum; uint8_t failed;} QMTIK_ModelWriter;
+static inline uint32_t QMTIK_checksum(uint32_t hash, const void* data, size_t size) {
+    const uint8_t* bytes=(const uint8_t*)data;
+    for (size_t i=0; i<size; ++i) {hash^=bytes[i]; hash*=16777619u;}
+    return hash;
+}
+static inline void QMTIK_write_section(QMTIK_ModelWriter* writer, size_t offset, const void* data, size_t size) {
+    static const uint8_t zeros[64]={0};
+    if (writer->pos>offset) writer->failed=1;
+    while (writer->pos<offset){
+        size_t n=(offset-writer->pos<sizeof(zeros))?offset-writer->pos:sizeof(zeros);
+        if (writer->file&&fwrite(zeros, 1, n, writer->file)!=n) writer->failed=1;
+        writer->checksum=QMTIK_checksum(writer->checksum, zeros, n);
+        writer->pos+=n;
+    }
+    if (!size) return;
+    if (writer->file&&fwrite(data, 1, size, writer->file)!=size) writer->failed=1;
+    writer->checksum=QMTIK_checksum(writer->checksum, data, size);
+    writer->pos+=size;
+}
+static inline void QMTIK_write_q_layer(QMTIK_ModelWriter* writer, size_t base, size_t wght_off, size_t bias_off, size_t acc_bias_off, size_t rq_off, const QMTIK_QWghtT* wght, const QMTIK_QWghtT* bias, size_t rows, size_t k, size_t n_rq, size_t scale_off, size_t row_rq_off, const QMTIK_MainT* scale) {
+    QMTIK_QAccT acc_bias[QMTIK_QACC_STRIDE];
+    QMTIK_QRequant rq[2]={QMTIK_make_requant(QMTIK_W_SCALE), QMTIK_make_requant(QMTIK_W_SCALE*QMTIK_LEAK)}, row_rq[QMTIK_QACC_STRIDE];
+    QMTIK_fold_bias(bias, rows, acc_bias);
+    QMTIK_write_section(writer, base+wght_off, wght, rows*QMTIK_WGHT_ROW(k));
+    QMTIK_write_section(writer, base+bias_off, bias, rows);
+    QMTIK_write_section(writer, base+acc_bias_off, acc_bias, rows*sizeof(QMTIK_QAccT));
+    QMTIK_write_section(writer, base+rq_off, rq, n_rq*sizeof(QMTIK_QRequant));
+    if (!scale) return;
+    QMTIK_make_row_rq(scale, rows, row_rq);
+    QMTIK_write_section(writer, base+scale_off, scale, rows*sizeof(QMTIK_MainT));
+    QMTIK_write_section(writer, base+row_rq_off, row_rq, rows*sizeof(QMTIK_QRequant));
+}
+#ifdef QMTIK_PRUNE_PERCENT
+static inline uint8_t QMTIK_sparse_block_kept(const QMTIK_Model* model, size_t g, size_t c) {
+    for (size_t i=g*QMTIK_SPARSE_ROWS; i<QMTIK_H&&i<(g+1)*QMTIK_SPARSE_ROWS; ++i)
+        for (size_t j=c*QMTIK_SPARSE_BLOCK; j<QMTIK_I&&j<(c+1)*QMTIK_SPARSE_BLOCK; ++j) if (model->q_ih_wght[i][j]) return 1;
+    return 0;
+}
+static inline size_t QMTIK_count_sparse_blocks(const QMTIK_Model* model) {
+    size_t n=0;
+    for (size_t g=0; g<QMTIK_SPARSE_GROUPS; ++g) for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) n+=QMTIK_sparse_block_kept(model, g, c);
+    return n;
+}
+//Streams the block CSR input layer one pass per array, so no compressed copy is kept around
+static inline void QMTIK_write_sparse_layer(QMTIK_ModelWriter* writer, const QMTIK_Model* model) {
+    size_t base=offsetof(QMTIK_QModel, q_ih_layer), b=0;
+    for (size_t g=0; g<QMTIK_SPARSE_GROUPS; ++g) for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) if (QMTIK_sparse_block_kept(model, g, c)){
+        QMTIK_QWghtT block[QMTIK_SPARSE_ROWS][QMTIK_SPARSE_BLOCK]={{0}};
+        for (size_t r=0; r<QMTIK_SPARSE_ROWS&&g*QMTIK_SPARSE_ROWS+r<QMTIK_H; ++r)
+            for (size_t j=0; j<QMTIK_SPARSE_BLOCK&&c*QMTIK_SPARSE_BLOCK+j<QMTIK_I; ++j) block[r][j]=model->q_ih_wght[g*QMTIK_SPARSE_ROWS+r][c*QMTIK_SPARSE_BLOCK+j];
+        QMTIK_write_section(writer, base+offsetof(QMTIK_QIHLayer, q_ih_blocks)+b++*sizeof(block), block, sizeof(block));
+    }
+    b=0;
+    for (size_t g=0; g<QMTIK_SPARSE_GROUPS; ++g) for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) if (QMTIK_sparse_block_kept(model, g, c)){
+        uint16_t col=(uint16_t)c;
+        QMTIK_write_section(writer, base+offsetof(QMTIK_QIHLayer, q_ih_block_col)+b++*sizeof(col), &col, sizeof(col));
+    }
+    b=0;
+    for (size_t g=0; g<QMTIK_SPARSE_GROUPS; ++g){
+        for (size_t c=0; c<QMTIK_SPARSE_COLS; ++c) b+=QMTIK_sparse_block_kept(model, g, c);
+        uint32_t group_end=(uint32_t)b;
+        QMTIK_write_section(writer, base+offsetof(QMTIK_QIHLayer, q_ih_group_end)+g*sizeof(group_end), &group_end, sizeof(group_end));
+    }
+    for (size_t i=0; i<QMTIK_SPARSE_GROUPS*QMTIK_SPARSE_ROWS; ++i){
+        QMTIK_QAccT wsum=0;
+        for (size_t j=0; i<QMTIK_H&&j<QMTIK_I; ++j) wsum+=model->q_ih_wght[i][j];
+        QMTIK_write_section(writer, base+offsetof(QMTIK_QIHLayer, q_ih_wsum)+i*sizeof(wsum), &wsum, sizeof(wsum));
+    }
+    QMTIK_write_q_layer(writer, base, offsetof(QMTIK_QIHLayer, q_ih_bias), offsetof(QMTIK_QIHLayer, q_ih_bias), offsetof(QMTIK_QIHLayer, q_ih_acc_bias), offsetof(QMTIK_QIHLayer, q_ih_rq), NULL, model->q_ih_bias, QMTIK_H, 0, 2, 0, 0, NULL);
+}
+#endif
+//The canonical payload: row-major weights once, SIMD panels are repacked by the loaders
+static inline void QMTIK_write_q_model(QMTIK_ModelWriter* writer, const QMTIK_Model* model) {
+    #ifdef QMTIK_PRUNE_PERCENT
+        QMTIK_write_sparse_layer(writer, model);
+    #else
+        QMTIK_write_q_layer(writer, offsetof(QMTIK_QModel, q_ih_layer), offsetof(QMTIK_QIHLayer, q_ih_wght), offsetof(QMTIK_QIHLayer, q_ih_bias), offsetof(QMTIK_QIHLayer, q_ih_acc_bias), offsetof(QMTIK_QIHLayer, q_ih_rq), &model->q_ih_wght[0][0], model->q_ih_bias, QMTIK_H, QMTIK_I, 2, QMTIK_QROW_ARGS(QMTIK_QIHLayer, q_ih, model->q_ih_scale));
+    #endif
+    for (size_t l=0; l<QMTIK_L; ++l)
+        QMTIK_write_q_layer(writer, offsetof(QMTIK_QModel, q_hh_layers)+l*sizeof(QMTIK_QHHLayer), offsetof(QMTIK_QHHLayer, q_hh_wght), offsetof(QMTIK_QHHLayer, q_hh_bias), offsetof(QMTIK_QHHLayer, q_hh_acc_bias), offsetof(QMTIK_QHHLayer, q_hh_rq), &model->q_hh_wghts[l][0][0], model->q_hh_biases[l], QMTIK_H, QMTIK_H, 2, QMTIK_QROW_ARGS(QMTIK_QHHLayer, q_hh, model->q_hh_scales[l]));
+    QMTIK_write_q_layer(writer, offsetof(QMTIK_QModel, q_o_layer), offsetof(QMTIK_QOLayer, q_o_wght), offsetof(QMTIK_QOLayer, q_o_bias), offsetof(QMTIK_QOLayer, q_o_acc_bias), offsetof(QMTIK_QOLayer, q_o_rq), &model->q_o_wght[0][0], model->q_o_bias, QMTIK_O, QMTIK_H, 1, QMTIK_QROW_ARGS(QMTIK_QOLayer, q_o, model->q_o_scale));
+    #ifdef QMTIK_SKIP_ZERO_ACTV
+        QMTIK_QWghtT col[QMTIK_COL_STRIDE(QMTIK_H>QMTIK_O?QMTIK_H:QMTIK_O)];
+        size_t columns=offsetof(QMTIK_QModel, q_columns);
+        for (size_t l=0; l<QMTIK_L; ++l) for (size_t j=0; j<QMTIK_H; ++j){
+            QMTIK_gather_column(&model->q_hh_wghts[l][0][0], QMTIK_H, QMTIK_H, j, col);
+            QMTIK_write_section(writer, columns+offsetof(QMTIK_QColumns, q_hh_cols)+(l*QMTIK_H+j)*QMTIK_COL_STRIDE(QMTIK_H), col, QMTIK_COL_STRIDE(QMTIK_H));
+        }
+        for (size_t j=0; j<QMTIK_H; ++j){
+            QMTIK_gather_column(&model->q_o_wght[0][0], QMTIK_O, QMTIK_H, j, col);
+            QMTIK_write_section(writer, columns+offsetof(QMTIK_QColumns, q_o_cols)+j*QMTIK_COL_STRIDE(QMTIK_O), col, QMTIK_COL_STRIDE(QMTIK_O));
+        }
+    #endif
+    QMTIK_write_section(writer, QMTIK_QMODEL_CORE_SIZE, NULL, 0);
+}
+uint8_t QMTIK_store_model(QMTIK_Model* model, FILE* q_model_file){
+    QMTIK_ModelHeader header={QMTIK_MODEL_MAGIC, QMTIK_MODEL_VERSION, sizeof(QMTIK_ModelHeader), QMTIK_I, QMTIK_H, QMTIK_L, QMTIK_O, QMTIK_W_SCALE, QMTIK_A_SCALE, QMTIK_ACTV_ID, QMTIK_PP_ID, QMTIK_MODEL_WGHT_FLAG|QMTIK_MODEL_SPARSE_FLAG|QMTIK_MODEL_COLUMNS_FLAG, QMTIK_QMODEL_CORE_SIZE, 0, 0};
+    QMTIK_ModelWriter writer={NULL, 0, QMTIK_CHECKSUM_INIT, 0};
+    #ifdef QMTIK_PRUNE_PERCENT
+        size_t kept=QMTIK_count_sparse_blocks(model);
+        if (kept>QMTIK_SPARSE_KEPT) {fprintf(stderr, "[QMTIK] Input layer keeps %zu weight blocks, QMTIK_PRUNE_PERCENT leaves room for %zu\n", kept, (size_t)QMTIK_SPARSE_KEPT); return 1;}
+    #endif
+    //a first pass without a file only sums the checksum, so the header goes out once and pipes work
+    QMTIK_write_q_model(&writer, model);
+    header.checksum=writer.checksum;
+    if (fwrite(&header, sizeof(header), 1, q_model_file)!=1) {perror("[QMTIK] Failed to write model file"); return 1;}
+    writer=(QMTIK_ModelWriter){q_model_file, 0, QMTIK_CHECKSUM_INIT, 0};
+    QMTIK_write_q_model(&writer, model);
+    if (writer.failed) {perror("[QMTIK] Failed to write model file"); return 1;}
+    return 0;
+}
+static inline uint8_t QMTIK_check_model_header(const QMTIK_ModelHeader* header) {
+    if (header->version!=QMTIK_MODEL_VERSION||header->header_size!=sizeof(QMTIK_ModelHeader)) {fprintf(stderr, "[QMTIK] Unsupported model file version %u\n", header->version); return 1;}
+    if (header->i!=QMTIK_I||header->h!=QMTIK_H||header->l!=QMTIK_L||header->o!=QMTIK_O) {fprintf(stderr, "[QMTIK] Model topology %u-%ux%u-%u does not match config\n", header->i, header->h, header->l, header->o); return 1;}
+    if (header->w_scale!=QMTIK_W_SCALE||header->a_scale!=QMTIK_A_SCALE) {fprintf(stderr, "[QMTIK] Model scales do not match config\n"); return 1;}
+    if (header->actv_id!=QMTIK_ACTV_ID||header->pp_id!=QMTIK_PP_ID) {fprintf(stderr, "[QMTIK] Model activation or post processing does not match config\n"); return 1;}
+    if ((header->flags&(QMTIK_MODEL_FLAG_INT4|QMTIK_MODEL_FLAG_SPARSE|QMTIK_MODEL_FLAG_COLUMNS))!=(QMTIK_MODEL_WGHT_FLAG|QMTIK_MODEL_SPARSE_FLAG|QMTIK_MODEL_COLUMNS_FLAG)) {fprintf(stderr, "[QMTIK] Model weight layout does not match config (QMTIK_INT4_WGHT, QMTIK_PRUNE_PERCENT, QMTIK_SKIP_ZERO_ACTV)\n"); return 1;}
+    if ((header->flags&QMTIK_MODEL_FLAG_PANELS)?header->payload_size<=QMTIK_QMODEL_CORE_SIZE:header->payload_size!=QMTIK_QMODEL_CORE_SIZE) {fprintf(stderr, "[QMTIK] Model payload size does not match config\n"); return 1;}
+    return 0;
+}
+static inline uint8_t QMTIK_load_legacy_q_model(QMTIK_QModel* q_model, FILE* q_model_file) {
+    #if !QMTIK_DENSE_INFER
+        (void)q_model; (void)q_model_file;
+        fprintf(stderr, "[QMTIK] Headerless QMTIK 1.0 model files hold dense INT8 weights, load them without QMTIK_INT4_WGHT or QMTIK_PRUNE_PERCENT\n");
+        return 1;
+    #else
+    uint8_t ok=fread(q_model->q_ih_layer.q_ih_wght, sizeof(q_model->q_ih_layer.q_ih_wght), 1, q_model_file)==1;
+    ok=ok&&fread(q_model->q_ih_layer.q_ih_bias, sizeof(q_model->q_ih_layer.q_ih_bias), 1, q_model_file)==1;
+    for (size_t l=0; l<QMTIK_L; ++l) ok=ok&&fread(q_model->q_hh_layers[l].q_hh_wght, sizeof(q_model->q_hh_layers[l].q_hh_wght), 1, q_model_file)==1;
+    for (size_t l=0; l<QMTIK_L; ++l) ok=ok&&fread(q_model->q_hh_layers[l].q_hh_bias, sizeof(q_model->q_hh_layers[l].q_hh_bias), 1, q_model_file)==1;
+    ok=ok&&fread(q_model->q_o_layer.q_o_wght, sizeof(q_model->q_o_layer.q_o_wght), 1, q_model_file)==1;
+    ok=ok&&fread(q_model->q_o_layer.q_o_bias, sizeof(q_model->q_o_layer.q_o_bias), 1, q_model_file)==1;
+    if (!ok) {perror("[QMTIK] Failed to read model file"); return 1;}
+    QMTIK_prepare_q_model(q_model);
+    return 0;
+    #endif
+}
+uint8_t QMTIK_load_model(QMTIK_QNetwork* q_network, FILE* q_model_file) {return QMTIK_load_q_model(&q_network->q_model, q_model_file);}
+uint8_t QMTIK_load_q_model(QMTIK_QModel* q_model, FILE* q_model_file) {
+    QMTIK_ModelHeader header;
+    long start=ftell(q_model_file);
+    if (fread(&header, sizeof(header), 1, q_model_file)!=1||memcmp(header.magic, QMTIK_MODEL_MAGIC, sizeof(header.magic))){
+        if (start<0||fseek(q_model_file, start, SEEK_SET)) {perror("[QMTIK] Failed to read model file"); return 1;}
+        return QMTIK_load_legacy_q_model(q_model, q_model_file);
+    }
+    if (QMTIK_check_model_header(&header)) return 1;
+    if (fread(q_model, QMTIK_QMODEL_CORE_SIZE, 1, q_model_file)!=1) {perror("[QMTIK] Failed to read model file"); return 1;}
+    uint32_t checksum=QMTIK_checksum(QMTIK_CHECKSUM_INIT, q_model, QMTIK_QMODEL_CORE_SIZE);
+    size_t remaining=header.payload_size-QMTIK_QMODEL_CORE_SIZE;
+    #ifdef QMTIK_SIMD
+        if (remaining==sizeof(QMTIK_QPanels)){
+            if (fread(&q_model->q_panels, sizeof(QMTIK_QPanels), 1, q_model_file)!=1) {perror("[QMTIK] Failed to read model file"); return 1;}
+            checksum=QMTIK_checksum(checksum, &q_model->q_panels, sizeof(QMTIK_QPanels));
+            remaining=0;
+        }
+        else QMTIK_prepare_q_panels(q_model);
+    #endif
+    while (remaining){
+        uint8_t chunk[4096];
+        size_t n=(remaining<sizeof(chunk))?remaining:sizeof(chunk);
+        if (fread(chunk, n, 1, q_model_file)!=1) {perror("[QMTIK] Failed to read model file"); return 1;}
+        checksum=QMTIK_checksum(checksum, chunk, n);
+        remaining-=n;
+    }
+    if (checksum!=header.checksum) {fprintf(stderr, "[QMTIK] Model file checksum mismatch\n"); return 1;}
+    QMTIK_select_kernel();
+    return 0;
+}
+#ifdef QMTIK_MMAP
+#ifdef QMTIK_SIMD
+//Panels of a file without them are repacked into anonymous pages behind a private mapping of the file, the
+//weight pages stay shared with the page cache and the whole model is read only again afterwards
+static inline void* QMTIK_map_with_panels(int fd, size_t file_size, size_t* size) {
+    size_t page=(size_t)sysconf(_SC_PAGESIZE);
+    size_t total=QMTIK_ROUND_UP(sizeof(QMTIK_ModelHeader)+sizeof(QMTIK_QModel), page), file_pages=QMTIK_ROUND_UP(file_size, page);
+    uint8_t* base=(uint8_t*)mmap(NULL, total, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (base==MAP_FAILED) return NULL;
+    if (mmap(base, (file_pages<total)?file_pages:total, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, 0)==MAP_FAILED) {munmap(base, total); return NULL;}
+    QMTIK_prepare_q_panels((QMTIK_QModel*)(base+sizeof(QMTIK_ModelHeader)));
+    mprotect(base, total, PROT_READ);
+    *size=total;
+    return base;
+}
+#endif
+uint8_t QMTIK_map_model(QMTIK_MappedModel* mapped, const char* path) {
+    struct stat st;
+    int fd=open(path, O_RDONLY);
+    if (fd<0) {perror("[QMTIK] Failed to open model file"); return 1;}
+    if (fstat(fd, &st)||(size_t)st.st_size<sizeof(QMTIK_ModelHeader)) {fprintf(stderr, "[QMTIK] Model file too small\n"); close(fd); return 1;}
+    size_t size=(size_t)st.st_size;
+    void* base=mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base==MAP_FAILED) {perror("[QMTIK] Failed to map model file"); close(fd); return 1;}
+    const QMTIK_ModelHeader* header=(const QMTIK_ModelHeader*)base;
+    uint8_t bad=memcmp(header->magic, QMTIK_MODEL_MAGIC, sizeof(header->magic))!=0;
+    if (bad) fprintf(stderr, "[QMTIK] Model file has no header, use QMTIK_load_model\n");
+    bad=bad||QMTIK_check_model_header(header);
+    if (!bad&&header->header_size+(size_t)header->payload_size>size) {fprintf(stderr, "[QMTIK] Model file is truncated\n"); bad=1;}
+    if (!bad&&QMTIK_checksum(QMTIK_CHECKSUM_INIT, (const uint8_t*)base+header->header_size, header->payload_size)!=header->checksum) {fprintf(stderr, "[QMTIK] Model file checksum mismatch\n"); bad=1;}
+    #ifdef QMTIK_SIMD
+        //panels written by older SIMD builds are used in place, canonical files get theirs repacked
+        if (!bad&&header->payload_size<sizeof(QMTIK_QModel)){
+            void* panel_base=QMTIK_map_with_panels(fd, (size_t)st.st_size, &size);
+            munmap(base, (size_t)st.st_size);
+            base=panel_base;
+            if (!base) {perror("[QMTIK] Failed to map model file"); close(fd); return 1;}
+        }
+    #endif
+    close(fd);
+    if (bad) {munmap(base, size); return 1;}
+    mapped->base=base;
+    mapped->size=size;
+    mapped->q_model=(const QMTIK_QModel*)((const uint8_t*)base+sizeof(QMTIK_ModelHeader));
+    QMTIK_select_kernel();
+    return 0;
+}
+void QMTIK_unmap_model(QMTIK_MappedModel* mapped) {
+    if (mapped->base) munmap(mapped->base, mapped->size);
+    mapped->base=NULL; mapped->size=0; mapped->q_model=NULL;
+}
+//msync wants a page aligned start, pages can be larger than the 4KB the slots are aligned to
+static inline uint8_t QMTIK_msync_range(void* start, size_t size) {
+    size_t page=(size_t)sysconf(_SC_PAGESIZE), offset=(size_t)(uintptr_t)start%page;
+    if (msync((uint8_t*)start-offset, size+offset, MS_SYNC)) {perror("[QMTIK] Failed to sync checkpoint"); return 1;}
+    return 0;
+}
+//every is the number of samples between snapshots, 0 only takes them at epoch ends
+uint8_t QMTIK_open_checkpoint(QMTIK_Checkpoint* checkpoint, const char* path, size_t every) {
+    struct stat st;
+    size_t size=QMTIK_CHECKPOINT_OFFSET+3*QMTIK_CHECKPOINT_STRIDE;
+    memset(checkpoint, 0, sizeof(QMTIK_Checkpoint));
+    int fd=open(path, O_RDWR|O_CREAT, 0644);
+    if (fd<0) {perror("[QMTIK] Failed to open checkpoint file"); return 1;}
+    if (fstat(fd, &st)) {perror("[QMTIK] Failed to stat checkpoint file"); close(fd); return 1;}
+    uint8_t fresh=(st.st_size==0);
+    if (!fresh&&(size_t)st.st_size!=size) {fprintf(stderr, "[QMTIK] Checkpoint file size does not match this build's QMTIK_Network\n"); close(fd); return 1;}
+    if (fresh&&ftruncate(fd, (off_t)size)) {perror("[QMTIK] Failed to size checkpoint file"); close(fd); return 1;}
+    void* base=mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base==MAP_FAILED) {perror("[QMTIK] Failed to map checkpoint file"); return 1;}
+    QMTIK_CheckpointHeader* header=(QMTIK_CheckpointHeader*)base;
+    //a file cut short before its header was written starts over
+    if (!fresh&&!header->version&&!header->slot_seq[0]&&!header->slot_seq[1]) fresh=1;
+    if (fresh){
+        memcpy(header->magic, QMTIK_CHECKPOINT_MAGIC, sizeof(header->magic));
+        header->version=QMTIK_CHECKPOINT_VERSION; header->header_size=QMTIK_CHECKPOINT_OFFSET;
+        header->i=QMTIK_I; header->h=QMTIK_H; header->l=QMTIK_L; header->o=QMTIK_O; header->train_batch=QMTIK_TRAIN_BATCH;
+        header->network_size=sizeof(QMTIK_Network);
+    }
+    else if (memcmp(header->magic, QMTIK_CHECKPOINT_MAGIC, sizeof(header->magic))||header->version!=QMTIK_CHECKPOINT_VERSION||header->header_size!=QMTIK_CHECKPOINT_OFFSET||header->network_size!=sizeof(QMTIK_Network)
+        ||header->i!=QMTIK_I||header->h!=QMTIK_H||header->l!=QMTIK_L||header->o!=QMTIK_O||header->train_batch!=QMTIK_TRAIN_BATCH){
+        fprintf(stderr, "[QMTIK] Checkpoint file does not match config\n");
+        munmap(base, size);
+        return 1;
+    }
+    checkpoint->header=header;
+    checkpoint->network=(QMTIK_Network*)((uint8_t*)base+QMTIK_CHECKPOINT_OFFSET);
+    checkpoint->base=base;
+    checkpoint->size=size;
+    checkpoint->every=every;
+    //the live network may hold batches trained after the newest snapshot, or half of one
+    size_t s=header->slot_seq[1]>header->slot_seq[0];
+    checkpoint->resumed=header->slot_seq[s]!=0;
+    if (checkpoint->resumed){
+        memcpy(checkpoint->network, QMTIK_CHECKPOINT_SLOT(base, s), sizeof(QMTIK_Network));
+        header->epoch=header->slot_epoch[s]; header->sample=header->slot_sample[s];
+    }
+    else header->epoch=header->sample=0;
+    return 0;
+}
+//Snapshots the live network into the older slot: the slot is invalidated, filled and synced before its
+//sequence number makes it the newest, so a crash between any two steps still leaves the other slot intact
+uint8_t QMTIK_sync_checkpoint(QMTIK_Checkpoint* checkpoint) {
+    QMTIK_CheckpointHeader* header=checkpoint->header;
+    size_t s=header->slot_seq[0]>header->slot_seq[1];
+    uint8_t* slot=QMTIK_CHECKPOINT_SLOT(checkpoint->base, s);
+    header->slot_seq[s]=0;
+    header->slot_epoch[s]=header->epoch; header->slot_sample[s]=header->sample;
+    if (QMTIK_msync_range(header, QMTIK_CHECKPOINT_OFFSET)) return 1;
+    memcpy(slot, checkpoint->network, sizeof(QMTIK_Network));
+    if (QMTIK_msync_range(slot, sizeof(QMTIK_Network))) return 1;
+    header->slot_seq[s]=header->slot_seq[s^1]+1;
+    return QMTIK_msync_range(header, QMTIK_CHECKPOINT_OFFSET);
+}
+//Trains the mapped network from the checkpoint position to QMTIK_EPOCHS, on train_file or dataset (the other one NULL)
+uint8_t QMTIK_resume_training(QMTIK_Checkpoint* checkpoint, FILE* train_file, QMTIK_Dataset* dataset, QMTIK_TrainContext* contexts, size_t n_threads) {
+    QMTIK_Network* network=checkpoint->network;
+    if (!train_file==!dataset) {fprintf(stderr, "[QMTIK] Resumed training needs exactly one of train_file and dataset\n"); return 1;}
+    #ifndef QMTIK_THREADS
+        n_threads=0;
+    #endif
+    //a fresh run snapshots its initial weights, the live ones change from the first batch on
+    if (!checkpoint->header->slot_seq[0]&&!checkpoint->header->slot_seq[1]&&QMTIK_sync_checkpoint(checkpoint)) return 1;
+    if (!n_threads||!contexts) QMTIK_train_epochs(network, train_file, dataset, &network->train_context, 1, checkpoint, NULL);
+    else QMTIK_train_epochs(network, train_file, dataset, contexts, (n_threads>QMTIK_MAX_THREADS)?QMTIK_MAX_THREADS:n_threads, checkpoint, NULL);
+    return QMTIK_sync_checkpoint(checkpoint);
+}
+void QMTIK_close_checkpoint(QMTIK_Checkpoint* checkpoint) {
+    if (checkpoint->base) munmap(checkpoint->base, checkpoint->size);
+    memset(checkpoint, 0, sizeof(QMTIK_Checkpoint));
+}
+#endif
+//==================================================
+//Flat static const arrays, so the compiled model lives in .rodata and needs no brace nesting per dimension
+static inline void QMTIK_emit_array(FILE* c_file, const char* type, const char* name, const char* array, const void* data, size_t size, size_t n) {
+    fprintf(c_file, "static const %s %s_%s[%zu]={", type, name, array, n?n:1);
+    for (size_t i=0; i<n; ++i){
+        long long v=(size==1)?((const int8_t*)data)[i]:(size==2)?((const uint16_t*)data)[i]:((const int32_t*)data)[i];
+        fprintf(c_file, "%s%lld,", (i%32)?"":"\n    ", v);
+    }
+    fprintf(c_file, n?"\n};\n":"0};\n");
+}
+//rows x k dense or INT4 layer over the <name>_<layer>_* arrays, out is the statement storing acc for row i
+static inline void QMTIK_emit_layer(FILE* c_file, const char* name, const char* layer, size_t rows, size_t k, const char* x, const char* out, unsigned unroll) {
+    fprintf(c_file, "    for (int i=0; i<%zu; ++i){\n        int32_t acc=0;\n", rows);
+    if (unroll>1) fprintf(c_file, "        #pragma GCC unroll %u\n", unroll);
+    #ifdef QMTIK_INT4_WGHT
+        fprintf(c_file, "        for (int j=0; j<%zu; ++j) acc+=%s_w4(%s_%s_wght+i*%zu, j)*%s[j];\n", k, name, name, layer, (size_t)QMTIK_WGHT_ROW(k), x);
+        fprintf(c_file, "        acc=%s_%s_bias[i]+%s_requantize(acc, %s_%s_rq[2*i], %s_%s_rq[2*i+1]);\n", name, layer, name, name, layer, name, layer);
+    #else
+        fprintf(c_file, "        for (int j=0; j<%zu; ++j) acc+=%s_%s_wght[i*%zu+j]*%s[j];\n", k, name, layer, k, x);
+        fprintf(c_file, "        acc+=%s_%s_bias[i];\n", name, layer);
+    #endif
+    fprintf(c_file, "        %s\n    }\n", out);
+}
+//Emits <name>.c and <name>.h with a standalone int8_t forward pass <name>_infer, bit-exact with QMTIK_infer
+uint8_t QMTIK_compile_model(const QMTIK_QModel* q_model, const char* name, unsigned unroll, FILE* c_file, FILE* h_file) {
+    const QMTIK_QRequant* rq=q_model->q_ih_layer.q_ih_rq;
+    char out[256], x[64];
+    fprintf(h_file, "//Generated by QMTIK_compile_model, QMTIK %s\n#pragma once\n#include <stdint.h>\n", QMTIK_VERSION);
+    fprintf(h_file, "void %s_infer(const int8_t input[%d], int8_t output[%d]);\n", name, QMTIK_I, QMTIK_O);
+    fprintf(c_file, "//Generated by QMTIK_compile_model, QMTIK %s\n#include \"%s.h\"\n", QMTIK_VERSION, name);
+    #ifdef QMTIK_PRUNE_PERCENT
+        size_t kept=q_model->q_ih_layer.q_ih_group_end[QMTIK_SPARSE_GROUPS-1];
+        QMTIK_emit_array(c_file, "int8_t", name, "ih_blocks", q_model->q_ih_layer.q_ih_blocks, 1, kept*QMTIK_SPARSE_ROWS*QMTIK_SPARSE_BLOCK);
+        QMTIK_emit_array(c_file, "uint16_t", name, "ih_col", q_model->q_ih_layer.q_ih_block_col, 2, kept);
+        QMTIK_emit_array(c_file, "uint32_t", name, "ih_end", q_model->q_ih_layer.q_ih_group_end, 4, QMTIK_SPARSE_GROUPS);
+    #else
+        QMTIK_emit_array(c_file, "int8_t", name, "ih_wght", q_model->q_ih_layer.q_ih_wght, 1, sizeof(q_model->q_ih_layer.q_ih_wght));
+    #endif
+    QMTIK_emit_array(c_file, "int32_t", name, "ih_bias", q_model->q_ih_layer.q_ih_acc_bias, 4, QMTIK_H);
+    for (size_t l=0; l<QMTIK_L; ++l){
+        snprintf(x, sizeof(x), "hh%zu_wght", l);
+        QMTIK_emit_array(c_file, "int8_t", name, x, q_model->q_hh_layers[l].q_hh_wght, 1, sizeof(q_model->q_hh_layers[l].q_hh_wght));
+        snprintf(x, sizeof(x), "hh%zu_bias", l);
+        QMTIK_emit_array(c_file, "int32_t", name, x, q_model->q_hh_layers[l].q_hh_acc_bias, 4, QMTIK_H);
+    }
+    QMTIK_emit_array(c_file, "int8_t", name, "o_wght", q_model->q_o_layer.q_o_wght, 1, sizeof(q_model->q_o_layer.q_o_wght));
+    QMTIK_emit_array(c_file, "int32_t", name, "o_bias", q_model->q_o_layer.q_o_acc_bias, 4, QMTIK_O);
+    QMTIK_build_luts();
+    #if defined(QMTIK_SIGMOID_ACTV)||defined(QMTIK_TANH_ACTV)
+        QMTIK_emit_array(c_file, "int32_t", name, "steps", QMTIK_actv_lut.step, 4, 255);
+    #endif
+    #if defined(QMTIK_SOFT_MAX_PP)
+        QMTIK_emit_array(c_file, "int32_t", name, "exp", QMTIK_pp_lut.exp, 4, 256);
+    #elif defined(QMTIK_SIGMOID_PP)
+        QMTIK_emit_array(c_file, "int8_t", name, "sigmoid", QMTIK_pp_lut.sigmoid, 1, 256);
+    #endif
+    #ifdef QMTIK_INT4_WGHT
+        QMTIK_emit_array(c_file, "int32_t", name, "ih_rq", q_model->q_ih_layer.q_ih_row_rq, 4, 2*QMTIK_H);
+        for (size_t l=0; l<QMTIK_L; ++l){
+            snprintf(x, sizeof(x), "hh%zu_rq", l);
+            QMTIK_emit_array(c_file, "int32_t", name, x, q_model->q_hh_layers[l].q_hh_row_rq, 4, 2*QMTIK_H);
+        }
+        QMTIK_emit_array(c_file, "int32_t", name, "o_rq", q_model->q_o_layer.q_o_row_rq, 4, 2*QMTIK_O);
+        fprintf(c_file, "static inline int32_t %s_w4(const int8_t* row, int j) {return ((((uint8_t)row[j>>1]>>(4*(j&1)))&0xF)^8)-8;}\n", name);
+    #endif
+    fprintf(c_file, "static inline int32_t %s_requantize(int32_t acc, int32_t mult, int32_t shift) {return (int32_t)(((int64_t)acc*mult+((int64_t)1<<(shift-1)))>>shift);}\n", name);
+    fprintf(c_file, "static inline int8_t %s_saturate(int32_t x) {return (int8_t)(x>%d?%d:(x<%d?%d:x));}\n", name, QMTIK_QActvT_MAX, QMTIK_QActvT_MAX, QMTIK_QActvT_MIN, QMTIK_QActvT_MIN);
+    fprintf(c_file, "static inline int8_t %s_activation(int32_t acc) {", name);
+    #if defined(QMTIK_RELU_ACTV)
+        fprintf(c_file, "return acc>0?%s_saturate(%s_requantize(acc, %d, %d)):0;}\n", name, name, rq[0].mult, rq[0].shift);
+    #elif defined(QMTIK_LEAKY_RELU_ACTV)
+        fprintf(c_file, "return %s_saturate(acc>0?%s_requantize(acc, %d, %d):%s_requantize(acc, %d, %d));}\n", name, name, rq[0].mult, rq[0].shift, name, rq[1].mult, rq[1].shift);
+    #else
+        (void)rq;
+        fprintf(c_file, "int v=0; for (int s=128; s; s>>=1) v+=(acc>%s_steps[v+s-1])?s:0; return (int8_t)(%d+v);}\n", name, (int)QMTIK_actv_lut.low);
+    #endif
+    fprintf(c_file, "void %s_infer(const int8_t input[%d], int8_t output[%d]) {\n    int8_t actv[2][%d];\n", name, QMTIK_I, QMTIK_O, QMTIK_H);
+    #ifdef QMTIK_PRUNE_PERCENT
+        fprintf(c_file, "    for (int g=0, b=0; g<%d; ++g){\n        int32_t sum[%d]={0};\n", QMTIK_SPARSE_GROUPS, QMTIK_SPARSE_ROWS);
+        fprintf(c_file, "        for (; b<(int)%s_ih_end[g]; ++b) for (int r=0; r<%d; ++r) for (int j=0; j<%d&&%s_ih_col[b]*%d+j<%d; ++j) sum[r]+=%s_ih_blocks[b*%d+r*%d+j]*input[%s_ih_col[b]*%d+j];\n",
+            name, QMTIK_SPARSE_ROWS, QMTIK_SPARSE_BLOCK, name, QMTIK_SPARSE_BLOCK, QMTIK_I, name, QMTIK_SPARSE_ROWS*QMTIK_SPARSE_BLOCK, QMTIK_SPARSE_BLOCK, name, QMTIK_SPARSE_BLOCK);
+        fprintf(c_file, "        for (int r=0; r<%d&&g*%d+r<%d; ++r) actv[0][g*%d+r]=%s_activation(%s_ih_bias[g*%d+r]+sum[r]);\n    }\n", QMTIK_SPARSE_ROWS, QMTIK_SPARSE_ROWS, QMTIK_H, QMTIK_SPARSE_ROWS, name, name, QMTIK_SPARSE_ROWS);
+    #else
+        snprintf(out, sizeof(out), "actv[0][i]=%s_activation(acc);", name);
+        QMTIK_emit_layer(c_file, name, "ih", QMTIK_H, QMTIK_I, "input", out, unroll);
+    #endif
+    for (size_t l=0; l<QMTIK_L; ++l){
+        char layer[32];
+        snprintf(layer, sizeof(layer), "hh%zu", l);
+        snprintf(x, sizeof(x), "actv[%zu]", l&1);
+        snprintf(out, sizeof(out), "actv[%zu][i]=%s_activation(acc);", (l+1)&1, name);
+        QMTIK_emit_layer(c_file, name, layer, QMTIK_H, QMTIK_H, x, out, unroll);
+    }
+    snprintf(x, sizeof(x), "actv[%d]", QMTIK_L&1);
+    snprintf(out, sizeof(out), "output[i]=%s_saturate(%s_requantize(acc, %d, %d));", name, name, q_model->q_o_layer.q_o_rq.mult, q_model->q_o_layer.q_o_rq.shift);
+    QMTIK_emit_layer(c_file, name, "o", QMTIK_O, QMTIK_H, x, out, unroll);
+    #if defined(QMTIK_SOFT_MAX_PP)
+        fprintf(c_file, "    int8_t max_z=output[0];\n    uint64_t sum=0, recip;\n    for (int i=1; i<%d; ++i) if (output[i]>max_z) max_z=output[i];\n", QMTIK_O);
+        fprintf(c_file, "    for (int i=0; i<%d; ++i) sum+=(uint32_t)%s_exp[max_z-output[i]];\n    recip=((127ull<<40)+sum-1)/sum;\n", QMTIK_O, name);
+        fprintf(c_file, "    for (int i=0; i<%d; ++i) output[i]=(int8_t)(((uint32_t)%s_exp[max_z-output[i]]*recip+(1ull<<39))>>40);\n", QMTIK_O, name);
+    #elif defined(QMTIK_SIGMOID_PP)
+        fprintf(c_file, "    for (int i=0; i<%d; ++i) output[i]=%s_sigmoid[output[i]+%d];\n", QMTIK_O, name, -QMTIK_QActvT_MIN);
+    #endif
+    fprintf(c_file, "}\n");
+    if (ferror(c_file)||ferror(h_file)) {perror("[QMTIK] Failed to write compiled model"); return 1;}
+    return 0;
+}
+//==================================================
+static inline uint8_t QMTIK_rt_check_desc(const QMTIK_RtDesc* desc) {
+    if (!desc->n_layers||desc->n_layers>QMTIK_RT_MAX_LAYERS) {fprintf(stderr, "[QMTIK] Runtime network needs 1 to %d layers\n", QMTIK_RT_MAX_LAYERS); return 1;}
+    for (size_t l=0; l<=desc->n_layers; ++l) if (!desc->widths[l]) {fprintf(stderr, "[QMTIK] Runtime network width %zu is zero\n", l); return 1;}
+    for (size_t l=0; l<desc->n_layers; ++l) if (desc->actvs[l]>QMTIK_RT_TANH) {fprintf(stderr, "[QMTIK] Runtime network layer %zu has unknown activation %u\n", l, desc->actvs[l]); return 1;}
+    if (desc->pp_id<1||desc->pp_id>3||!(desc->w_scale>0)||!(desc->a_scale>0)) {fprintf(stderr, "[QMTIK] Runtime network post processing or scales are invalid\n"); return 1;}
+    return 0;
+}
+//Lays the layers, post processing tables, gather map and per layer weights, biases, folds and sigmoid/tanh table out from base
+//Scratch: accumulators, one activation buffer per layer parity (layer l only reads l-1) sized for its widest layer, gathered input
+//With base==NULL only the arena size is computed
+static inline size_t QMTIK_rt_layout(const QMTIK_RtDesc* desc, uint8_t* base, QMTIK_RtNetwork* rt) {
+    size_t lut_off=QMTIK_ROUND_UP(desc->n_layers*sizeof(QMTIK_RtLayer), 64), max_out=0, buf[2]={0, 0};
+    size_t gather_off=lut_off+QMTIK_ROUND_UP(sizeof(QMTIK_QPpLut), 64);
+    size_t off=gather_off+QMTIK_ROUND_UP(desc->widths[0]*sizeof(uint32_t), 64);
+    for (size_t l=0; l<desc->n_layers; ++l){
+        size_t in=desc->widths[l], out=desc->widths[l+1];
+        QMTIK_RtLayer* layer=base?(QMTIK_RtLayer*)base+l:NULL;
+        if (layer) {layer->in=(uint32_t)in; layer->out=(uint32_t)out; layer->actv=desc->actvs[l]; layer->panel=NULL; layer->wsum=NULL; layer->steps=NULL;}
+        if (layer) {layer->w_scale=desc->w_scale; layer->a_scale=desc->a_scale;}
+        if (layer) layer->wght=(QMTIK_QWghtT*)(base+off);
+        off+=QMTIK_ROUND_UP(out*in, 64);
+        if (layer) layer->bias=(QMTIK_QWghtT*)(base+off);
+        off+=QMTIK_ROUND_UP(out, 64);
+        if (layer) layer->acc_bias=(QMTIK_QAccT*)(base+off);
+        off+=QMTIK_ROUND_UP(out*sizeof(QMTIK_QAccT), 64);
+        if (layer) layer->acc_fold=(QMTIK_QAccT*)(base+off);
+        off+=QMTIK_ROUND_UP(out*sizeof(QMTIK_QAccT), 64);
+        if (desc->actvs[l]>=QMTIK_RT_SIGMOID){
+            if (layer) layer->steps=(QMTIK_QStepLut*)(base+off);
+            off+=QMTIK_ROUND_UP(sizeof(QMTIK_QStepLut), 64);
+        }
+        #if defined(QMTIK_SIMD)&&QMTIK_WGHT_BITS==8
+            if (layer) {layer->panel=(QMTIK_QWghtT*)(base+off); layer->wsum=(QMTIK_QAccT*)(base+off+QMTIK_PANEL_SIZE(out, in));}
+            off+=QMTIK_PANEL_SIZE(out, in)+QMTIK_ROUND_UP(out, QMTIK_PANEL_R)*sizeof(QMTIK_QAccT);
+        #endif
+        if (out>max_out) max_out=out;
+        if (l+1<desc->n_layers&&out>buf[l&1]) buf[l&1]=out;
+    }
+    if (rt){
+        rt->n_layers=desc->n_layers; rt->pp_id=desc->pp_id; rt->w_scale=desc->w_scale; rt->a_scale=desc->a_scale;
+        rt->layers=(QMTIK_RtLayer*)base;
+        rt->pp_lut=(QMTIK_QPpLut*)(base+lut_off);
+        rt->gather=(uint32_t*)(base+gather_off); rt->n_inputs=0;
+        rt->buf_off[0]=QMTIK_ROUND_UP(max_out, QMTIK_PANEL_R)*sizeof(QMTIK_QAccT);
+        rt->buf_off[1]=rt->buf_off[0]+QMTIK_ROUND_UP(buf[0], 64);
+        rt->buf_off[2]=rt->buf_off[1]+QMTIK_ROUND_UP(buf[1], 64);
+        rt->scratch_size=rt->buf_off[2]+QMTIK_ROUND_UP(desc->widths[0], 64);
+    }
+    return off;
+}
+//Accumulators are in units of w_scale times the input scale, requantization brings them to the layer's a_scale
+static inline void QMTIK_rt_prepare_layer(const QMTIK_RtNetwork* rt, QMTIK_RtLayer* layer) {
+    size_t l=(size_t)(layer-rt->layers);
+    QMTIK_MainT a_in=l?rt->layers[l-1].a_scale:rt->a_scale, m=layer->w_scale*a_in/layer->a_scale;
+    layer->rq[0]=QMTIK_rt_make_requant(m); layer->rq[1]=QMTIK_rt_make_requant(m*QMTIK_LEAK);
+    for (size_t i=0; i<layer->out; ++i) layer->acc_bias[i]=(QMTIK_QAccT)lroundf(layer->bias[i]/a_in)+layer->acc_fold[i];
+    if (layer->steps) QMTIK_build_steps(layer->steps, layer->w_scale*a_in, layer->a_scale, layer->actv);
+    if (l+1==rt->n_layers) QMTIK_build_pp_lut(rt->pp_lut, layer->a_scale);
+    #if defined(QMTIK_SIMD)&&QMTIK_WGHT_BITS==8
+        QMTIK_repack_panel(layer->wght, layer->out, layer->in, layer->panel, layer->wsum);
+    #endif
+}
+//Even multipliers are halved into the shift, which keeps the result, so power-of-two scales requantize with mult 1
+static inline QMTIK_QRequant QMTIK_rt_make_requant(QMTIK_MainT m) {
+    QMTIK_QRequant rq=QMTIK_make_requant(m);
+    while (rq.mult&&!(rq.mult&1)&&rq.shift>1) {rq.mult>>=1; --rq.shift;}
+    return rq;
+}
+//A rounding shift without the 64 bit multiply
+static inline int32_t QMTIK_rt_requantize(QMTIK_QAccT acc, QMTIK_QRequant rq) {return (rq.mult==1)?(int32_t)(((int64_t)acc+((int64_t)1<<(rq.shift-1)))>>rq.shift):QMTIK_requantize(acc, rq);}
+static inline QMTIK_QActvT QMTIK_rt_activation(const QMTIK_RtNetwork* rt, const QMTIK_RtLayer* layer, QMTIK_QAccT acc) {
+    (void)rt;
+    if (layer->actv==QMTIK_RT_RELU) return acc>0?QMTIK_saturate_a(QMTIK_rt_requantize(acc, layer->rq[0])):0;
+    if (layer->actv==QMTIK_RT_LEAKY_RELU) return QMTIK_saturate_a(QMTIK_rt_requantize(acc, layer->rq[acc>0?0:1]));
+    if (layer->actv==QMTIK_RT_LINEAR) return QMTIK_saturate_a(QMTIK_rt_requantize(acc, layer->rq[0]));
+    return QMTIK_step_lookup(layer->steps, acc);
+}
+static inline void QMTIK_rt_post_process(const QMTIK_RtNetwork* rt, QMTIK_QActvT* z, size_t n) {
+    if (rt->pp_id==2) QMTIK_softmax_q(rt->pp_lut, z, n);
+    if (rt->pp_id==3) for (size_t i=0; i<n; ++i) z[i]=rt->pp_lut->sigmoid[z[i]-QMTIK_QActvT_MIN];
+}
+size_t QMTIK_rt_arena_size(const QMTIK_RtDesc* desc) {return QMTIK_rt_check_desc(desc)?0:QMTIK_rt_layout(desc, NULL, NULL)+63;}
+uint8_t QMTIK_rt_instantiate(QMTIK_RtNetwork* rt, const QMTIK_RtDesc* desc, void* arena, size_t arena_size) {
+    uint8_t* base=(uint8_t*)QMTIK_ROUND_UP((uintptr_t)arena, 64);
+    if (QMTIK_rt_check_desc(desc)) return 1;
+    if (arena_size<QMTIK_rt_arena_size(desc)) {fprintf(stderr, "[QMTIK] Runtime network needs a %zu byte arena, got %zu\n", QMTIK_rt_arena_size(desc), arena_size); return 1;}
+    QMTIK_rt_layout(desc, base, rt);
+    for (size_t l=0; l<rt->n_layers; ++l){
+        QMTIK_RtLayer* layer=&rt->layers[l];
+        memset(layer->wght, 0, (size_t)layer->out*layer->in);
+        memset(layer->bias, 0, layer->out);
+        memset(layer->acc_fold, 0, layer->out*sizeof(QMTIK_QAccT));
+        QMTIK_rt_prepare_layer(rt, layer);
+    }
+    QMTIK_select_kernel();
+    return 0;
+}
+//wght is [out][in] row-major, bias [out], both in QMTIK_W_SCALE units like QMTIK_Model
+void QMTIK_rt_set_layer(QMTIK_RtNetwork* rt, size_t l, const QMTIK_QWghtT* wght, const QMTIK_QWghtT* bias) {
+    QMTIK_RtLayer* layer=&rt->layers[l];
+    memcpy(layer->wght, wght, (size_t)layer->out*layer->in);
+    memcpy(layer->bias, bias, layer->out);
+    QMTIK_rt_prepare_layer(rt, layer);
+}
+//w_scales[l] and a_scales[l+1] become the weight and output scales of layer l, a_scales[0] the input scale, the int8
+//weights and biases keep their values in the new units
+uint8_t QMTIK_rt_set_scales(QMTIK_RtNetwork* rt, const QMTIK_MainT* w_scales, const QMTIK_MainT* a_scales) {
+    for (size_t l=0; l<=rt->n_layers; ++l) if (!(a_scales[l]>0)||(l<rt->n_layers&&!(w_scales[l]>0))) {fprintf(stderr, "[QMTIK] Runtime network scales of layer %zu are invalid\n", l); return 1;}
+    rt->a_scale=a_scales[0];
+    for (size_t l=0; l<rt->n_layers; ++l) {rt->layers[l].w_scale=w_scales[l]; rt->layers[l].a_scale=a_scales[l+1];}
+    for (size_t l=0; l<rt->n_layers; ++l) QMTIK_rt_prepare_layer(rt, &rt->layers[l]);
+    return 0;
+}
+//The first layer reads input[gather[j]] for its input j from then on, 1 when an index is not below n_inputs
+uint8_t QMTIK_rt_set_gather(QMTIK_RtNetwork* rt, uint32_t n_inputs, const uint32_t* gather) {
+    for (size_t j=0; j<rt->layers[0].in; ++j) if (gather[j]>=n_inputs) {fprintf(stderr, "[QMTIK] Runtime gather index %u is not below %u\n", gather[j], n_inputs); return 1;}
+    if (gather!=rt->gather) memcpy(rt->gather, gather, rt->layers[0].in*sizeof(uint32_t));
+    rt->n_inputs=n_inputs;
+    return 0;
+}
+//scratch holds rt->scratch_size bytes (64 byte aligned for the SIMD kernels), one per concurrent caller
+void QMTIK_rt_infer(const QMTIK_RtNetwork* rt, void* scratch, const QMTIK_QActvT* input, QMTIK_QActvT* output) {
+    QMTIK_QAccT* acc=(QMTIK_QAccT*)scratch;
+    const QMTIK_QActvT* x=input;
+    if (rt->n_inputs){
+        QMTIK_QActvT* gathered=(QMTIK_QActvT*)((uint8_t*)scratch+rt->buf_off[2]);
+        for (size_t j=0; j<rt->layers[0].in; ++j) gathered[j]=input[rt->gather[j]];
+        x=gathered;
+    }
+    for (size_t l=0; l<rt->n_layers; ++l){
+        const QMTIK_RtLayer* layer=&rt->layers[l];
+        QMTIK_QActvT* y=(l+1==rt->n_layers)?output:(QMTIK_QActvT*)((uint8_t*)scratch+rt->buf_off[l&1]);
+        QMTIK_infer_gemm(layer->wght, layer->panel, layer->wsum, layer->acc_bias, NULL, layer->out, layer->in, x, 1, acc);
+        for (size_t i=0; i<layer->out; ++i) y[i]=QMTIK_rt_activation(rt, layer, acc[i]);
+        x=y;
+    }
+    QMTIK_rt_post_process(rt, output, rt->layers[rt->n_layers-1].out);
+}
+//Runtime model file: QMTIK_RtHeader, widths, activations, the gather map when n_inputs is set, then each layer's
+//weights, biases, folds and float w_scale/a_scale, checksummed after the header
+uint8_t QMTIK_rt_store(const QMTIK_RtNetwork* rt, FILE* file) {
+    QMTIK_RtHeader header={QMTIK_RT_MAGIC, QMTIK_RT_VERSION, (uint32_t)rt->n_layers, rt->pp_id, rt->w_scale, rt->a_scale, QMTIK_CHECKSUM_INIT, rt->n_inputs};
+    long start=ftell(file);
+    uint8_t ok=start>=0&&fwrite(&header, sizeof(header), 1, file)==1;
+    for (size_t l=0; l<=rt->n_layers; ++l){
+        uint32_t width=l?rt->layers[l-1].out:rt->layers[0].in;
+        header.checksum=QMTIK_checksum(header.checksum, &width, sizeof(width));
+        ok=ok&&fwrite(&width, sizeof(width), 1, file)==1;
+    }
+    for (size_t l=0; l<rt->n_layers; ++l){
+        header.checksum=QMTIK_checksum(header.checksum, &rt->layers[l].actv, 1);
+        ok=ok&&fwrite(&rt->layers[l].actv, 1, 1, file)==1;
+    }
+    if (rt->n_inputs){
+        header.checksum=QMTIK_checksum(header.checksum, rt->gather, rt->layers[0].in*sizeof(uint32_t));
+        ok=ok&&fwrite(rt->gather, rt->layers[0].in*sizeof(uint32_t), 1, file)==1;
+    }
+    for (size_t l=0; l<rt->n_layers; ++l){
+        const QMTIK_RtLayer* layer=&rt->layers[l];
+        header.checksum=QMTIK_checksum(header.checksum, layer->wght, (size_t)layer->out*layer->in);
+        header.checksum=QMTIK_checksum(header.checksum, layer->bias, layer->out);
+        header.checksum=QMTIK_checksum(header.checksum, layer->acc_fold, layer->out*sizeof(QMTIK_QAccT));
+        ok=ok&&fwrite(layer->wght, (size_t)layer->out*layer->in, 1, file)==1&&fwrite(layer->bias, layer->out, 1, file)==1;
+        ok=ok&&fwrite(layer->acc_fold, layer->out*sizeof(QMTIK_QAccT), 1, file)==1;
+        float scales[2]={layer->w_scale, layer->a_scale};
+        header.checksum=QMTIK_checksum(header.checksum, scales, sizeof(scales));
+        ok=ok&&fwrite(scales, sizeof(scales), 1, file)==1;
+    }
+    if (!ok||fseek(file, start, SEEK_SET)||fwrite(&header, sizeof(header), 1, file)!=1||fseek(file, 0, SEEK_END)) {perror("[QMTIK] Failed to write runtime model file"); return 1;}
+    return 0;
+}
+static inline uint8_t QMTIK_rt_read_desc(FILE* file, QMTIK_RtHeader* header, QMTIK_RtDesc* desc, uint32_t widths[QMTIK_RT_MAX_LAYERS+1], uint8_t actvs[QMTIK_RT_MAX_LAYERS]) {
+    if (fread(header, offsetof(QMTIK_RtHeader, n_inputs), 1, file)!=1) {perror("[QMTIK] Failed to read runtime model file"); return 1;}
+    if (memcmp(header->magic, QMTIK_RT_MAGIC, sizeof(header->magic))||header->version<1||header->version>QMTIK_RT_VERSION) {fprintf(stderr, "[QMTIK] Not a runtime model file of version 1 to %d\n", QMTIK_RT_VERSION); return 1;}
+    header->n_inputs=0;
+    if (header->version>1&&fread(&header->n_inputs, sizeof(header->n_inputs), 1, file)!=1) {perror("[QMTIK] Failed to read runtime model file"); return 1;}
+    if (!header->n_layers||header->n_layers>QMTIK_RT_MAX_LAYERS) {fprintf(stderr, "[QMTIK] Runtime model has %u layers, QMTIK_RT_MAX_LAYERS is %d\n", header->n_layers, QMTIK_RT_MAX_LAYERS); return 1;}
+    if (fread(widths, sizeof(uint32_t), header->n_layers+1, file)!=header->n_layers+1||fread(actvs, 1, header->n_layers, file)!=header->n_layers) {perror("[QMTIK] Failed to read runtime model file"); return 1;}
+    desc->n_layers=header->n_layers; desc->widths=widths; desc->actvs=actvs;
+    desc->pp_id=(uint8_t)header->pp_id; desc->w_scale=header->w_scale; desc->a_scale=header->a_scale;
+    return QMTIK_rt_check_desc(desc);
+}
+//Reads the topology of the runtime model at the current file position and seeks back, 0 on error
+size_t QMTIK_rt_file_arena_size(FILE* file) {
+    QMTIK_RtHeader header; QMTIK_RtDesc desc;
+    uint32_t widths[QMTIK_RT_MAX_LAYERS+1]; uint8_t actvs[QMTIK_RT_MAX_LAYERS];
+    long start=ftell(file);
+    size_t size=(start>=0&&!QMTIK_rt_read_desc(file, &header, &desc, widths, actvs))?QMTIK_rt_arena_size(&desc):0;
+    if (start<0||fseek(file, start, SEEK_SET)) {perror("[QMTIK] Failed to read runtime model file"); return 0;}
+    return size;
+}
+uint8_t QMTIK_rt_load(QMTIK_RtNetwork* rt, void* arena, size_t arena_size, FILE* file) {
+    QMTIK_RtHeader header; QMTIK_RtDesc desc;
+    uint32_t widths[QMTIK_RT_MAX_LAYERS+1]; uint8_t actvs[QMTIK_RT_MAX_LAYERS];
+    if (QMTIK_rt_read_desc(file, &header, &desc, widths, actvs)||QMTIK_rt_instantiate(rt, &desc, arena, arena_size)) return 1;
+    uint32_t checksum=QMTIK_checksum(QMTIK_checksum(QMTIK_CHECKSUM_INIT, widths, (desc.n_layers+1)*sizeof(uint32_t)), actvs, desc.n_layers);
+    if (header.n_inputs){
+        uint32_t* gather=rt->gather;
+        if (fread(gather, widths[0]*sizeof(uint32_t), 1, file)!=1) {perror("[QMTIK] Failed to read runtime model file"); return 1;}
+        checksum=QMTIK_checksum(checksum, gather, widths[0]*sizeof(uint32_t));
+        if (QMTIK_rt_set_gather(rt, header.n_inputs, gather)) return 1;
+    }
+    for (size_t l=0; l<rt->n_layers; ++l){
+        QMTIK_RtLayer* layer=&rt->layers[l];
+        if (fread(layer->wght, (size_t)layer->out*layer->in, 1, file)!=1||fread(layer->bias, layer->out, 1, file)!=1) {perror("[QMTIK] Failed to read runtime model file"); return 1;}
+        checksum=QMTIK_checksum(QMTIK_checksum(checksum, layer->wght, (size_t)layer->out*layer->in), layer->bias, layer->out);
+        if (header.version>1){
+            if (fread(layer->acc_fold, layer->out*sizeof(QMTIK_QAccT), 1, file)!=1) {perror("[QMTIK] Failed to read runtime model file"); return 1;}
+            checksum=QMTIK_checksum(checksum, layer->acc_fold, layer->out*sizeof(QMTIK_QAccT));
+        }
+        if (header.version>2){
+            float scales[2];
+            if (fread(scales, sizeof(scales), 1, file)!=1) {perror("[QMTIK] Failed to read runtime model file"); return 1;}
+            checksum=QMTIK_checksum(checksum, scales, sizeof(scales));
+            if (!(scales[0]>0)||!(scales[1]>0)) {fprintf(stderr, "[QMTIK] Runtime model layer %zu scales are invalid\n", l); return 1;}
+            layer->w_scale=scales[0]; layer->a_scale=scales[1];
+        }
+        QMTIK_rt_prepare_layer(rt, layer);
+    }
+    if (checksum!=header.checksum) {fprintf(stderr, "[QMTIK] Runtime model file checksum mismatch\n"); return 1;}
+    return 0;
+}
+#if QMTIK_DENSE_INFER
+//The compiled-in topology as a runtime descriptor, QMTIK_rt_from_q_model then copies a loaded model into it
+void QMTIK_rt_model_desc(QMTIK_RtDesc* desc, uint32_t widths[QMTIK_L+3], uint8_t actvs[QMTIK_L+2]) {
+    for (size_t l=0; l<QMTIK_L+3; ++l) widths[l]=(l==0)?QMTIK_I:(l==QMTIK_L+2)?QMTIK_O:QMTIK_H;
+    for (size_t l=0; l<QMTIK_L+2; ++l) actvs[l]=(l==QMTIK_L+1)?QMTIK_RT_LINEAR:QMTIK_ACTV_ID;
+    desc->n_layers=QMTIK_L+2; desc->widths=widths; desc->actvs=actvs;
+    desc->pp_id=QMTIK_PP_ID; desc->w_scale=QMTIK_W_SCALE; desc->a_scale=QMTIK_A_SCALE;
+}
+void QMTIK_rt_from_q_model(QMTIK_RtNetwork* rt, const QMTIK_QModel* q_model) {
+    QMTIK_rt_set_layer(rt, 0, &q_model->q_ih_layer.q_ih_wght[0][0], q_model->q_ih_layer.q_ih_bias);
+    for (size_t l=0; l<QMTIK_L; ++l) QMTIK_rt_set_layer(rt, l+1, &q_model->q_hh_layers[l].q_hh_wght[0][0], q_model->q_hh_layers[l].q_hh_bias);
+    QMTIK_rt_set_layer(rt, QMTIK_L+1, &q_model->q_o_layer.q_o_wght[0][0], q_model->q_o_layer.q_o_bias);
+}
+//Keeps column j of a rows x cols layer when its value varies and a kept row (all rows for row_keep==NULL) weights it,
+//at least one column is kept
+static inline uint32_t QMTIK_rt_plan_keep(const QMTIK_QWghtT* wght, size_t rows, size_t cols, const uint8_t* row_keep, const QMTIK_QActvT* low, const QMTIK_QActvT* high, uint8_t* keep) {
+    uint32_t kept=0;
+    for (size_t j=0; j<cols; ++j){
+        keep[j]=0;
+        for (size_t i=0; i<rows&&!keep[j]&&low[j]!=high[j]; ++i) keep[j]=(!row_keep||row_keep[i])&&wght[i*cols+j];
+        kept+=keep[j];
+    }
+    if (!kept) keep[0]=1;
+    return kept?kept:1;
+}
+//Copies the kept rows and columns, a dropped column adds weight*value to the row's fold: value is its constant, or
+//anything for a column no kept row weights
+static inline void QMTIK_rt_plan_layer(const QMTIK_RtNetwork* rt, QMTIK_RtLayer* layer, const QMTIK_QWghtT* wght, const QMTIK_QWghtT* bias, size_t rows, size_t cols, const uint8_t* row_keep, const uint8_t* col_keep, const QMTIK_QActvT* col_value) {
+    QMTIK_QWghtT* w=layer->wght;
+    size_t r=0;
+    for (size_t i=0; i<rows; ++i){
+        if (row_keep&&!row_keep[i]) continue;
+        QMTIK_QAccT fold=0;
+        for (size_t j=0; j<cols; ++j){
+            if (col_keep[j]) *w++=wght[i*cols+j];
+            else fold+=(QMTIK_QAccT)wght[i*cols+j]*col_value[j];
+        }
+        layer->bias[r]=bias[i]; layer->acc_fold[r++]=fold;
+    }
+    QMTIK_rt_prepare_layer(rt, layer);
+}
+//Runs q_model over the samples, then drops every input and hidden neuron that is constant over them, folding its
+//value into the next layer's accumulators, or that no kept neuron of the next layer weights. plan->desc is the
+//smaller topology, for QMTIK_rt_arena_size and QMTIK_rt_instantiate before QMTIK_rt_from_plan
+void QMTIK_rt_plan_model(QMTIK_RtPlan* plan, const QMTIK_QModel* q_model, const QMTIK_SamplePair* samples, size_t n_samples) {
+    QMTIK_QContext q_context;
+    memset(plan->i_low, QMTIK_QActvT_MAX, sizeof(plan->i_low)); memset(plan->i_high, QMTIK_QActvT_MIN, sizeof(plan->i_high));
+    memset(plan->h_low, QMTIK_QActvT_MAX, sizeof(plan->h_low)); memset(plan->h_high, QMTIK_QActvT_MIN, sizeof(plan->h_high));
+    for (size_t s=0; s<n_samples; ++s){
+        memcpy(q_context.q_i_actv, samples[s].input, QMTIK_I);
+        QMTIK_infer_logits(q_model, &q_context);
+        for (size_t j=0; j<QMTIK_I; ++j) {QMTIK_QActvT x=q_context.q_i_actv[j]; if (x<plan->i_low[j]) plan->i_low[j]=x; if (x>plan->i_high[j]) plan->i_high[j]=x;}
+        for (size_t l=0; l<=QMTIK_L; ++l) for (size_t j=0; j<QMTIK_H; ++j){
+            QMTIK_QActvT x=l?q_context.q_hh_actv[l-1][j]:q_context.q_ih_actv[j];
+            if (x<plan->h_low[l][j]) plan->h_low[l][j]=x;
+            if (x>plan->h_high[l][j]) plan->h_high[l][j]=x;
+        }
+    }
+    QMTIK_rt_model_desc(&plan->desc, plan->widths, plan->actvs);
+    plan->widths[QMTIK_L+1]=QMTIK_rt_plan_keep(&q_model->q_o_layer.q_o_wght[0][0], QMTIK_O, QMTIK_H, NULL, plan->h_low[QMTIK_L], plan->h_high[QMTIK_L], plan->keep_h[QMTIK_L]);
+    for (size_t l=QMTIK_L; l-->0;) plan->widths[l+1]=QMTIK_rt_plan_keep(&q_model->q_hh_layers[l].q_hh_wght[0][0], QMTIK_H, QMTIK_H, plan->keep_h[l+1], plan->h_low[l], plan->h_high[l], plan->keep_h[l]);
+    plan->widths[0]=QMTIK_rt_plan_keep(&q_model->q_ih_layer.q_ih_wght[0][0], QMTIK_H, QMTIK_I, plan->keep_h[0], plan->i_low, plan->i_high, plan->keep_i);
+    plan->macs=0; plan->dense_macs=(uint64_t)QMTIK_I*QMTIK_H+(uint64_t)QMTIK_L*QMTIK_H*QMTIK_H+(uint64_t)QMTIK_H*QMTIK_O;
+    for (size_t l=0; l<QMTIK_L+2; ++l) plan->macs+=(uint64_t)plan->widths[l]*plan->widths[l+1];
+}
+//rt comes from QMTIK_rt_instantiate with plan->desc, it then takes the full QMTIK_I wide inputs through its gather map
+//and gives the outputs of q_model for every planned sample
+uint8_t QMTIK_rt_from_plan(QMTIK_RtNetwork* rt, const QMTIK_RtPlan* plan, const QMTIK_QModel* q_model) {
+    uint32_t gather[QMTIK_I];
+    size_t n=0;
+    for (size_t j=0; j<QMTIK_I; ++j) if (plan->keep_i[j]) gather[n++]=(uint32_t)j;
+    QMTIK_rt_plan_layer(rt, &rt->layers[0], &q_model->q_ih_layer.q_ih_wght[0][0], q_model->q_ih_layer.q_ih_bias, QMTIK_H, QMTIK_I, plan->keep_h[0], plan->keep_i, plan->i_low);
+    for (size_t l=0; l<QMTIK_L; ++l) QMTIK_rt_plan_layer(rt, &rt->layers[l+1], &q_model->q_hh_layers[l].q_hh_wght[0][0], q_model->q_hh_layers[l].q_hh_bias, QMTIK_H, QMTIK_H, plan->keep_h[l+1], plan->keep_h[l], plan->h_low[l]);
+    QMTIK_rt_plan_layer(rt, &rt->layers[QMTIK_L+1], &q_model->q_o_layer.q_o_wght[0][0], q_model->q_o_layer.q_o_bias, QMTIK_O, QMTIK_H, NULL, plan->keep_h[QMTIK_L], plan->h_low[QMTIK_L]);
+    return QMTIK_rt_set_gather(rt, QMTIK_I, gather);
+}
+//The float forward pass without fake quantization: z[l] holds the activations of layer l, z[QMTIK_L+1] the logits
+static inline void QMTIK_calib_forward(const QMTIK_Network* network, const QMTIK_QActvT* input, QMTIK_MainT z[QMTIK_L+2][QMTIK_H>QMTIK_O?QMTIK_H:QMTIK_O]) {
+    QMTIK_MainT x[QMTIK_I];
+    for (size_t j=0; j<QMTIK_I; ++j) x[j]=QMTIK_fake_quantize_a(input[j]);
+    for (size_t i=0; i<QMTIK_H; ++i){
+        QMTIK_MainT acc=network->ih_layer.ih_bias[i];
+        for (size_t j=0; j<QMTIK_I; ++j) acc+=network->ih_layer.ih_wght[i][j]*x[j];
+        z[0][i]=QMTIK_train_activation(acc);
+    }
+    for (size_t l=0; l<QMTIK_L; ++l) for (size_t i=0; i<QMTIK_H; ++i){
+        QMTIK_MainT acc=network->hh_layers[l].hh_bias[i];
+        for (size_t j=0; j<QMTIK_H; ++j) acc+=network->hh_layers[l].hh_wght[i][j]*z[l][j];
+        z[l+1][i]=QMTIK_train_activation(acc);
+    }
+    for (size_t i=0; i<QMTIK_O; ++i){
+        QMTIK_MainT acc=network->o_layer.o_bias[i];
+        for (size_t j=0; j<QMTIK_H; ++j) acc+=network->o_layer.o_wght[i][j]*z[QMTIK_L][j];
+        z[QMTIK_L+1][i]=acc;
+    }
+}
+//Upper edge of the first histogram bin over [0, max] that reaches percentile % of the count
+static inline QMTIK_MainT QMTIK_calib_clip(const uint32_t* hist, uint64_t count, QMTIK_MainT max, QMTIK_MainT percentile) {
+    uint64_t need=(uint64_t)ceil((double)count*percentile/100.0), sum=0;
+    for (size_t b=0; b<QMTIK_CALIB_BINS; ++b) if ((sum+=hist[b])>=need) return max*(QMTIK_MainT)(b+1)/QMTIK_CALIB_BINS;
+    return max;
+}
+//Maps the clip to QMTIK_QActvT_MAX, rounded up to a power of two with pow2
+static inline QMTIK_MainT QMTIK_calib_scale(QMTIK_MainT clip, QMTIK_MainT fallback, uint8_t pow2) {
+    QMTIK_MainT scale=(clip>0)?clip/QMTIK_QActvT_MAX:fallback;
+    return pow2?exp2f(ceilf(log2f(scale))):scale;
+}
+static inline QMTIK_MainT QMTIK_calib_weights(const QMTIK_MainT* wght, size_t n, QMTIK_MainT percentile, uint8_t pow2) {
+    uint32_t hist[QMTIK_CALIB_BINS]={0};
+    QMTIK_MainT max=0;
+    for (size_t i=0; i<n; ++i) max=fmaxf(max, fabsf(wght[i]));
+    for (size_t i=0; max>0&&i<n; ++i){
+        size_t b=(size_t)(fabsf(wght[i])/max*QMTIK_CALIB_BINS);
+        ++hist[b<QMTIK_CALIB_BINS?b:QMTIK_CALIB_BINS-1];
+    }
+    return QMTIK_calib_scale(QMTIK_calib_clip(hist, n, max, percentile), QMTIK_W_SCALE, pow2);
+}
+//Picks per layer weight and activation scales for the float network from the weights and from its activations over the
+//samples of calib_file, clipping the largest values above percentile (100 keeps the maximum), 1 on a read error or no samples
+uint8_t QMTIK_calibrate(QMTIK_Calibration* calibration, const QMTIK_Network* network, FILE* calib_file, QMTIK_MainT percentile, uint8_t pow2) {
+    uint32_t hist[QMTIK_L+2][QMTIK_CALIB_BINS]={{0}};
+    QMTIK_MainT z[QMTIK_L+2][QMTIK_H>QMTIK_O?QMTIK_H:QMTIK_O];
+    QMTIK_SamplePair pair;
+    uint64_t count=0;
+    long start=ftell(calib_file);
+    for (size_t l=0; l<QMTIK_L+2; ++l) calibration->a_max[l]=0;
+    for (uint8_t pass=0; pass<2; ++pass){
+        if (start<0||fseek(calib_file, start, SEEK_SET)) {perror("[QMTIK] Failed to read calibration file"); return 1;}
+        while (fread(&pair, sizeof(pair), 1, calib_file)==1){
+            QMTIK_calib_forward(network, pair.input, z);
+            for (size_t l=0; l<QMTIK_L+2; ++l) for (size_t i=0; i<((l>QMTIK_L)?QMTIK_O:QMTIK_H); ++i){
+                QMTIK_MainT a=fabsf(z[l][i]);
+                if (!pass) {calibration->a_max[l]=fmaxf(calibration->a_max[l], a); continue;}
+                size_t b=(calibration->a_max[l]>0)?(size_t)(a/calibration->a_max[l]*QMTIK_CALIB_BINS):0;
+                ++hist[l][b<QMTIK_CALIB_BINS?b:QMTIK_CALIB_BINS-1];
+            }
+            count+=!pass;
+        }
+        if (ferror(calib_file)) {perror("[QMTIK] Failed to read calibration file"); return 1;}
+    }
+    if (!count) {fprintf(stderr, "[QMTIK] Calibration file holds no samples\n"); return 1;}
+    calibration->a_scale[0]=QMTIK_A_SCALE;
+    for (size_t l=0; l<QMTIK_L+2; ++l) calibration->a_scale[l+1]=QMTIK_calib_scale(QMTIK_calib_clip(hist[l], count*((l>QMTIK_L)?QMTIK_O:QMTIK_H), calibration->a_max[l], percentile), QMTIK_A_SCALE, pow2);
+    calibration->w_scale[0]=QMTIK_calib_weights(&network->ih_layer.ih_wght[0][0], (size_t)QMTIK_H*QMTIK_I, percentile, pow2);
+    for (size_t l=0; l<QMTIK_L; ++l) calibration->w_scale[l+1]=QMTIK_calib_weights(&network->hh_layers[l].hh_wght[0][0], (size_t)QMTIK_H*QMTIK_H, percentile, pow2);
+    calibration->w_scale[QMTIK_L+1]=QMTIK_calib_weights(&network->o_layer.o_wght[0][0], (size_t)QMTIK_O*QMTIK_H, percentile, pow2);
+    return 0;
+}
+static inline void QMTIK_rt_quantize_layer(const QMTIK_RtNetwork* rt, QMTIK_RtLayer* layer, const QMTIK_MainT* wght, const QMTIK_MainT* bias) {
+    for (size_t i=0; i<(size_t)layer->out*layer->in; ++i) layer->wght[i]=(QMTIK_QWghtT)fmaxf(QMTIK_QWghtT_MIN, fminf(QMTIK_QWghtT_MAX, roundf(wght[i]/layer->w_scale)));
+    for (size_t i=0; i<layer->out; ++i) layer->bias[i]=(QMTIK_QWghtT)fmaxf(QMTIK_QWghtT_MIN, fminf(QMTIK_QWghtT_MAX, roundf(bias[i]/layer->w_scale)));
+    QMTIK_rt_prepare_layer(rt, layer);
+}
+//Quantizes the float network into rt, instantiated from QMTIK_rt_model_desc, with the calibrated scales of every layer
+uint8_t QMTIK_rt_from_network(QMTIK_RtNetwork* rt, const QMTIK_Network* network, const QMTIK_Calibration* calibration) {
+    uint8_t shape=rt->n_layers==QMTIK_L+2&&rt->layers[0].in==QMTIK_I&&!rt->n_inputs;
+    for (size_t l=0; shape&&l<QMTIK_L+2; ++l) shape=rt->layers[l].out==((l>QMTIK_L)?QMTIK_O:QMTIK_H)&&(!l||rt->layers[l].in==QMTIK_H);
+    if (!shape||QMTIK_rt_set_scales(rt, calibration->w_scale, calibration->a_scale)) {fprintf(stderr, "[QMTIK] Runtime network does not take the calibrated network\n"); return 1;}
+    QMTIK_rt_quantize_layer(rt, &rt->layers[0], &network->ih_layer.ih_wght[0][0], network->ih_layer.ih_bias);
+    for (size_t l=0; l<QMTIK_L; ++l) QMTIK_rt_quantize_layer(rt, &rt->layers[l+1], &network->hh_layers[l].hh_wght[0][0], network->hh_layers[l].hh_bias);
+    QMTIK_rt_quantize_layer(rt, &rt->layers[QMTIK_L+1], &network->o_layer.o_wght[0][0], network->o_layer.o_bias);
+    return 0;
+}
+#endif
+//==================================================
+static inline uint64_t QMTIK_mix64(uint64_t x) {
+    x^=x>>30; x*=0xBF58476D1CE4E5B9ull;
+    x^=x>>27; x*=0x94D049BB133111EBull;
+    return x^(x>>31);
+}
+static inline size_t QMTIK_permute_index(size_t i, size_t n, uint64_t key) {
+    //4 round Feistel network over the next even power of two, cycle walked back into [0, n)
+    size_t half=1;
+    while (((size_t)1<<(2*half))<n) ++half;
+    size_t mask=((size_t)1<<half)-1;
+    do {
+        size_t left=i>>half, right=i&mask;
+        for (uint64_t r=0; r<4; ++r){
+            size_t next=left^(QMTIK_mix64(right^(key+r*0x9E3779B97F4A7C15ull))&mask);
+            left=right; right=next;
+        }
+        i=(left<<half)|right;
+    } while (i>=n);
+    return i;
+}
+#ifdef QMTIK_THREADS
+static void* QMTIK_read_ahead(void* arg) {
+    QMTIK_Dataset* dataset=(QMTIK_Dataset*)arg;
+    for (size_t b=0;; b^=1){
+        pthread_mutex_lock(&dataset->lock);
+        while (dataset->chunk_ready[b]&&!dataset->stop) pthread_cond_wait(&dataset->cond, &dataset->lock);
+        uint8_t stop=dataset->stop;
+        pthread_mutex_unlock(&dataset->lock);
+        if (stop) break;
+        size_t count=fread(dataset->chunks[b], sizeof(QMTIK_SamplePair), dataset->chunk_size, dataset->file);
+        pthread_mutex_lock(&dataset->lock);
+        dataset->chunk_count[b]=count;
+        dataset->chunk_ready[b]=1;
+        pthread_cond_broadcast(&dataset->cond);
+        pthread_mutex_unlock(&dataset->lock);
+        if (!count) break;
+    }
+    return NULL;
+}
+static inline void QMTIK_stop_read_ahead(QMTIK_Dataset* dataset) {
+    if (!dataset->reading) return;
+    pthread_mutex_lock(&dataset->lock);
+    dataset->stop=1;
+    pthread_cond_broadcast(&dataset->cond);
+    pthread_mutex_unlock(&dataset->lock);
+    pthread_join(dataset->reader, NULL);
+    dataset->reading=0;
+}
+#endif
+static inline void QMTIK_release_chunk(QMTIK_Dataset* dataset, size_t b) {
+    #ifdef QMTIK_THREADS
+    if (dataset->reading){
+        pthread_mutex_lock(&dataset->lock);
+        dataset->chunk_ready[b]=0;
+        pthread_cond_broadcast(&dataset->cond);
+        pthread_mutex_unlock(&dataset->lock);
+        return;
+    }
+    #endif
+    dataset->chunk_ready[b]=0;
+}
+static inline size_t QMTIK_acquire_chunk(QMTIK_Dataset* dataset, size_t b) {
+    #ifdef QMTIK_THREADS
+    if (dataset->reading){
+        pthread_mutex_lock(&dataset->lock);
+        while (!dataset->chunk_ready[b]) pthread_cond_wait(&dataset->cond, &dataset->lock);
+        pthread_mutex_unlock(&dataset->lock);
+        return dataset->chunk_count[b];
+    }
+    #endif
+    dataset->chunk_count[b]=fread(dataset->chunks[b], sizeof(QMTIK_SamplePair), dataset->chunk_size, dataset->file);
+    dataset->chunk_ready[b]=1;
+    return dataset->chunk_count[b];
+}
+static inline const QMTIK_SamplePair* QMTIK_next_sample(QMTIK_Dataset* dataset) {
+    if (!dataset->file){
+        if (dataset->next>=dataset->n_samples) return NULL;
+        size_t i=dataset->next++;
+        return &dataset->samples[dataset->seed?QMTIK_permute_index(i, dataset->n_samples, dataset->key):i];
+    }
+    if (dataset->pos>=dataset->avail){
+        if (dataset->eof) return NULL;
+        size_t b=dataset->chunk^1;
+        //the previous chunk may still back pointers handed out in this batch, it is released on the next call
+        if (dataset->holding) dataset->pending=dataset->chunk+1;
+        if (!(dataset->avail=QMTIK_acquire_chunk(dataset, b))) {dataset->eof=1; return NULL;}
+        dataset->chunk=b; dataset->pos=0; dataset->holding=1;
+        ++dataset->next;
+    }
+    size_t i=dataset->pos++;
+    if (dataset->seed) i=QMTIK_permute_index(i, dataset->avail, dataset->key^dataset->next);
+    return &dataset->chunks[dataset->chunk][i];
+}
+#ifdef QMTIK_MMAP
+uint8_t QMTIK_map_dataset(QMTIK_Dataset* dataset, const char* path) {
+    struct stat st;
+    memset(dataset, 0, sizeof(QMTIK_Dataset));
+    int fd=open(path, O_RDONLY);
+    if (fd<0) {perror("[QMTIK] Failed to open dataset file"); return 1;}
+    if (fstat(fd, &st)||(size_t)st.st_size<sizeof(QMTIK_SamplePair)) {fprintf(stderr, "[QMTIK] Dataset file holds no samples\n"); close(fd); return 1;}
+    void* base=mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base==MAP_FAILED) {perror("[QMTIK] Failed to map dataset file"); return 1;}
+    dataset->base=base;
+    dataset->size=(size_t)st.st_size;
+    dataset->samples=(const QMTIK_SamplePair*)base;
+    dataset->n_samples=dataset->size/sizeof(QMTIK_SamplePair);
+    madvise(base, dataset->size, MADV_SEQUENTIAL);
+    return 0;
+}
+#endif
+uint8_t QMTIK_stream_dataset(QMTIK_Dataset* dataset, FILE* file, QMTIK_SamplePair* buffer, size_t chunk_size) {
+    memset(dataset, 0, sizeof(QMTIK_Dataset));
+    if (!file||!buffer||chunk_size<QMTIK_TRAIN_BATCH||chunk_size<QMTIK_BATCH) {fprintf(stderr, "[QMTIK] Dataset stream needs a buffer of 2 chunks of at least QMTIK_TRAIN_BATCH and QMTIK_BATCH samples\n"); return 1;}
+    dataset->file=file;
+    dataset->chunks[0]=buffer;
+    dataset->chunks[1]=buffer+chunk_size;
+    dataset->chunk_size=chunk_size;
+    #ifdef QMTIK_THREADS
+    pthread_mutex_init(&dataset->lock, NULL);
+    pthread_cond_init(&dataset->cond, NULL);
+    #endif
+    return 0;
+}
+void QMTIK_close_dataset(QMTIK_Dataset* dataset) {
+    #ifdef QMTIK_THREADS
+    if (dataset->file){
+        QMTIK_stop_read_ahead(dataset);
+        pthread_mutex_destroy(&dataset->lock);
+        pthread_cond_destroy(&dataset->cond);
+    }
+    #endif
+    #ifdef QMTIK_MMAP
+    if (dataset->base) munmap(dataset->base, dataset->size);
+    #endif
+    memset(dataset, 0, sizeof(QMTIK_Dataset));
+}
+void QMTIK_shuffle_dataset(QMTIK_Dataset* dataset, uint64_t seed) {
+    dataset->seed=seed;
+    #ifdef QMTIK_MMAP
+    if (dataset->base) madvise(dataset->base, dataset->size, seed?MADV_RANDOM:MADV_SEQUENTIAL);
+    #endif
+}
+void QMTIK_rewind_dataset(QMTIK_Dataset* dataset) {
+    dataset->key=QMTIK_mix64(dataset->seed+dataset->epoch++);
+    dataset->next=0;
+    if (!dataset->file) return;
+    #ifdef QMTIK_THREADS
+    QMTIK_stop_read_ahead(dataset);
+    #endif
+    rewind(dataset->file);
+    dataset->chunk_ready[0]=dataset->chunk_ready[1]=0;
+    dataset->chunk_count[0]=dataset->chunk_count[1]=0;
+    dataset->chunk=1; dataset->pos=0; dataset->avail=0; dataset->holding=0; dataset->pending=0; dataset->eof=0; dataset->stop=0;
+    #ifdef QMTIK_THREADS
+    dataset->reading=(pthread_create(&dataset->reader, NULL, QMTIK_read_ahead, dataset)==0);
+    #endif
+}
+size_t QMTIK_dataset_batch(QMTIK_Dataset* dataset, const QMTIK_SamplePair** batch, size_t n) {
+    size_t count=0;
+    if (dataset->pending) {QMTIK_release_chunk(dataset, dataset->pending-1); dataset->pending=0;}
+    //a streamed batch ends with its chunk, so it holds at most the one chunk it started in
+    while (count<n&&!(dataset->file&&count&&dataset->pos>=dataset->avail)&&(batch[count]=QMTIK_next_sample(dataset))) ++count;
+    return count;
+}
+//==================================================
+void QMTIK_init_weights(QMTIK_Network* network){
+    srand(time(NULL));
+    for (size_t i=0; i<QMTIK_H; ++i){
+        network->ih_layer.ih_bias[i]=0.0f;
+        for (size_t j=0; j<QMTIK_I; ++j) network->ih_layer.ih_wght[i][j]=sqrtf(2.0f/(QMTIK_I+QMTIK_H))*((QMTIK_MainT)rand()/RAND_MAX-0.5f)*2.0f;
+    }
+    for (size_t l=0; l<QMTIK_L; ++l){
+        for (size_t i=0; i<QMTIK_H; ++i) {
+            network->hh_layers[l].hh_bias[i]=0.0f;
+            for (size_t j=0; j<QMTIK_H; ++j) network->hh_layers[l].hh_wght[i][j]=sqrtf(2.0f/(QMTIK_H+QMTIK_H))*((QMTIK_MainT)rand()/RAND_MAX-0.5f)*2.0f;
+        }
+    }
+    for (size_t i=0; i<QMTIK_O; ++i){
+        network->o_layer.o_bias[i]=0.0f;
+        for (size_t j=0; j<QMTIK_H; ++j) network->o_layer.o_wght[i][j]=sqrtf(2.0f/(QMTIK_H+QMTIK_O))*((QMTIK_MainT)rand()/RAND_MAX-0.5f)*2.0f;
+    }
+    memset(&network->adam_state, 0, sizeof(QMTIK_AdamState));
+    network->adam_state.b1t = 1.0f;
+    network->adam_state.b2t = 1.0f;
+}
+//==================================================
+void QMTIK_load_network_input(QMTIK_QNetwork* q_network, QMTIK_QActvT input[QMTIK_I]) {for(size_t i=0; i<QMTIK_I; ++i) q_network->q_context.q_i_actv[i]=input[i];}
+void QMTIK_get_network_output(QMTIK_QNetwork* q_network, QMTIK_QActvT output[QMTIK_O]) {for(size_t i=0; i<QMTIK_O; ++i) output[i]=q_network->q_context.q_o_z[i];}
+//==================================================
+QMTIK_MainT QMTIK_test_before_quant(QMTIK_Network* network, FILE* test_file){
+    QMTIK_SamplePair pair;
+    uint64_t total_cost=0;
+    int _sample_number=0;
+    rewind(test_file);
+    QMTIK_refresh_wght_shadow(network);
+    #ifdef QMTIK_TEST_BEFORE_QUANT_DEBUG
+        printf("[QMTIK] ====TEST BEFORE QUANT====\n");
+    #endif
+    while (1){
         if (!QMTIK_load_sample_pair(test_file, &pair)) break;
-        for(size_t i=0; i<QMTIK_I; ++i) network->i_layer.i_actv[i]=(QMTIK_MainT)pair.input[i];
-        QMTIK_train_forward(network);
-        int32_t temp_cost=QMTIK_train_cost(network->o_layer.o_z, pair.output);
+        for(size_t i=0; i<QMTIK_I; ++i) network->train_context.i_actv[i]=(QMTIK_MainT)pair.input[i];
+        QMTIK_train_forward(network, &network->train_context);
+        int32_t temp_cost=QMTIK_train_cost(network->train_context.o_z, pair.output);
         #ifdef QMTIK_TEST_BEFORE_QUANT_DEBUG
             if (_sample_number%(QMTIK_SAMPLE_NUMBER_DEBUG_UPDATE_POINT)==0) {
                 printf("[QMTIK] SAMPLE_NUMBER: %d\n", _sample_number);
                 printf("[QMTIK] OUTPUT: ");
-                for(size_t i=0; i<QMTIK_O; ++i) printf("%f,", network->o_layer.o_z[i]);
+                for(size_t i=0; i<QMTIK_O; ++i) printf("%f,", network->train_context.o_z[i]);
                 printf("\n[QMTIK] EXPECTED: ");
                 for(size_t i=0; i<QMTIK_O; ++i) printf("%d,", pair.output[i]);
                 printf("\n[QMTIK] COST: %d\n", temp_cost);
@@ -559,7 +3530,8 @@ QMTIK_MainT QMTIK_test_before_quant(QMTIK_Network* network, FILE* test_file){
     return (QMTIK_MainT)total_cost/_sample_number;
 }
 QMTIK_MainT QMTIK_test_after_quant(QMTIK_QNetwork* q_network, FILE* test_file){
-    QMTIK_SamplePair pair;
+    QMTIK_SamplePair pairs[QMTIK_BATCH];
+    QMTIK_QActvT inputs[QMTIK_BATCH][QMTIK_I], outputs[QMTIK_BATCH][QMTIK_O];
     uint64_t total_cost=0;
     int _sample_number=0;
     rewind(test_file);
@@ -567,28 +3539,316 @@ QMTIK_MainT QMTIK_test_after_quant(QMTIK_QNetwork* q_network, FILE* test_file){
         printf("[QMTIK] ====TEST AFTER QUANT====\n");
     #endif
     while (1){
-        if (!QMTIK_load_sample_pair(test_file, &pair)) break;
-        QMTIK_load_network_input(q_network, pair.input);
-        QMTIK_infer_forward(q_network);
-        int32_t temp_cost=QMTIK_infer_cost(q_network->q_o_layer.q_o_z, pair.output);
-        #ifdef QMTIK_TEST_AFTER_QUANT_DEBUG
-            if (_sample_number%(QMTIK_SAMPLE_NUMBER_DEBUG_UPDATE_POINT)==0) {
-                printf("[QMTIK] SAMPLE_NUMBER: %d\n", _sample_number);
-                printf("[QMTIK] OUTPUT: ");
-                for(size_t i=0; i<QMTIK_O; ++i) printf("%d,", q_network->q_o_layer.q_o_z[i]);
-                printf("\n[QMTIK] EXPECTED: ");
-                for(size_t i=0; i<QMTIK_O; ++i) printf("%d,", pair.output[i]);
-                printf("\n[QMTIK] COST: %d\n", temp_cost);
-            }
-        #endif
-        _sample_number+=1;
-        total_cost+=temp_cost;
+        size_t n=0;
+        while (n<QMTIK_BATCH&&QMTIK_load_sample_pair(test_file, &pairs[n])) {memcpy(inputs[n], pairs[n].input, QMTIK_I); ++n;}
+        if (!n) break;
+        QMTIK_infer_forward_batch(&q_network->q_model, inputs, outputs, n);
+        for (size_t s=0; s<n; ++s){
+            int32_t temp_cost=QMTIK_infer_cost(outputs[s], pairs[s].output);
+            #ifdef QMTIK_TEST_AFTER_QUANT_DEBUG
+                if (_sample_number%(QMTIK_SAMPLE_NUMBER_DEBUG_UPDATE_POINT)==0) {
+                    printf("[QMTIK] SAMPLE_NUMBER: %d\n", _sample_number);
+                    printf("[QMTIK] OUTPUT: ");
+                    for(size_t i=0; i<QMTIK_O; ++i) printf("%d,", outputs[s][i]);
+                    printf("\n[QMTIK] EXPECTED: ");
+                    for(size_t i=0; i<QMTIK_O; ++i) printf("%d,", pairs[s].output[i]);
+                    printf("\n[QMTIK] COST: %d\n", temp_cost);
+                }
+            #endif
+            _sample_number+=1;
+            total_cost+=temp_cost;
+        }
+    }
+    return (QMTIK_MainT)total_cost/_sample_number;
+}
+#ifdef QMTIK_THREADS
+typedef struct {const QMTIK_QModel* q_model; int fd; size_t first, count; uint64_t total_cost;} QMTIK_ScoreShard;
+static void* QMTIK_score_shard(void* arg) {
+    QMTIK_ScoreShard* shard=(QMTIK_ScoreShard*)arg;
+    QMTIK_SamplePair pairs[QMTIK_BATCH];
+    QMTIK_QActvT inputs[QMTIK_BATCH][QMTIK_I], outputs[QMTIK_BATCH][QMTIK_O];
+    for (size_t s0=0; s0<shard->count; s0+=QMTIK_BATCH){
+        size_t n=(shard->count-s0<QMTIK_BATCH)?shard->count-s0:QMTIK_BATCH;
+        if (pread(shard->fd, pairs, n*sizeof(QMTIK_SamplePair), (off_t)((shard->first+s0)*sizeof(QMTIK_SamplePair)))!=(ssize_t)(n*sizeof(QMTIK_SamplePair))) break;
+        for (size_t s=0; s<n; ++s) memcpy(inputs[s], pairs[s].input, QMTIK_I);
+        QMTIK_infer_forward_batch(shard->q_model, inputs, outputs, n);
+        for (size_t s=0; s<n; ++s) shard->total_cost+=(uint64_t)QMTIK_infer_cost(outputs[s], pairs[s].output);
+    }
+    return NULL;
+}
+QMTIK_MainT QMTIK_test_after_quant_parallel(const QMTIK_QModel* q_model, FILE* test_file, size_t n_threads){
+    pthread_t threads[QMTIK_MAX_THREADS];
+    QMTIK_ScoreShard shards[QMTIK_MAX_THREADS];
+    uint8_t started[QMTIK_MAX_THREADS];
+    uint64_t total_cost=0;
+    if (!n_threads) {long n_cpus=sysconf(_SC_NPROCESSORS_ONLN); n_threads=(n_cpus>0)?(size_t)n_cpus:1;}
+    if (n_threads>QMTIK_MAX_THREADS) n_threads=QMTIK_MAX_THREADS;
+    if (fseek(test_file, 0, SEEK_END)) return 0.0f;
+    size_t _sample_number=(size_t)ftell(test_file)/sizeof(QMTIK_SamplePair);
+    rewind(test_file);
+    if (!_sample_number) return 0.0f;
+    #ifdef QMTIK_TEST_AFTER_QUANT_DEBUG
+        printf("[QMTIK] ====TEST AFTER QUANT (%zu THREADS)====\n", n_threads);
+    #endif
+    for (size_t t=0; t<n_threads; ++t){
+        shards[t].q_model=q_model;
+        shards[t].fd=fileno(test_file);
+        shards[t].first=_sample_number*t/n_threads;
+        shards[t].count=_sample_number*(t+1)/n_threads-shards[t].first;
+        shards[t].total_cost=0;
+        started[t]=(pthread_create(&threads[t], NULL, QMTIK_score_shard, &shards[t])==0);
+        if (!started[t]) QMTIK_score_shard(&shards[t]);
+    }
+    for (size_t t=0; t<n_threads; ++t){
+        if (started[t]) pthread_join(threads[t], NULL);
+        total_cost+=shards[t].total_cost;
     }
     return (QMTIK_MainT)total_cost/_sample_number;
 }
+#endif
+QMTIK_MainT QMTIK_test_dataset(const QMTIK_QModel* q_model, QMTIK_Dataset* dataset){
+    const QMTIK_SamplePair* batch[QMTIK_BATCH];
+    QMTIK_QActvT inputs[QMTIK_BATCH][QMTIK_I], outputs[QMTIK_BATCH][QMTIK_O];
+    uint64_t total_cost=0;
+    size_t _sample_number=0, n;
+    #ifdef QMTIK_TEST_AFTER_QUANT_DEBUG
+        printf("[QMTIK] ====TEST DATASET====\n");
+    #endif
+    QMTIK_rewind_dataset(dataset);
+    while ((n=QMTIK_dataset_batch(dataset, batch, QMTIK_BATCH))){
+        for (size_t s=0; s<n; ++s) memcpy(inputs[s], batch[s]->input, QMTIK_I);
+        QMTIK_infer_forward_batch(q_model, inputs, outputs, n);
+        for (size_t s=0; s<n; ++s) total_cost+=(uint64_t)QMTIK_infer_cost(outputs[s], batch[s]->output);
+        _sample_number+=n;
+    }
+    return _sample_number?(QMTIK_MainT)total_cost/_sample_number:0.0f;
+}
+//==================================================
+#ifdef QMTIK_SERVE
+static inline uint64_t QMTIK_serve_ns(void) {struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (uint64_t)ts.tv_sec*1000000000u+(uint64_t)ts.tv_nsec;}
+static inline void QMTIK_serve_max(uint64_t* x, uint64_t v) {uint64_t old=__atomic_load_n(x, __ATOMIC_RELAXED); while (old<v&&!__atomic_compare_exchange_n(x, &old, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));}
+uint8_t QMTIK_serve_submit(QMTIK_Server* server, QMTIK_ServeRequest* request) {
+    size_t pos=__atomic_load_n(&server->head, __ATOMIC_RELAXED);
+    QMTIK_ServeSlot* slot;
+    for (;;){
+        slot=&server->slots[pos&(QMTIK_SERVE_QUEUE-1)];
+        ptrdiff_t dif=(ptrdiff_t)__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)-(ptrdiff_t)pos;
+        if (dif<0) return 1;
+        if (dif==0&&__atomic_compare_exchange_n(&server->head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        if (dif>0) pos=__atomic_load_n(&server->head, __ATOMIC_RELAXED);
+    }
+    request->submit_ns=QMTIK_serve_ns();
+    sem_init(&request->done, 0, 0);
+    slot->request=request;
+    __atomic_store_n(&slot->seq, pos+1, __ATOMIC_RELEASE);
+    QMTIK_serve_max(&server->max_depth, pos+1-__atomic_load_n(&server->tail, __ATOMIC_RELAXED));
+    sem_post(&server->queued);
+    return 0;
+}
+//NULL when the ring is empty or its oldest slot is claimed but not yet published
+static inline QMTIK_ServeRequest* QMTIK_serve_pop(QMTIK_Server* server) {
+    size_t pos=__atomic_load_n(&server->tail, __ATOMIC_RELAXED);
+    QMTIK_ServeSlot* slot;
+    for (;;){
+        slot=&server->slots[pos&(QMTIK_SERVE_QUEUE-1)];
+        ptrdiff_t dif=(ptrdiff_t)__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)-(ptrdiff_t)(pos+1);
+        if (dif<0) return NULL;
+        if (dif==0&&__atomic_compare_exchange_n(&server->tail, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        if (dif>0) pos=__atomic_load_n(&server->tail, __ATOMIC_RELAXED);
+    }
+    QMTIK_ServeRequest* request=slot->request;
+    __atomic_store_n(&slot->seq, pos+QMTIK_SERVE_QUEUE, __ATOMIC_RELEASE);
+    return request;
+}
+//Every queued semaphore count is one submitted request, or one of the n_workers counts QMTIK_serve_stop posts
+static inline QMTIK_ServeRequest* QMTIK_serve_take(QMTIK_Server* server) {
+    QMTIK_ServeRequest* request;
+    while (!(request=QMTIK_serve_pop(server))){
+        if (__atomic_load_n(&server->stop, __ATOMIC_ACQUIRE)) return NULL;
+        sched_yield();
+    }
+    return request;
+}
+static void* QMTIK_serve_worker(void* arg) {
+    QMTIK_Server* server=(QMTIK_Server*)arg;
+    QMTIK_ServeRequest* batch[QMTIK_SERVE_MAX_BATCH];
+    QMTIK_QActvT inputs[QMTIK_SERVE_MAX_BATCH][QMTIK_I], outputs[QMTIK_SERVE_MAX_BATCH][QMTIK_O];
+    for (;;){
+        size_t n=0;
+        while (sem_wait(&server->queued)&&errno==EINTR);
+        if (!(batch[n]=QMTIK_serve_take(server))) return NULL;
+        uint64_t deadline=batch[n++]->submit_ns+server->max_wait_ns;
+        while (n<server->max_batch){
+            uint64_t now=QMTIK_serve_ns();
+            int waited;
+            if (now>=deadline) waited=sem_trywait(&server->queued);
+            else{
+                //sem_timedwait only takes CLOCK_REALTIME, so the monotonic deadline is carried over as a remaining time
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                uint64_t at=(uint64_t)ts.tv_nsec+(deadline-now);
+                ts.tv_sec+=(time_t)(at/1000000000u); ts.tv_nsec=(long)(at%1000000000u);
+                while ((waited=sem_timedwait(&server->queued, &ts))&&errno==EINTR);
+            }
+            if (waited) break;
+            //a stop count taken mid batch is handed back so this worker still exits after replying
+            if (!(batch[n]=QMTIK_serve_take(server))) {sem_post(&server->queued); break;}
+            ++n;
+        }
+        for (size_t s=0; s<n; ++s) memcpy(inputs[s], batch[s]->input, QMTIK_I);
+        QMTIK_infer_forward_batch(server->q_model, inputs, outputs, n);
+        uint64_t now=QMTIK_serve_ns();
+        //counted before any done is posted, so a client whose waits returned sees its requests in QMTIK_serve_stats
+        __atomic_fetch_add(&server->requests, n, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&server->batches, 1, __ATOMIC_RELAXED);
+        for (size_t s=0; s<n; ++s){
+            uint64_t latency=now-batch[s]->submit_ns;
+            memcpy(batch[s]->output, outputs[s], QMTIK_O);
+            __atomic_fetch_add(&server->latency_ns, latency, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&server->latency_hist[63-__builtin_clzll(latency/1000+1)], 1, __ATOMIC_RELAXED);
+            QMTIK_serve_max(&server->latency_max_ns, latency);
+            sem_post(&batch[s]->done);
+        }
+    }
+}
+//q_model must stay loaded until QMTIK_serve_stop, max_batch is clamped to [1, QMTIK_SERVE_MAX_BATCH]
+uint8_t QMTIK_serve_start(QMTIK_Server* server, const QMTIK_QModel* q_model, size_t n_workers, size_t max_batch, double max_wait_us) {
+    memset(server, 0, sizeof(*server));
+    for (size_t i=0; i<QMTIK_SERVE_QUEUE; ++i) server->slots[i].seq=i;
+    server->q_model=q_model;
+    server->max_batch=(max_batch<1)?1:(max_batch>QMTIK_SERVE_MAX_BATCH)?QMTIK_SERVE_MAX_BATCH:max_batch;
+    server->max_wait_ns=(max_wait_us>0)?(uint64_t)(max_wait_us*1e3):0;
+    if (sem_init(&server->queued, 0, 0)) {perror("[QMTIK] Failed to create server queue"); return 1;}
+    if (n_workers>QMTIK_MAX_THREADS) n_workers=QMTIK_MAX_THREADS;
+    for (; server->n_workers<n_workers; ++server->n_workers){
+        if (pthread_create(&server->workers[server->n_workers], NULL, QMTIK_serve_worker, server)) {fprintf(stderr, "[QMTIK] Failed to start server worker %zu\n", server->n_workers); break;}
+    }
+    if (!server->n_workers) {sem_destroy(&server->queued); return 1;}
+    return 0;
+}
+void QMTIK_serve_wait(QMTIK_ServeRequest* request) {
+    while (sem_wait(&request->done)&&errno==EINTR);
+    sem_destroy(&request->done);
+}
+void QMTIK_serve_stats(QMTIK_Server* server, QMTIK_ServeStats* stats) {
+    uint64_t hist[64], seen=0;
+    memset(stats, 0, sizeof(*stats));
+    stats->requests=__atomic_load_n(&server->requests, __ATOMIC_RELAXED);
+    stats->batches=__atomic_load_n(&server->batches, __ATOMIC_RELAXED);
+    stats->max_depth=__atomic_load_n(&server->max_depth, __ATOMIC_RELAXED);
+    stats->depth=__atomic_load_n(&server->head, __ATOMIC_RELAXED)-__atomic_load_n(&server->tail, __ATOMIC_RELAXED);
+    if (!stats->requests) return;
+    for (size_t b=0; b<64; ++b) hist[b]=__atomic_load_n(&server->latency_hist[b], __ATOMIC_RELAXED);
+    stats->mean_batch=(double)stats->requests/(double)stats->batches;
+    stats->latency_us[0]=(double)__atomic_load_n(&server->latency_ns, __ATOMIC_RELAXED)/(double)stats->requests/1e3;
+    stats->latency_us[3]=(double)__atomic_load_n(&server->latency_max_ns, __ATOMIC_RELAXED)/1e3;
+    for (size_t b=0; b<64; ++b){
+        seen+=hist[b];
+        double bound=(double)((2ull<<b)-1);
+        if (stats->latency_us[1]==0&&seen*2>=stats->requests) stats->latency_us[1]=bound;
+        if (stats->latency_us[2]==0&&seen*100>=stats->requests*99) stats->latency_us[2]=bound;
+    }
+}
+//Submissions must have finished, queued requests are still answered before the workers exit
+void QMTIK_serve_stop(QMTIK_Server* server) {
+    __atomic_store_n(&server->stop, 1, __ATOMIC_RELEASE);
+    for (size_t t=0; t<server->n_workers; ++t) sem_post(&server->queued);
+    for (size_t t=0; t<server->n_workers; ++t) pthread_join(server->workers[t], NULL);
+    sem_destroy(&server->queued);
+    server->n_workers=0;
+}
+#endif
+//==================================================
+#ifdef QMTIK_BENCH
+static inline double QMTIK_bench_now(void) {struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (double)ts.tv_sec+ts.tv_nsec*1e-9;}
+static int QMTIK_compare_double(const void* a, const void* b) {double x=*(const double*)a, y=*(const double*)b; return (x>y)-(x<y);}
+//Times QMTIK_BENCH_LOADS loads of model_path, then iterations single-sample QMTIK_infer_forward calls (latencies holds one
+//entry per iteration), the same samples layer by layer, and QMTIK_infer_forward_batch over iterations samples
+uint8_t QMTIK_bench_infer(QMTIK_BenchResult* result, QMTIK_QNetwork* q_network, const char* model_path, const QMTIK_SamplePair* samples, size_t n_samples, double* latencies, size_t iterations) {
+    QMTIK_QActvT inputs[QMTIK_BATCH][QMTIK_I], outputs[QMTIK_BATCH][QMTIK_O];
+    double t0, total=0.0;
+    if (!n_samples||!iterations) {fprintf(stderr, "[QMTIK] Benchmark needs samples and iterations\n"); return 1;}
+    for (size_t r=0; r<QMTIK_BENCH_LOADS; ++r){
+        FILE* q_model_file=fopen(model_path, "rb");
+        if (!q_model_file) {perror("[QMTIK] Failed to open model file"); return 1;}
+        t0=QMTIK_bench_now();
+        uint8_t bad=QMTIK_load_model(q_network, q_model_file);
+        total+=QMTIK_bench_now()-t0;
+        fclose(q_model_file);
+        if (bad) return 1;
+    }
+    result->load_ms=total*1e3/QMTIK_BENCH_LOADS;
+    result->samples=n_samples;
+    result->iterations=iterations;
+    for (size_t it=0; it<iterations/10+1; ++it) {memcpy(q_network->q_context.q_i_actv, samples[it%n_samples].input, QMTIK_I); QMTIK_infer_forward(q_network);}
+    total=0.0;
+    for (size_t it=0; it<iterations; ++it){
+        memcpy(q_network->q_context.q_i_actv, samples[it%n_samples].input, QMTIK_I);
+        t0=QMTIK_bench_now();
+        QMTIK_infer_forward(q_network);
+        latencies[it]=(QMTIK_bench_now()-t0)*1e6;
+        total+=latencies[it];
+    }
+    qsort(latencies, iterations, sizeof(double), QMTIK_compare_double);
+    result->latency_us[0]=total/iterations;
+    result->latency_us[1]=latencies[(iterations-1)/2];
+    result->latency_us[2]=latencies[(size_t)((iterations-1)*0.99)];
+    result->latency_us[3]=latencies[(size_t)((iterations-1)*0.999)];
+    result->gops=2.0*((double)QMTIK_I*QMTIK_H+(double)QMTIK_L*QMTIK_H*QMTIK_H+(double)QMTIK_H*QMTIK_O)/(result->latency_us[0]*1e3);
+    for (size_t l=0; l<QMTIK_L+2; ++l) result->layer_us[l]=0.0;
+    for (size_t it=0; it<iterations; ++it){
+        memcpy(q_network->q_context.q_i_actv, samples[it%n_samples].input, QMTIK_I);
+        for (size_t l=0; l<QMTIK_L+2; ++l){
+            t0=QMTIK_bench_now();
+            QMTIK_infer_layer(&q_network->q_model, &q_network->q_context, l);
+            if (l==QMTIK_L+1) QMTIK_infer_post_process(q_network->q_context.q_o_z);
+            result->layer_us[l]+=(QMTIK_bench_now()-t0)*1e6/iterations;
+        }
+    }
+    t0=QMTIK_bench_now();
+    for (size_t done=0, m; done<iterations; done+=m){
+        m=(iterations-done<QMTIK_BATCH)?iterations-done:QMTIK_BATCH;
+        for (size_t s=0; s<m; ++s) memcpy(inputs[s], samples[(done+s)%n_samples].input, QMTIK_I);
+        QMTIK_infer_forward_batch(&q_network->q_model, inputs, outputs, m);
+    }
+    result->batch_per_s=iterations/(QMTIK_bench_now()-t0);
+    return 0;
+}
+//One pass of QMTIK_TRAIN_BATCH sized updates over the samples, the network is trained in place
+void QMTIK_bench_train(QMTIK_BenchResult* result, QMTIK_Network* network, QMTIK_TrainContext* contexts, size_t n_threads, const QMTIK_SamplePair* samples, size_t n_samples) {
+    const QMTIK_SamplePair* batch[QMTIK_TRAIN_BATCH];
+    if (!contexts||!n_threads) {contexts=&network->train_context; n_threads=1;}
+    if (n_threads>QMTIK_MAX_THREADS) n_threads=QMTIK_MAX_THREADS;
+    for (size_t c=0; c<n_threads; ++c) memset(&contexts[c].grads, 0, sizeof(QMTIK_Params));
+    QMTIK_refresh_wght_shadow(network);
+    QMTIK_select_kernel();
+    QMTIK_TRAIN_POOL_START(pool, network, contexts, n_threads)
+    double t0=QMTIK_bench_now();
+    for (size_t s0=0, n; s0<n_samples; s0+=n){
+        n=(n_samples-s0<QMTIK_TRAIN_BATCH)?n_samples-s0:QMTIK_TRAIN_BATCH;
+        for (size_t s=0; s<n; ++s) batch[s]=&samples[s0+s];
+        QMTIK_train_batch(network, batch, n, contexts, n_threads, pool);
+    }
+    QMTIK_TRAIN_POOL_STOP(pool)
+    result->n_threads=n_threads;
+    result->train_per_s=n_samples/(QMTIK_bench_now()-t0);
+}
+void QMTIK_write_bench_json(const QMTIK_BenchResult* result, FILE* json_file) {
+    fprintf(json_file, "{\n  \"version\": \"%s\",\n  \"kernel\": \"%s\",\n  \"topology\": [%d, %d, %d, %d],\n", QMTIK_VERSION, QMTIK_get_kernel_name(), QMTIK_I, QMTIK_H, QMTIK_L, QMTIK_O);
+    fprintf(json_file, "  \"weight_bits\": %d,\n  \"batch\": %d,\n  \"train_batch\": %d,\n  \"threads\": %zu,\n", QMTIK_WGHT_BITS, QMTIK_BATCH, QMTIK_TRAIN_BATCH, result->n_threads);
+    fprintf(json_file, "  \"samples\": %zu,\n  \"iterations\": %zu,\n  \"load_ms\": %.4f,\n", result->samples, result->iterations, result->load_ms);
+    fprintf(json_file, "  \"latency_us\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f},\n  \"layer_us\": [", result->latency_us[0], result->latency_us[1], result->latency_us[2], result->latency_us[3]);
+    for (size_t l=0; l<QMTIK_L+2; ++l) fprintf(json_file, "%s%.3f", l?", ":"", result->layer_us[l]);
+    fprintf(json_file, "],\n  \"gops\": %.3f,\n  \"batch_samples_per_s\": %.1f,\n  \"train_samples_per_s\": %.1f\n}\n", result->gops, result->batch_per_s, result->train_per_s);
+}
+#endif
 //==================================================
 size_t QMTIK_get_network_memory_usage(void) {return sizeof(QMTIK_Network);}
 size_t QMTIK_get_model_memory_usage(void) {return sizeof(QMTIK_Model);}
 size_t QMTIK_get_inference_memory_usage(void) {return sizeof(QMTIK_QNetwork);}
+size_t QMTIK_get_context_memory_usage(void) {return sizeof(QMTIK_QContext);}
+size_t QMTIK_get_train_context_memory_usage(void) {return sizeof(QMTIK_TrainContext);}
+size_t QMTIK_get_finetune_memory_usage(void) {return sizeof(QMTIK_FineTune);}
+const char* QMTIK_get_kernel_name(void) {return QMTIK_gemv_kernel_name;}
 //==================================================
 #endif
@@ -0,0 +1,46 @@
+//The activation and post processing tables must reproduce the float functions they replaced: sigmoid/tanh and the
+//sigmoid output exactly, the integer softmax within 1 and only where the float value sits on a half tie
+#include "test_config.h"
+
+#define SOFTMAX_SAMPLES 20000
+
+//The float softmax of the library before the tables, with the unrounded outputs kept for the tie check
+static inline void test_float_softmax(const QMTIK_QActvT* z, QMTIK_QActvT* out, float* exact) {
+    float temp[QMTIK_O], max_z=z[0]*QMTIK_A_SCALE, sum=0.0f;
+    for (size_t i=1; i<QMTIK_O; ++i) if (z[i]*QMTIK_A_SCALE>max_z) max_z=z[i]*QMTIK_A_SCALE;
+    for (size_t i=0; i<QMTIK_O; ++i) {temp[i]=expf(z[i]*QMTIK_A_SCALE-max_z); sum+=temp[i];}
+    for (size_t i=0; i<QMTIK_O; ++i) {exact[i]=(temp[i]/sum)*127; out[i]=(QMTIK_QActvT)roundf(exact[i]);}
+}
+
+int main(void) {
+    size_t bad=0, total=0;
+    QMTIK_build_luts();
+    #if defined(QMTIK_SIGMOID_ACTV)||defined(QMTIK_TANH_ACTV)
+        //every accumulator up to well past saturation, then the far ends
+        for (int64_t acc=-(1<<20); acc<=(1<<20); ++acc, ++total) bad+=QMTIK_infer_activation_q((QMTIK_QAccT)acc, NULL)!=QMTIK_infer_activation((QMTIK_MainT)acc*QMTIK_QACC_SCALE);
+        for (int64_t acc=INT32_MIN; acc<=INT32_MAX; acc+=65537, ++total) bad+=QMTIK_infer_activation_q((QMTIK_QAccT)acc, NULL)!=QMTIK_infer_activation((QMTIK_MainT)acc*QMTIK_QACC_SCALE);
+    #endif
+    #ifdef QMTIK_SIGMOID_PP
+        for (int z=QMTIK_QActvT_MIN; z<=QMTIK_QActvT_MAX; ++z, ++total){
+            QMTIK_QActvT q[QMTIK_O]={(QMTIK_QActvT)z};
+            QMTIK_infer_post_process(q);
+            bad+=q[0]!=(QMTIK_QActvT)roundf((1.0f/(1.0f+expf(-fmaxf(QMTIK_CLAMP_MIN, fminf(QMTIK_CLAMP_MAX, z*QMTIK_A_SCALE)))))*127.0f);
+        }
+    #endif
+    #ifdef QMTIK_SOFT_MAX_PP
+        for (size_t s=0; s<SOFTMAX_SAMPLES; ++s, ++total){
+            QMTIK_QActvT q[QMTIK_O], expected[QMTIK_O];
+            float exact[QMTIK_O];
+            //narrow spreads keep several outputs away from 0 so the rounding is exercised
+            float spread=(s%2)?255.0f:16.0f;
+            for (size_t i=0; i<QMTIK_O; ++i) q[i]=(QMTIK_QActvT)(test_random()*spread);
+            test_float_softmax(q, expected, exact);
+            QMTIK_infer_post_process(q);
+            for (size_t i=0; i<QMTIK_O; ++i){
+                int diff=abs(q[i]-expected[i]);
+                if (diff>1||(diff==1&&fabsf(exact[i]-floorf(exact[i])-0.5f)>1e-3f)) {++bad; break;}
+            }
+        }
+    #endif
+    return test_report("activation tables", bad, total);
+}
@@ -0,0 +1,70 @@
+//Kills checkpointed training at random points and resumes it until it finishes, the weights and Adam state must
+//end bit-identical to an uninterrupted run
+#define QMTIK_MMAP
+#define QMTIK_TRAIN_BATCH 4
+#include "test_config.h"
+#include <signal.h>
+#include <sys/wait.h>
+
+#define N_SAMPLES 4000
+#define EVERY 64
+#define MAX_RUNS 1000
+#define N_THREADS 2
+
+static QMTIK_TrainContext contexts[N_THREADS];
+
+//One training process from wherever the checkpoint stands, a fresh file gets the seeded weights
+static int train(const char* path) {
+    QMTIK_Checkpoint checkpoint;
+    FILE* file=fopen("checkpoint_kill.data", "rb");
+    if (!file) {perror("checkpoint_kill.data"); return 1;}
+    if (QMTIK_open_checkpoint(&checkpoint, path, EVERY)) {fclose(file); return 1;}
+    if (!checkpoint.resumed) {test_state=12345; test_network(checkpoint.network);}
+    int failed=QMTIK_resume_training(&checkpoint, file, NULL, contexts, N_THREADS);
+    QMTIK_close_checkpoint(&checkpoint);
+    fclose(file);
+    return failed;
+}
+static int run_child(const char* path, double kill_after, uint8_t* killed) {
+    int status;
+    pid_t pid=fork();
+    if (pid<0) {perror("fork"); return 1;}
+    if (!pid) _exit(train(path));
+    if (kill_after>=0) {struct timespec delay={(time_t)kill_after, (long)((kill_after-(double)(time_t)kill_after)*1e9)}; nanosleep(&delay, NULL); kill(pid, SIGKILL);}
+    if (waitpid(pid, &status, 0)<0) {perror("waitpid"); return 1;}
+    *killed=WIFSIGNALED(status)&&WTERMSIG(status)==SIGKILL;
+    return !*killed&&(!WIFEXITED(status)||WEXITSTATUS(status));
+}
+
+int main(void) {
+    uint8_t killed;
+    FILE* file=fopen("checkpoint_kill.data", "wb");
+    if (!file) {perror("checkpoint_kill.data"); return 1;}
+    for (size_t s=0; s<N_SAMPLES; ++s){
+        QMTIK_SamplePair pair;
+        test_input(pair.input, QMTIK_I);
+        for (size_t o=0; o<QMTIK_O; ++o) pair.output[o]=(QMTIK_QActvT)((o==s%QMTIK_O)?127:0);
+        fwrite(&pair, sizeof(pair), 1, file);
+    }
+    fclose(file);
+    remove("checkpoint_kill.ref"); remove("checkpoint_kill.ckp");
+    double start=QMTIK_wall_seconds();
+    if (run_child("checkpoint_kill.ref", -1, &killed)) {fprintf(stderr, "uninterrupted run failed\n"); return 1;}
+    double seconds=QMTIK_wall_seconds()-start;
+    size_t runs=0, kills=0;
+    for (killed=1; killed&&runs<MAX_RUNS; ++runs){
+        if (run_child("checkpoint_kill.ckp", (test_random()+0.5f)*seconds/8, &killed)) {fprintf(stderr, "resumed run failed\n"); return 1;}
+        kills+=killed;
+    }
+    if (killed) {fprintf(stderr, "no run finished in %d tries\n", MAX_RUNS); return 1;}
+    QMTIK_Checkpoint ref, ckp;
+    if (QMTIK_open_checkpoint(&ref, "checkpoint_kill.ref", EVERY)||QMTIK_open_checkpoint(&ckp, "checkpoint_kill.ckp", EVERY)) return 1;
+    size_t bad=(ckp.header->epoch!=QMTIK_EPOCHS)
+        +(memcmp(ref.network, ckp.network, sizeof(QMTIK_Params))!=0)
+        +(memcmp(&ref.network->adam_state, &ckp.network->adam_state, sizeof(QMTIK_AdamState))!=0);
+    printf("checkpoint kill: %zu kills over %zu runs of up to %.3fs\n", kills, runs, seconds);
+    QMTIK_close_checkpoint(&ref);
+    QMTIK_close_checkpoint(&ckp);
+    remove("checkpoint_kill.data"); remove("checkpoint_kill.ref"); remove("checkpoint_kill.ckp");
+    return test_report("checkpoint kill", bad, 3);
+}
@@ -0,0 +1,35 @@
+//The C emitted by QMTIK_compile_model must give the same outputs as QMTIK_infer. Built plain it writes
+//compiled_model_gen.c/.h, built with -DTEST_COMPILED and the generated file it checks them against the library
+#include "test_config.h"
+#ifdef TEST_COMPILED
+    #include "compiled_model_gen.h"
+#endif
+
+#define SAMPLES 500
+
+int main(void) {
+    static QMTIK_Network network;
+    static QMTIK_QModel q_model;
+    test_network(&network);
+    if (test_q_model(&network, &q_model)) return 1;
+    #ifndef TEST_COMPILED
+        FILE* c_file=fopen("compiled_model_gen.c", "w");
+        FILE* h_file=fopen("compiled_model_gen.h", "w");
+        if (!c_file||!h_file) {perror("compiled_model_gen"); return 1;}
+        uint8_t failed=QMTIK_compile_model(&q_model, "compiled_model_gen", 8, c_file, h_file);
+        fclose(c_file);
+        fclose(h_file);
+        return failed;
+    #else
+        static QMTIK_QContext q_context;
+        int8_t output[QMTIK_O];
+        size_t bad=0;
+        for (size_t s=0; s<SAMPLES; ++s){
+            test_input(q_context.q_i_actv, QMTIK_I);
+            QMTIK_infer(&q_model, &q_context);
+            compiled_model_gen_infer(q_context.q_i_actv, output);
+            bad+=memcmp(output, q_context.q_o_z, QMTIK_O)!=0;
+        }
+        return test_report("compiled model", bad, SAMPLES);
+    #endif
+}
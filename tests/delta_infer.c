@@ -0,0 +1,24 @@
+//QMTIK_infer_forward_delta must give the same outputs as QMTIK_infer_forward on a stream of slowly changing frames
+#include "test_config.h"
+
+int main(void) {
+    static QMTIK_Network network;
+    static QMTIK_QNetwork full, delta;
+    QMTIK_QDelta q_delta;
+    size_t bad=0, frames=500;
+    test_network(&network);
+    if (test_q_model(&network, &full.q_model)) return 1;
+    delta.q_model=full.q_model;
+    QMTIK_reset_delta(&q_delta);
+    test_input(full.q_context.q_i_actv, QMTIK_I);
+    for (size_t f=0; f<frames; ++f){
+        //mostly a few inputs change, now and then all of them
+        size_t changes=(f%50==49)?QMTIK_I:(size_t)((test_random()+0.5f)*4.0f)+1;
+        for (size_t c=0; c<changes; ++c) full.q_context.q_i_actv[(size_t)((test_random()+0.5f)*QMTIK_I)%QMTIK_I]=(QMTIK_QActvT)(test_random()*255.0f);
+        memcpy(delta.q_context.q_i_actv, full.q_context.q_i_actv, QMTIK_I);
+        QMTIK_infer_forward(&full);
+        QMTIK_infer_forward_delta(&delta, &q_delta);
+        bad+=memcmp(full.q_context.q_o_z, delta.q_context.q_o_z, QMTIK_O)!=0;
+    }
+    return test_report("delta inference", bad, frames);
+}
@@ -0,0 +1,31 @@
+//QMTIK_infer_parallel must give the same activations as QMTIK_infer for every pool size, including pools with more
+//threads than output panels so some threads own no rows
+#include "test_config.h"
+
+#define SAMPLES 200
+
+int main(void) {
+    static const size_t sizes[]={2, 3, 4, 7};
+    static QMTIK_Network network;
+    static QMTIK_QModel q_model;
+    static QMTIK_QContext expected, q_context;
+    QMTIK_InferPool pool;
+    int failed=0;
+    test_network(&network);
+    if (test_q_model(&network, &q_model)) return 1;
+    for (size_t p=0; p<sizeof(sizes)/sizeof(sizes[0]); ++p){
+        size_t bad=0;
+        if (QMTIK_start_infer_pool(&pool, sizes[p], 0)) return 1;
+        for (size_t s=0; s<SAMPLES; ++s){
+            test_input(expected.q_i_actv, QMTIK_I);
+            memcpy(q_context.q_i_actv, expected.q_i_actv, QMTIK_I);
+            QMTIK_infer(&q_model, &expected);
+            QMTIK_infer_parallel(&pool, &q_model, &q_context);
+            bad+=memcmp(&expected, &q_context, sizeof(QMTIK_QContext))!=0;
+        }
+        QMTIK_stop_infer_pool(&pool);
+        printf("%zu threads ", sizes[p]);
+        failed|=test_report("infer pool", bad, SAMPLES);
+    }
+    return failed;
+}
@@ -0,0 +1,39 @@
+//Model files are the same for every build: "store" writes one through a pipe, "check" loads and maps the file
+//written by the other build and compares both against this build's own quantized model
+#define QMTIK_MMAP
+#include "test_config.h"
+
+#define MODEL_PATH "model_file.qmtik"
+
+int main(int argc, char** argv) {
+    static QMTIK_Network network;
+    static QMTIK_Model model;
+    static QMTIK_QModel own, loaded;
+    QMTIK_QContext contexts[3];
+    QMTIK_MappedModel mapped;
+    size_t bad=0, samples=200;
+    test_network(&network);
+    if (argc>1&&!strcmp(argv[1], "store")){
+        FILE* pipe=popen("cat > " MODEL_PATH, "w");
+        if (!pipe) {perror("popen"); return 1;}
+        QMTIK_quantize_to_model(&network, &model);
+        uint8_t failed=QMTIK_store_model(&model, pipe);
+        return (pclose(pipe)!=0)|failed;
+    }
+    FILE* file=fopen(MODEL_PATH, "rb");
+    if (!file) {perror(MODEL_PATH); return 1;}
+    uint8_t failed=QMTIK_load_q_model(&loaded, file);
+    fclose(file);
+    if (failed||test_q_model(&network, &own)||QMTIK_map_model(&mapped, MODEL_PATH)) return 1;
+    for (size_t s=0; s<samples; ++s){
+        test_input(contexts[0].q_i_actv, QMTIK_I);
+        memcpy(contexts[1].q_i_actv, contexts[0].q_i_actv, QMTIK_I);
+        memcpy(contexts[2].q_i_actv, contexts[0].q_i_actv, QMTIK_I);
+        QMTIK_infer(&own, &contexts[0]);
+        QMTIK_infer(&loaded, &contexts[1]);
+        QMTIK_infer(mapped.q_model, &contexts[2]);
+        bad+=memcmp(contexts[0].q_o_z, contexts[1].q_o_z, QMTIK_O)||memcmp(contexts[0].q_o_z, contexts[2].q_o_z, QMTIK_O);
+    }
+    QMTIK_unmap_model(&mapped);
+    return test_report("model file", bad, samples);
+}
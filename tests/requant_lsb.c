@@ -0,0 +1,47 @@
+//The integer engine must stay within one LSB of the float path it replaced: the requantizer on its own over a sweep of
+//multipliers, then every layer fed the same input activations as the integer one
+#include "test_config.h"
+#include <stdlib.h>
+
+//The float path: dequantized MACs, the training activation, then rounding back to activation codes
+static inline QMTIK_QActvT test_float_actv(const QMTIK_QWghtT* wght, QMTIK_QWghtT bias, const QMTIK_QActvT* in, size_t k, uint8_t actv) {
+    QMTIK_MainT acc=bias*QMTIK_W_SCALE;
+    for (size_t j=0; j<k; ++j) acc+=(wght[j]*QMTIK_W_SCALE)*(in[j]*QMTIK_A_SCALE);
+    if (actv) acc=QMTIK_train_activation(acc);
+    return (QMTIK_QActvT)fmaxf(QMTIK_QActvT_MIN, fminf(QMTIK_QActvT_MAX, roundf(acc/QMTIK_A_SCALE)));
+}
+static inline size_t test_requant(void) {
+    size_t bad=0;
+    for (int e=-24; e<30; ++e) for (size_t n=0; n<200; ++n){
+        double m=ldexp(1.0+(test_random()+0.5f), e);
+        QMTIK_QAccT acc=(QMTIK_QAccT)(test_random()*ldexp(1.0, (e<0)?22:22-e));
+        double expected=(double)acc*(float)m;
+        bad+=fabs((double)QMTIK_requantize(acc, QMTIK_make_requant((QMTIK_MainT)m))-expected)>1.0;
+    }
+    //out of range multipliers saturate instead of wrapping
+    QMTIK_QRequant rq=QMTIK_make_requant(4.0e9f);
+    bad+=rq.mult!=INT32_MAX||rq.shift!=1;
+    return bad;
+}
+
+int main(void) {
+    static QMTIK_Network network;
+    static QMTIK_QNetwork q_network;
+    QMTIK_QModel* q_model=&q_network.q_model;
+    QMTIK_QContext* q_context=&q_network.q_context;
+    size_t bad=test_requant(), total=54*200+1, samples=200;
+    test_network(&network);
+    if (test_q_model(&network, q_model)) return 1;
+    for (size_t s=0; s<samples; ++s){
+        test_input(q_context->q_i_actv, QMTIK_I);
+        QMTIK_infer_logits(q_model, q_context);
+        for (size_t i=0; i<QMTIK_H; ++i) bad+=abs(test_float_actv(q_model->q_ih_layer.q_ih_wght[i], q_model->q_ih_layer.q_ih_bias[i], q_context->q_i_actv, QMTIK_I, 1)-q_context->q_ih_actv[i])>1;
+        for (size_t l=0; l<QMTIK_L; ++l){
+            const QMTIK_QActvT* in=l?q_context->q_hh_actv[l-1]:q_context->q_ih_actv;
+            for (size_t i=0; i<QMTIK_H; ++i) bad+=abs(test_float_actv(q_model->q_hh_layers[l].q_hh_wght[i], q_model->q_hh_layers[l].q_hh_bias[i], in, QMTIK_H, 1)-q_context->q_hh_actv[l][i])>1;
+        }
+        for (size_t i=0; i<QMTIK_O; ++i) bad+=abs(test_float_actv(q_model->q_o_layer.q_o_wght[i], q_model->q_o_layer.q_o_bias[i], q_context->q_hh_actv[QMTIK_L-1], QMTIK_H, 0)-q_context->q_o_z[i])>1;
+        total+=QMTIK_H*(1+QMTIK_L)+QMTIK_O;
+    }
+    return test_report("requantization within 1 LSB", bad, total);
+}
@@ -0,0 +1,65 @@
+//Every SIMD kernel this CPU supports must give byte-identical activations to the portable loops, one sample at a time
+//and batched, with the column kernels both always and never taken under QMTIK_SKIP_ZERO_ACTV
+#define QMTIK_SIMD
+#include "test_config.h"
+
+#define SAMPLES 64
+#ifdef QMTIK_SKIP_ZERO_ACTV
+    #define TEST_DENSITIES 2
+#else
+    #define TEST_DENSITIES 1
+#endif
+
+static QMTIK_QActvT inputs[SAMPLES][QMTIK_I], outputs[SAMPLES][QMTIK_O];
+static QMTIK_QContext expected[SAMPLES];
+
+//Overrides what QMTIK_select_kernel picked, density is the column kernel cutoff (0 never, 2 always)
+#define TEST_USE(isa, column_isa, density) {QMTIK_gemv_kernel=QMTIK_gemv_##isa; QMTIK_SET_GEMV4(isa) QMTIK_SET_SPARSE(isa) QMTIK_SET_COLUMN(column_isa, density)}
+static inline void test_use_portable(void) {
+    QMTIK_gemv_kernel=NULL;
+    #ifdef QMTIK_INT4_WGHT
+        QMTIK_gemv4_kernel=NULL;
+    #endif
+    QMTIK_SET_SPARSE(portable)
+    QMTIK_SET_COLUMN(portable, 0.0f)
+}
+static inline int test_kernel(const QMTIK_QModel* q_model, const char* isa) {
+    static QMTIK_QContext q_context;
+    size_t bad=0;
+    for (size_t s=0; s<SAMPLES; ++s){
+        memcpy(q_context.q_i_actv, inputs[s], QMTIK_I);
+        QMTIK_infer(q_model, &q_context);
+        bad+=memcmp(&q_context, &expected[s], sizeof(QMTIK_QContext))!=0;
+    }
+    QMTIK_infer_forward_batch(q_model, inputs, outputs, SAMPLES);
+    for (size_t s=0; s<SAMPLES; ++s) bad+=memcmp(outputs[s], expected[s].q_o_z, QMTIK_O)!=0;
+    printf("%s ", isa);
+    return test_report("simd kernel", bad, 2*SAMPLES);
+}
+
+int main(void) {
+    static QMTIK_Network network;
+    static QMTIK_QModel q_model;
+    int failed=0;
+    test_network(&network);
+    if (test_q_model(&network, &q_model)) return 1;
+    //every other sample is mostly zeros so the column kernels see sparse inputs too
+    for (size_t s=0; s<SAMPLES; ++s){
+        test_input(inputs[s], QMTIK_I);
+        if (s%2) for (size_t i=0; i<QMTIK_I; ++i) if ((test_random()+0.5f)<0.75f) inputs[s][i]=0;
+    }
+    test_use_portable();
+    for (size_t s=0; s<SAMPLES; ++s) {memcpy(expected[s].q_i_actv, inputs[s], QMTIK_I); QMTIK_infer(&q_model, &expected[s]);}
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")){
+        for (int d=0; d<TEST_DENSITIES; ++d) {TEST_USE(sse41, sse41, 2.0f*(QMTIK_MainT)d) failed|=test_kernel(&q_model, d?"sse4.1 columns":"sse4.1");}
+    }
+    if (__builtin_cpu_supports("avx2")){
+        for (int d=0; d<TEST_DENSITIES; ++d) {TEST_USE(avx2, avx2, 2.0f*(QMTIK_MainT)d) failed|=test_kernel(&q_model, d?"avx2 columns":"avx2");}
+    }
+    if (__builtin_cpu_supports("avx512f")&&__builtin_cpu_supports("avx512bw")&&__builtin_cpu_supports("avx512vnni")){
+        for (int d=0; d<TEST_DENSITIES; ++d) {TEST_USE(avx512vnni, avx2, 2.0f*(QMTIK_MainT)d) failed|=test_kernel(&q_model, d?"avx512vnni columns":"avx512vnni");}
+    }
+    else printf("avx512vnni simd kernel [%s]: not supported here, skipped\n", TEST_BUILD);
+    return failed;
+}
@@ -0,0 +1,70 @@
+//Streams a file whose sample count is not a multiple of chunk_size and checks every epoch yields each sample once
+#define QMTIK_I 8
+#define QMTIK_H 8
+#define QMTIK_L 1
+#define QMTIK_O 2
+#define QMTIK_W_SCALE 0.05f
+#define QMTIK_A_SCALE 0.5f
+#define QMTIK_ALPHA 0.001f
+#define QMTIK_EPOCHS 1
+#define QMTIK_BETA1 0.9f
+#define QMTIK_BETA2 0.999f
+#define QMTIK_EPS 1e-8f
+#define QMTIK_TRAIN_BATCH 16
+#define QMTIK_BATCH 16
+#define QMTIK_RELU_ACTV
+#define QMTIK_LINEAR_PP
+#define QMTIK_MSE_COST
+#define QMTIK_THREADS
+#define QMTIK_IMPLEMENTATION
+#include "../qmtik.h"
+#include <signal.h>
+
+#define N_SAMPLES 100
+
+static QMTIK_SamplePair buffer[2*64];
+
+static int run(FILE* file, size_t chunk_size, size_t n, uint64_t seed) {
+    QMTIK_Dataset dataset;
+    const QMTIK_SamplePair* batch[64];
+    if (QMTIK_stream_dataset(&dataset, file, buffer, chunk_size)) return 1;
+    QMTIK_shuffle_dataset(&dataset, seed);
+    int failed=0;
+    for (int epoch=0; epoch<3; ++epoch){
+        uint8_t seen[N_SAMPLES]={0};
+        size_t total=0, count;
+        QMTIK_rewind_dataset(&dataset);
+        while ((count=QMTIK_dataset_batch(&dataset, batch, n))){
+            for (size_t s=0; s<count; ++s){
+                size_t id=(size_t)(uint8_t)batch[s]->input[0]|(size_t)(uint8_t)batch[s]->input[1]<<8;
+                if (id<N_SAMPLES) ++seen[id];
+            }
+            total+=count;
+        }
+        for (size_t i=0; i<N_SAMPLES; ++i) if (seen[i]!=1) failed=1;
+        if (total!=N_SAMPLES) failed=1;
+    }
+    QMTIK_close_dataset(&dataset);
+    printf("chunk %zu batch %zu seed %llu: %s\n", chunk_size, n, (unsigned long long)seed, failed?"FAILED":"ok");
+    return failed;
+}
+
+int main(void) {
+    static const size_t cases[][2]={{32, 16}, {32, 32}, {64, 64}, {64, 32}, {64, 20}, {32, 7}};
+    FILE* file=tmpfile();
+    if (!file) {perror("tmpfile"); return 1;}
+    for (size_t i=0; i<N_SAMPLES; ++i){
+        QMTIK_SamplePair pair={{0}, {0}};
+        pair.input[0]=(QMTIK_QActvT)(i&0xFF); pair.input[1]=(QMTIK_QActvT)(i>>8);
+        fwrite(&pair, sizeof(pair), 1, file);
+    }
+    //a hang in the read-ahead thread fails the test instead of blocking it
+    alarm(30);
+    int failed=0;
+    for (size_t c=0; c<sizeof(cases)/sizeof(cases[0]); ++c){
+        failed|=run(file, cases[c][0], cases[c][1], 0);
+        failed|=run(file, cases[c][0], cases[c][1], 42);
+    }
+    fclose(file);
+    return failed;
+}
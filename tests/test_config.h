@@ -0,0 +1,64 @@
+//Shared configuration and fixtures of the tests, an odd input width leaves half-packed rows and few outputs leave padded panel rows
+#define QMTIK_I 45
+#define QMTIK_H 48
+#define QMTIK_L 2
+#define QMTIK_O 6
+#define QMTIK_W_SCALE 0.05f
+#define QMTIK_A_SCALE 0.5f
+#define QMTIK_ALPHA 0.001f
+#define QMTIK_EPOCHS 2
+#define QMTIK_BETA1 0.9f
+#define QMTIK_BETA2 0.999f
+#define QMTIK_EPS 1e-8f
+#if !defined(QMTIK_RELU_ACTV)&&!defined(QMTIK_SIGMOID_ACTV)&&!defined(QMTIK_TANH_ACTV)
+    #define QMTIK_LEAKY_RELU_ACTV
+#endif
+#if !defined(QMTIK_LINEAR_PP)&&!defined(QMTIK_SIGMOID_PP)
+    #define QMTIK_SOFT_MAX_PP
+#endif
+#define QMTIK_CROSS_ENTROPY_COST
+#define QMTIK_THREADS
+#ifndef TEST_BUILD
+    #define TEST_BUILD "int8"
+#endif
+#define QMTIK_IMPLEMENTATION
+#include "../qmtik.h"
+
+static uint32_t test_state=12345;
+static inline float test_random(void) {test_state=test_state*1664525u+1013904223u; return (float)(test_state>>8)/16777216.0f-0.5f;}
+static inline void test_input(QMTIK_QActvT* x, size_t n) {for (size_t i=0; i<n; ++i) x[i]=(QMTIK_QActvT)(test_random()*255.0f);}
+//Seeded weights instead of QMTIK_init_weights, which seeds rand from the clock
+static inline void test_network(QMTIK_Network* network) {
+    memset(network, 0, sizeof(QMTIK_Network));
+    for (size_t i=0; i<QMTIK_H; ++i){
+        network->ih_layer.ih_bias[i]=test_random()*0.5f;
+        for (size_t j=0; j<QMTIK_I; ++j) network->ih_layer.ih_wght[i][j]=test_random()*0.4f;
+    }
+    for (size_t l=0; l<QMTIK_L; ++l) for (size_t i=0; i<QMTIK_H; ++i){
+        network->hh_layers[l].hh_bias[i]=test_random()*0.5f;
+        for (size_t j=0; j<QMTIK_H; ++j) network->hh_layers[l].hh_wght[i][j]=test_random()*0.4f;
+    }
+    for (size_t i=0; i<QMTIK_O; ++i){
+        network->o_layer.o_bias[i]=test_random()*0.5f;
+        for (size_t j=0; j<QMTIK_H; ++j) network->o_layer.o_wght[i][j]=test_random()*0.4f;
+    }
+    #ifdef QMTIK_PRUNE_PERCENT
+        QMTIK_prune_input_layer(network, 1.0f);
+    #endif
+}
+//Quantizes the network through a model file, the only way from QMTIK_Model to QMTIK_QModel
+static inline int test_q_model(QMTIK_Network* network, QMTIK_QModel* q_model) {
+    static QMTIK_Model model;
+    FILE* file=tmpfile();
+    if (!file) {perror("tmpfile"); return 1;}
+    QMTIK_quantize_to_model(network, &model);
+    int failed=QMTIK_store_model(&model, file);
+    rewind(file);
+    failed|=QMTIK_load_q_model(q_model, file);
+    fclose(file);
+    return failed;
+}
+static inline int test_report(const char* name, size_t bad, size_t total) {
+    printf("%s [%s]: %s (%zu of %zu differ)\n", name, TEST_BUILD, bad?"FAILED":"ok", bad, total);
+    return bad!=0;
+}